@@ -0,0 +1,336 @@
+#ifndef ASIO_BENCH_HARNESS_HPP
+#define ASIO_BENCH_HARNESS_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace io_service {
+
+namespace bench {
+
+typedef std::chrono::steady_clock bench_clock;
+
+// Named values, measured by single run of scenario
+typedef std::vector<std::pair<std::string, double>> metrics;
+
+inline double to_ns(bench_clock::duration dur)
+{ return std::chrono::duration<double, std::nano>(dur).count(); }
+
+inline double per_second(std::size_t num_ops, bench_clock::duration dur)
+{ return num_ops / std::chrono::duration<double>(dur).count(); }
+
+// Nearest-rank percentile. Sorts samples
+inline double percentile(std::vector<double>& samples, double pct) {
+    if(samples.empty())
+        return 0;
+
+    std::sort(samples.begin(), samples.end());
+    const std::size_t rank =
+        static_cast<std::size_t>(pct / 100 * (samples.size() - 1) + 0.5);
+    return samples[std::min(rank, samples.size() - 1)];
+}
+
+// Adds p50 / p90 / p99 / p99.9 / max of samples under prefix
+inline void add_percentiles(
+    metrics& out, const std::string& prefix, std::vector<double>& samples
+) {
+    out.emplace_back(prefix + "_p50", percentile(samples, 50));
+    out.emplace_back(prefix + "_p90", percentile(samples, 90));
+    out.emplace_back(prefix + "_p99", percentile(samples, 99));
+    out.emplace_back(prefix + "_p999", percentile(samples, 99.9));
+    out.emplace_back(prefix + "_max", samples.empty() ? 0 : samples.back());
+}
+
+
+struct options {
+    // Runs of each scenario, after single warm-up run
+    unsigned repetitions;
+    // Divides operation counts. Smoke runs use 10 or so
+    unsigned scale_down;
+    std::vector<unsigned> thread_counts;
+    // Scenarios, whose name contains it. Empty for all
+    std::string filter;
+    // JSON goes to stdout, if empty
+    std::string json_path;
+
+public:
+    options()
+        : repetitions(5)
+        , scale_down(1)
+        , thread_counts()
+        , filter()
+        , json_path()
+    {
+        const unsigned max_threads =
+            std::max(2u, std::thread::hardware_concurrency());
+        for(unsigned num = 1; num <= max_threads; num *= 2)
+            thread_counts.push_back(num);
+    }
+
+    std::size_t scaled(std::size_t num_ops) const
+    { return std::max<std::size_t>(1, num_ops / scale_down); }
+
+}; // struct options
+
+
+// Runs scenarios, prints summary as they go, and writes results as JSON:
+// median, min and max of each metric over repetitions
+class runner {
+private:
+    struct result {
+        std::string name;
+        std::map<std::string, std::string> params;
+        std::vector<std::string> metric_names;
+        std::map<std::string, std::vector<double>> samples;
+    };
+
+private:
+    std::string m_suite;
+    options m_options;
+    std::vector<result> m_results;
+
+public:
+    runner(std::string suite, options opts)
+        : m_suite(std::move(suite))
+        , m_options(std::move(opts))
+        , m_results()
+    {}
+
+public:
+    const options& opts() const
+    { return m_options; }
+
+    void run(
+        const std::string& name,
+        const std::map<std::string, std::string>& params,
+        const std::function<metrics()>& scenario
+    ) {
+        const std::string full_name = S_full_name(name, params);
+        if(!m_options.filter.empty()
+            && full_name.find(m_options.filter) == std::string::npos
+        )
+            return;
+
+        result res;
+        res.name = name;
+        res.params = params;
+
+        scenario(); /*warm-up*/
+        for(unsigned i = 0; i < m_options.repetitions; ++i) {
+            for(const auto& [metric, value] : scenario()) {
+                if(res.samples.find(metric) == res.samples.end())
+                    res.metric_names.push_back(metric);
+                res.samples[metric].push_back(value);
+            }
+        }
+
+        std::cerr << full_name << '\n';
+        for(const std::string& metric : res.metric_names) {
+            std::vector<double>& values = res.samples[metric];
+            std::sort(values.begin(), values.end());
+            std::cerr << "    " << std::left << std::setw(28) << metric
+                << std::fixed << std::setprecision(1)
+                << S_median(values) << '\n';
+        }
+
+        m_results.push_back(std::move(res));
+    }
+
+    // Returns process exit code
+    int finish() const {
+        if(m_options.json_path.empty()) {
+            M_write_json(std::cout);
+            return EXIT_SUCCESS;
+        }
+
+        std::ostringstream json;
+        M_write_json(json);
+
+        std::FILE* file = std::fopen(m_options.json_path.c_str(), "w");
+        if(!file) {
+            std::cerr << "Can not open " << m_options.json_path << '\n';
+            return EXIT_FAILURE;
+        }
+
+        const std::string text = json.str();
+        std::fwrite(text.data(), 1, text.size(), file);
+        std::fclose(file);
+        return EXIT_SUCCESS;
+    }
+
+// Impl funcs
+private:
+    void M_write_json(std::ostream& os) const {
+        os << "{\n  \"suite\": " << S_quoted(m_suite) << ",\n"
+            << "  \"context\": {\n"
+            << "    \"date\": " << S_quoted(S_date()) << ",\n"
+            << "    \"compiler\": " << S_quoted(S_compiler()) << ",\n"
+            << "    \"ndebug\": " << S_bool(S_is_ndebug()) << ",\n"
+            << "    \"mpmc_global_queue\": " << S_bool(S_is_mpmc()) << ",\n"
+            << "    \"hardware_concurrency\": "
+                << std::thread::hardware_concurrency() << ",\n"
+            << "    \"repetitions\": " << m_options.repetitions << ",\n"
+            << "    \"scale_down\": " << m_options.scale_down << "\n"
+            << "  },\n"
+            << "  \"results\": [";
+
+        const char* sep = "\n";
+        for(const result& res : m_results) {
+            os << sep << "    {\n      \"name\": " << S_quoted(res.name)
+                << ",\n      \"params\": {";
+
+            const char* param_sep = "";
+            for(const auto& [key, value] : res.params) {
+                os << param_sep << S_quoted(key) << ": " << S_quoted(value);
+                param_sep = ", ";
+            }
+            os << "},\n      \"metrics\": {";
+
+            const char* metric_sep = "\n";
+            for(const std::string& metric : res.metric_names) {
+                const std::vector<double>& values = res.samples.at(metric);
+                os << metric_sep << "        " << S_quoted(metric)
+                    << ": {\"median\": " << S_number(S_median(values))
+                    << ", \"min\": " << S_number(values.front())
+                    << ", \"max\": " << S_number(values.back()) << "}";
+                metric_sep = ",\n";
+            }
+            os << "\n      }\n    }";
+            sep = ",\n";
+        }
+        os << "\n  ]\n}\n";
+    }
+
+    // Prereq: values - sorted, non-empty
+    static double S_median(const std::vector<double>& values)
+    { return values[values.size() / 2]; }
+
+    static std::string S_full_name(
+        const std::string& name, const std::map<std::string, std::string>& params
+    ) {
+        std::string full_name = name;
+        for(const auto& [key, value] : params)
+            full_name += "/" + key + "=" + value;
+        return full_name;
+    }
+
+    static std::string S_quoted(const std::string& str) {
+        std::string quoted = "\"";
+        for(char ch : str) {
+            if(ch == '"' || ch == '\\')
+                quoted += '\\';
+            quoted += ch;
+        }
+        return quoted + "\"";
+    }
+
+    static std::string S_number(double value) {
+        std::ostringstream os;
+        os << std::setprecision(6) << value;
+        return os.str();
+    }
+
+    static const char* S_bool(bool value)
+    { return value ? "true" : "false"; }
+
+    static std::string S_date() {
+        const std::time_t now = std::time(nullptr);
+        char buf[32];
+        std::strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+        return buf;
+    }
+
+    static std::string S_compiler() {
+#if defined(__clang__)
+        return "clang " __clang_version__;
+#elif defined(__GNUC__)
+        return "gcc " __VERSION__;
+#else
+        return "unknown";
+#endif
+    }
+
+    static bool S_is_ndebug() {
+#ifdef NDEBUG
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    static bool S_is_mpmc() {
+#ifdef IO_SERVICE_MPMC_GLOBAL_QUEUE
+        return true;
+#else
+        return false;
+#endif
+    }
+
+}; // class runner
+
+
+// Parses --repetitions N, --scale-down N, --threads 1,2,4,
+// --filter STR, --json PATH. Exits on --help or bad argument
+inline options parse_options(int argc, char* argv[]) {
+    options opts;
+
+    auto usage =
+        [argv] (int code) {
+            std::cerr << "usage: " << argv[0]
+                << " [--repetitions N] [--scale-down N] [--threads 1,2,4]"
+                   " [--filter STR] [--json PATH]\n";
+            std::exit(code);
+        };
+
+    for(int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if(arg == "--help" || arg == "-h")
+            usage(EXIT_SUCCESS);
+        if(i + 1 >= argc)
+            usage(EXIT_FAILURE);
+
+        const std::string value = argv[++i];
+        if(arg == "--repetitions") {
+            opts.repetitions = std::max(1, std::atoi(value.c_str()));
+        } else if(arg == "--scale-down") {
+            opts.scale_down = std::max(1, std::atoi(value.c_str()));
+        } else if(arg == "--filter") {
+            opts.filter = value;
+        } else if(arg == "--json") {
+            opts.json_path = value;
+        } else if(arg == "--threads") {
+            opts.thread_counts.clear();
+            std::istringstream is(value);
+            std::string count;
+            while(std::getline(is, count, ','))
+                if(std::atoi(count.c_str()) > 0)
+                    opts.thread_counts.push_back(std::atoi(count.c_str()));
+            if(opts.thread_counts.empty())
+                usage(EXIT_FAILURE);
+        } else {
+            usage(EXIT_FAILURE);
+        }
+    }
+
+    return opts;
+}
+
+} // namespace bench
+
+} // namespace io_service
+
+#endif // ASIO_BENCH_HARNESS_HPP
@@ -0,0 +1,309 @@
+#include "bench_harness.hpp"
+
+#include "io_service.hpp"
+
+#include "jthread.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+// End-to-end scenarios of io_service. Each one builds its own service,
+// so that runs do not share state.
+// Summary goes to stderr, JSON to stdout or --json file
+
+namespace io_service {
+
+namespace bench {
+
+namespace {
+
+void run_worker(io_service* serv_ptr) {
+    try {
+        serv_ptr->run();
+    } catch(const service_stopped_error&) {}
+}
+
+// Joined on destruction. Service has to be stopped before
+struct worker_pool {
+    std::vector<concurrency::jthread> threads;
+
+    worker_pool(io_service& serv, unsigned num_threads) {
+        for(unsigned i = 0; i < num_threads; ++i)
+            threads.emplace_back(run_worker, &serv);
+    }
+};
+
+void wait_for(const std::atomic<std::size_t>& counter, std::size_t value) {
+    while(counter.load(std::memory_order_acquire) < value)
+        std::this_thread::yield();
+}
+
+// Producer outside of pool: every task goes through global queue
+metrics post_throughput_external(const options& opts, unsigned num_threads) {
+    const std::size_t num_tasks = opts.scaled(200000);
+
+    io_service serv;
+    worker_pool pool(serv, num_threads);
+    std::atomic<std::size_t> tasks_done(0);
+
+    const bench_clock::time_point start = bench_clock::now();
+    for(std::size_t i = 0; i < num_tasks; ++i)
+        serv.post(
+            [&tasks_done] () {
+                tasks_done.fetch_add(1, std::memory_order_release);
+            });
+    wait_for(tasks_done, num_tasks);
+    const bench_clock::duration elapsed = bench_clock::now() - start;
+
+    serv.stop();
+    return {
+        {"tasks_per_sec", per_second(num_tasks, elapsed)},
+        {"ns_per_task", to_ns(elapsed) / num_tasks}};
+}
+
+// Producer within pool: tasks go to local queue, peers steal them
+metrics post_throughput_in_pool(const options& opts, unsigned num_threads) {
+    const std::size_t num_tasks = opts.scaled(200000);
+
+    io_service serv;
+    worker_pool pool(serv, num_threads);
+    std::atomic<std::size_t> tasks_done(0);
+
+    const bench_clock::time_point start = bench_clock::now();
+    serv.post(
+        [&serv, &tasks_done, num_tasks] () {
+            for(std::size_t i = 0; i < num_tasks; ++i)
+                serv.post(
+                    [&tasks_done] () {
+                        tasks_done.fetch_add(1, std::memory_order_release);
+                    });
+        });
+    wait_for(tasks_done, num_tasks);
+    const bench_clock::duration elapsed = bench_clock::now() - start;
+
+    serv.stop();
+    return {
+        {"tasks_per_sec", per_second(num_tasks, elapsed)},
+        {"ns_per_task", to_ns(elapsed) / num_tasks}};
+}
+
+// Time from post() until task starts. Paced: each task is posted after
+// previous one ran, so it measures wake-up of idle workers.
+// Burst: all at once, so it measures queueing as well
+metrics post_latency(const options& opts, unsigned num_threads, bool is_paced) {
+    const std::size_t num_tasks = opts.scaled(is_paced ? 20000 : 100000);
+
+    io_service serv;
+    worker_pool pool(serv, num_threads);
+    std::atomic<std::size_t> tasks_done(0);
+    std::vector<double> delays(num_tasks);
+
+    for(std::size_t i = 0; i < num_tasks; ++i) {
+        const bench_clock::time_point posted = bench_clock::now();
+        serv.post(
+            [&delays, &tasks_done, i, posted] () {
+                delays[i] = to_ns(bench_clock::now() - posted);
+                tasks_done.fetch_add(1, std::memory_order_release);
+            });
+
+        if(is_paced)
+            wait_for(tasks_done, i + 1);
+    }
+    wait_for(tasks_done, num_tasks);
+
+    serv.stop();
+    metrics res;
+    add_percentiles(res, "delay_ns", delays);
+    return res;
+}
+
+// Inline dispatch against post from within pool. Single thread polls,
+// so that numbers do not depend on scheduling of workers
+metrics dispatch_vs_post(const options& opts) {
+    const std::size_t num_ops = opts.scaled(1000000);
+
+    io_service serv;
+    std::atomic<std::size_t> counter(0);
+    auto increment =
+        [&counter] () { counter.fetch_add(1, std::memory_order_relaxed); };
+
+    bench_clock::duration direct, dispatched, enqueued;
+    serv.post(
+        [&] () {
+            bench_clock::time_point start = bench_clock::now();
+            for(std::size_t i = 0; i < num_ops; ++i)
+                increment();
+            direct = bench_clock::now() - start;
+
+            start = bench_clock::now();
+            for(std::size_t i = 0; i < num_ops; ++i)
+                serv.dispatch(increment);
+            dispatched = bench_clock::now() - start;
+
+            start = bench_clock::now();
+            for(std::size_t i = 0; i < num_ops; ++i)
+                serv.post(increment);
+            enqueued = bench_clock::now() - start;
+        });
+
+    // Driver task, then tasks it posted
+    const bench_clock::time_point start = bench_clock::now();
+    serv.poll();
+    const bench_clock::duration posted = bench_clock::now() - start - direct - dispatched;
+
+    serv.stop();
+    return {
+        {"direct_ns_per_op", to_ns(direct) / num_ops},
+        {"dispatch_ns_per_op", to_ns(dispatched) / num_ops},
+        {"post_enqueue_ns_per_op", to_ns(enqueued) / num_ops},
+        {"post_total_ns_per_op", to_ns(posted) / num_ops}};
+}
+
+struct ping_pong_state {
+    std::atomic<std::size_t> balls_done;
+};
+
+// Ball bounces between services, as tasks of main.cpp do
+void bounce(ping_pong_state* state, std::size_t hops_left,
+    io_service* from, io_service* to
+) {
+    if(hops_left == 0) {
+        state->balls_done.fetch_add(1, std::memory_order_release);
+        return;
+    }
+
+    to->dispatch(&bounce, state, hops_left - 1, to, from);
+}
+
+metrics ping_pong(const options& opts, unsigned num_threads) {
+    const std::size_t num_balls = 64;
+    const std::size_t hops_per_ball = opts.scaled(200000) / num_balls + 1;
+
+    io_service serv1;
+    io_service serv2;
+    worker_pool pool1(serv1, num_threads);
+    worker_pool pool2(serv2, num_threads);
+    ping_pong_state state{{0}};
+
+    const bench_clock::time_point start = bench_clock::now();
+    for(std::size_t i = 0; i < num_balls; ++i)
+        serv1.post(&bounce, &state, hops_per_ball, &serv1, &serv2);
+    wait_for(state.balls_done, num_balls);
+    const bench_clock::duration elapsed = bench_clock::now() - start;
+
+    serv1.stop();
+    serv2.stop();
+    return {
+        {"hops_per_sec", per_second(num_balls * hops_per_ball, elapsed)}};
+}
+
+// Blocking round trip of external thread through future
+metrics post_waitable_round_trip(const options& opts, unsigned num_threads) {
+    const std::size_t num_trips = opts.scaled(20000);
+
+    io_service serv;
+    worker_pool pool(serv, num_threads);
+    std::vector<double> trips(num_trips);
+
+    for(std::size_t i = 0; i < num_trips; ++i) {
+        const bench_clock::time_point start = bench_clock::now();
+        serv.post_waitable([] () { return 1; }).get();
+        trips[i] = to_ns(bench_clock::now() - start);
+    }
+
+    serv.stop();
+    metrics res;
+    add_percentiles(res, "round_trip_ns", trips);
+    return res;
+}
+
+// stop() of service, whose workers are idle in run(). Then restart()
+metrics stop_restart(const options& opts, unsigned num_threads) {
+    const std::size_t num_cycles = opts.scaled(50);
+
+    io_service serv;
+    bench_clock::duration stopping(0), restarting(0);
+
+    for(std::size_t cycle = 0; cycle < num_cycles; ++cycle) {
+        {
+            worker_pool pool(serv, num_threads);
+
+            // Every worker is within run() once all of them met
+            std::atomic<std::size_t> arrived(0);
+            for(unsigned i = 0; i < num_threads; ++i)
+                serv.post(
+                    [&arrived, num_threads] () {
+                        arrived.fetch_add(1, std::memory_order_release);
+                        wait_for(arrived, num_threads);
+                    });
+            wait_for(arrived, num_threads);
+
+            const bench_clock::time_point start = bench_clock::now();
+            serv.stop();
+            stopping += bench_clock::now() - start;
+        }
+
+        const bench_clock::time_point start = bench_clock::now();
+        serv.restart();
+        restarting += bench_clock::now() - start;
+    }
+
+    serv.stop();
+    return {
+        {"stop_ns", to_ns(stopping) / num_cycles},
+        {"restart_ns", to_ns(restarting) / num_cycles}};
+}
+
+} // namespace
+
+} // namespace bench
+
+} // namespace io_service
+
+int main(int argc, char* argv[]) {
+    using namespace io_service::bench;
+
+    const options opts = parse_options(argc, argv);
+    runner bench_runner("io_service_bench", opts);
+
+    for(unsigned num_threads : opts.thread_counts) {
+        const std::string threads = std::to_string(num_threads);
+
+        bench_runner.run("post_throughput",
+            {{"threads", threads}, {"producer", "external"}},
+            [&] () { return post_throughput_external(opts, num_threads); });
+
+        bench_runner.run("post_throughput",
+            {{"threads", threads}, {"producer", "in_pool"}},
+            [&] () { return post_throughput_in_pool(opts, num_threads); });
+
+        bench_runner.run("post_latency",
+            {{"threads", threads}, {"load", "paced"}},
+            [&] () { return post_latency(opts, num_threads, true); });
+
+        bench_runner.run("post_latency",
+            {{"threads", threads}, {"load", "burst"}},
+            [&] () { return post_latency(opts, num_threads, false); });
+
+        bench_runner.run("ping_pong",
+            {{"threads_per_service", threads}},
+            [&] () { return ping_pong(opts, num_threads); });
+
+        bench_runner.run("post_waitable_round_trip",
+            {{"threads", threads}},
+            [&] () { return post_waitable_round_trip(opts, num_threads); });
+
+        bench_runner.run("stop_restart",
+            {{"threads", threads}},
+            [&] () { return stop_restart(opts, num_threads); });
+    }
+
+    bench_runner.run("dispatch_vs_post", {},
+        [&] () { return dispatch_vs_post(opts); });
+
+    return bench_runner.finish();
+}
@@ -0,0 +1,425 @@
+#include "bench_harness.hpp"
+
+#include "invocable.hpp"
+#include "interrupt_flag.hpp"
+#include "threadsafe_queue.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+// Building blocks of io_service, each against its std counterpart:
+// threadsafe_queue vs std::mutex + std::deque, invocable vs std::function,
+// interrupt_flag vs std::stop_source.
+// Summary goes to stderr, JSON to stdout or --json file
+
+namespace io_service {
+
+namespace bench {
+
+namespace {
+
+// Keeps value from being optimized out
+template<typename T>
+inline void do_not_optimize(const T& value)
+{ asm volatile("" : : "r,m"(value) : "memory"); }
+
+
+// Baseline queue: single mutex, std::deque
+template<typename T>
+class std_mutex_queue {
+private:
+    std::mutex m_mutex;
+    std::deque<T> m_data;
+
+public:
+    void push(T value) {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        m_data.push_back(std::move(value));
+    }
+
+    bool try_pop(T& out) {
+        std::lock_guard<std::mutex> lk(m_mutex);
+        if(m_data.empty())
+            return false;
+
+        out = std::move(m_data.front());
+        m_data.pop_front();
+        return true;
+    }
+};
+
+// Producers push their share, consumers pop until all are taken.
+// Empty queue is polled with yield, so that condition variables
+// do not dominate
+template<typename Queue>
+metrics queue_push_pop(
+    const options& opts, unsigned num_producers, unsigned num_consumers
+) {
+    const std::size_t num_items = opts.scaled(400000);
+    const std::size_t per_producer = num_items / num_producers;
+    const std::size_t total = per_producer * num_producers;
+
+    Queue queue;
+    std::atomic<std::size_t> num_popped(0);
+    std::atomic<bool> is_started(false);
+
+    std::vector<std::thread> threads;
+    for(unsigned i = 0; i < num_producers; ++i)
+        threads.emplace_back(
+            [&queue, &is_started, per_producer] () {
+                while(!is_started)
+                    std::this_thread::yield();
+
+                for(std::size_t j = 0; j < per_producer; ++j)
+                    queue.push(j);
+            });
+
+    for(unsigned i = 0; i < num_consumers; ++i)
+        threads.emplace_back(
+            [&queue, &is_started, &num_popped, total] () {
+                while(!is_started)
+                    std::this_thread::yield();
+
+                std::size_t value;
+                while(num_popped.load(std::memory_order_relaxed) < total) {
+                    if(queue.try_pop(value))
+                        num_popped.fetch_add(1, std::memory_order_relaxed);
+                    else
+                        std::this_thread::yield();
+                }
+            });
+
+    const bench_clock::time_point start = bench_clock::now();
+    is_started = true;
+    for(std::thread& thread : threads)
+        thread.join();
+    const bench_clock::duration elapsed = bench_clock::now() - start;
+
+    return {
+        {"items_per_sec", per_second(total, elapsed)},
+        {"ns_per_item", to_ns(elapsed) / total}};
+}
+
+
+// Callable with capture of given size
+template<std::size_t Size>
+struct payload_task {
+    unsigned char data[Size];
+    std::size_t* sum;
+
+    void operator()()
+    { *sum += data[0]; }
+};
+
+// Construction, relocation and single call, as task goes through queue.
+// std::function can be called more than once, but it is not needed here
+template<typename Function, std::size_t CaptureSize>
+metrics function_lifecycle(const options& opts) {
+    const std::size_t num_ops = opts.scaled(2000000);
+
+    std::size_t sum = 0;
+    payload_task<CaptureSize> callable{};
+    callable.data[0] = 1;
+    callable.sum = &sum;
+
+    bench_clock::time_point start = bench_clock::now();
+    for(std::size_t i = 0; i < num_ops; ++i) {
+        Function func(callable);
+        do_not_optimize(func);
+    }
+    const bench_clock::duration constructed = bench_clock::now() - start;
+
+    Function first(callable);
+    start = bench_clock::now();
+    for(std::size_t i = 0; i < num_ops; ++i) {
+        Function second(std::move(first));
+        do_not_optimize(second);
+        first = std::move(second);
+    }
+    const bench_clock::duration moved = bench_clock::now() - start;
+
+    start = bench_clock::now();
+    for(std::size_t i = 0; i < num_ops; ++i) {
+        Function func(callable);
+        do_not_optimize(func);
+        func();
+    }
+    const bench_clock::duration invoked = bench_clock::now() - start;
+    do_not_optimize(sum);
+
+    return {
+        {"construct_ns", to_ns(constructed) / num_ops},
+        {"move_ns", to_ns(moved) / (2 * num_ops)},
+        {"construct_invoke_ns", to_ns(invoked) / num_ops}};
+}
+
+
+// Handle acquisition and stop check. Both are taken by every run()
+metrics interrupt_flag_ops(const options& opts) {
+    const std::size_t num_ops = opts.scaled(2000000);
+    interrupt_flag flag;
+
+    bench_clock::time_point start = bench_clock::now();
+    for(std::size_t i = 0; i < num_ops; ++i) {
+        interrupt_handle handle = flag.make_handle();
+        do_not_optimize(handle);
+    }
+    const bench_clock::duration made = bench_clock::now() - start;
+
+    interrupt_handle handle = flag.make_handle();
+    std::size_t num_stopped = 0;
+    start = bench_clock::now();
+    for(std::size_t i = 0; i < num_ops; ++i) {
+        num_stopped += handle.is_stopped();
+        do_not_optimize(num_stopped);
+    }
+    const bench_clock::duration checked = bench_clock::now() - start;
+
+    return {
+        {"make_handle_ns", to_ns(made) / num_ops},
+        {"is_stopped_ns", to_ns(checked) / num_ops}};
+}
+
+metrics stop_source_ops(const options& opts) {
+    const std::size_t num_ops = opts.scaled(2000000);
+    std::stop_source source;
+
+    bench_clock::time_point start = bench_clock::now();
+    for(std::size_t i = 0; i < num_ops; ++i) {
+        std::stop_token token = source.get_token();
+        do_not_optimize(token);
+    }
+    const bench_clock::duration made = bench_clock::now() - start;
+
+    std::stop_token token = source.get_token();
+    std::size_t num_stopped = 0;
+    start = bench_clock::now();
+    for(std::size_t i = 0; i < num_ops; ++i) {
+        num_stopped += token.stop_requested();
+        do_not_optimize(num_stopped);
+    }
+    const bench_clock::duration checked = bench_clock::now() - start;
+
+    return {
+        {"make_handle_ns", to_ns(made) / num_ops},
+        {"is_stopped_ns", to_ns(checked) / num_ops}};
+}
+
+
+// Threads, which run body once per round
+class round_team {
+private:
+    std::function<void(unsigned)> m_body;
+    std::atomic<unsigned> m_round;
+    std::atomic<bool> m_is_done;
+    std::vector<std::thread> m_threads;
+
+public:
+    round_team(unsigned num_threads, std::function<void(unsigned)> body)
+        : m_body(std::move(body))
+        , m_round(0)
+        , m_is_done(false)
+        , m_threads()
+    {
+        for(unsigned i = 0; i < num_threads; ++i)
+            m_threads.emplace_back([this, i] () { M_loop(i); });
+    }
+
+    ~round_team() {
+        m_is_done = true;
+        for(std::thread& thread : m_threads)
+            thread.join();
+    }
+
+public:
+    // Body has to take state of previous round off
+    void start_round()
+    { ++m_round; }
+
+// Impl funcs
+private:
+    void M_loop(unsigned index) {
+        unsigned last_round = 0;
+        while(true) {
+            while(m_round == last_round && !m_is_done)
+                std::this_thread::yield();
+            if(m_is_done)
+                return;
+
+            last_round = m_round;
+            m_body(index);
+        }
+    }
+};
+
+// Time from signal_stop() until wait_all() returns, while threads
+// poll their handles
+metrics interrupt_flag_round_trip(const options& opts, unsigned num_threads) {
+    const std::size_t num_rounds = opts.scaled(2000);
+
+    std::vector<std::unique_ptr<interrupt_handle>> handles(num_threads);
+    std::atomic<unsigned> num_taken(0);
+    round_team team(num_threads,
+        [&handles, &num_taken] (unsigned index) {
+            interrupt_handle handle(std::move(*handles[index]));
+            ++num_taken;
+            while(!handle.is_stopped())
+                std::this_thread::yield();
+        });
+
+    bench_clock::duration stopping(0);
+    for(std::size_t round = 0; round < num_rounds; ++round) {
+        interrupt_flag flag;
+        for(unsigned i = 0; i < num_threads; ++i)
+            handles[i] = std::make_unique<interrupt_handle>(flag.make_handle());
+
+        num_taken = 0;
+        team.start_round();
+        while(num_taken < num_threads)
+            std::this_thread::yield();
+
+        const bench_clock::time_point start = bench_clock::now();
+        flag.signal_stop();
+        flag.wait_all();
+        stopping += bench_clock::now() - start;
+    }
+
+    return {{"stop_wait_ns", to_ns(stopping) / num_rounds}};
+}
+
+// Same with std::stop_source. Owners are counted under mutex,
+// as interrupt_flag does
+metrics stop_source_round_trip(const options& opts, unsigned num_threads) {
+    const std::size_t num_rounds = opts.scaled(2000);
+
+    std::stop_source source;
+    std::mutex mutex;
+    std::condition_variable cv;
+    unsigned num_owners = 0;
+    std::atomic<unsigned> num_taken(0);
+
+    round_team team(num_threads,
+        [&] (unsigned) {
+            std::stop_token token = source.get_token();
+            ++num_taken;
+            while(!token.stop_requested())
+                std::this_thread::yield();
+
+            std::lock_guard<std::mutex> lk(mutex);
+            if(--num_owners == 0)
+                cv.notify_one();
+        });
+
+    bench_clock::duration stopping(0);
+    for(std::size_t round = 0; round < num_rounds; ++round) {
+        source = std::stop_source();
+        num_owners = num_threads;
+
+        num_taken = 0;
+        team.start_round();
+        while(num_taken < num_threads)
+            std::this_thread::yield();
+
+        const bench_clock::time_point start = bench_clock::now();
+        source.request_stop();
+        std::unique_lock<std::mutex> lk(mutex);
+        cv.wait(lk, [&num_owners] () { return num_owners == 0; });
+        stopping += bench_clock::now() - start;
+    }
+
+    return {{"stop_wait_ns", to_ns(stopping) / num_rounds}};
+}
+
+template<std::size_t CaptureSize>
+void run_function_benches(runner& bench_runner, const options& opts) {
+    const std::string size = std::to_string(CaptureSize);
+    const std::string inline_str =
+        invocable::fits_inline<
+            callable_impl<payload_task<CaptureSize>, std::tuple<>>>
+        ? "true" : "false";
+
+    bench_runner.run("function_lifecycle",
+        {{"impl", "invocable"}, {"capture_bytes", size}, {"inline", inline_str}},
+        [&] () { return function_lifecycle<invocable, CaptureSize>(opts); });
+
+    bench_runner.run("function_lifecycle",
+        {{"impl", "std::function"}, {"capture_bytes", size}},
+        [&] () {
+            return function_lifecycle<std::function<void()>, CaptureSize>(opts);
+        });
+}
+
+} // namespace
+
+} // namespace bench
+
+} // namespace io_service
+
+int main(int argc, char* argv[]) {
+    using namespace io_service;
+    using namespace io_service::bench;
+
+    const options opts = parse_options(argc, argv);
+    runner bench_runner("io_service_micro_bench", opts);
+
+    for(unsigned num_producers : opts.thread_counts) {
+        for(unsigned num_consumers : opts.thread_counts) {
+            const std::map<std::string, std::string> params = {
+                {"producers", std::to_string(num_producers)},
+                {"consumers", std::to_string(num_consumers)}};
+
+            auto with_impl =
+                [&params] (const char* impl) {
+                    std::map<std::string, std::string> res = params;
+                    res["impl"] = impl;
+                    return res;
+                };
+
+            bench_runner.run("queue_push_pop", with_impl("threadsafe_queue"),
+                [&] () {
+                    return queue_push_pop<threadsafe_queue<std::size_t>>(
+                        opts, num_producers, num_consumers);
+                });
+
+            bench_runner.run("queue_push_pop", with_impl("std_mutex_queue"),
+                [&] () {
+                    return queue_push_pop<std_mutex_queue<std::size_t>>(
+                        opts, num_producers, num_consumers);
+                });
+        }
+    }
+
+    run_function_benches<8>(bench_runner, opts);
+    run_function_benches<32>(bench_runner, opts);
+    run_function_benches<64>(bench_runner, opts);
+    run_function_benches<256>(bench_runner, opts);
+
+    bench_runner.run("interrupt_ops", {{"impl", "interrupt_flag"}},
+        [&] () { return interrupt_flag_ops(opts); });
+    bench_runner.run("interrupt_ops", {{"impl", "std::stop_source"}},
+        [&] () { return stop_source_ops(opts); });
+
+    for(unsigned num_threads : opts.thread_counts) {
+        const std::string threads = std::to_string(num_threads);
+
+        bench_runner.run("interrupt_round_trip",
+            {{"impl", "interrupt_flag"}, {"threads", threads}},
+            [&] () { return interrupt_flag_round_trip(opts, num_threads); });
+
+        bench_runner.run("interrupt_round_trip",
+            {{"impl", "std::stop_source"}, {"threads", threads}},
+            [&] () { return stop_source_round_trip(opts, num_threads); });
+    }
+
+    return bench_runner.finish();
+}
@@ -0,0 +1,14 @@
+#ifndef ASIO_CPU_RELAX_HPP
+#define ASIO_CPU_RELAX_HPP
+
+// Hint to CPU, that caller is in spin-wait loop.
+// Saves power and lets sibling hyper-thread run
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+#endif
@@ -0,0 +1,244 @@
+#include "epoll_reactor.hpp"
+
+#include "lock_guard.hpp"
+
+#include <cerrno>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace io_service {
+
+// Max events taken by single epoll_wait()
+static const int max_events_per_wait = 128;
+
+using detail::last_error;
+
+epoll_reactor::epoll_reactor()
+    : io_backend()
+    , m_epoll_fd(-1)
+    , m_descriptors()
+    , m_retired()
+{
+    m_epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+    if(m_epoll_fd == -1)
+        throw std::system_error(last_error(), "epoll_create1");
+
+    // eventfd is told apart by null data.ptr
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+    if(::epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, M_event_fd(), &event) == -1) {
+        std::error_code ec = last_error();
+        ::close(m_epoll_fd);
+        throw std::system_error(ec, "epoll_ctl");
+    }
+}
+
+epoll_reactor::~epoll_reactor()
+{ ::close(m_epoll_fd); }
+
+descriptor_handle epoll_reactor::register_descriptor(int fd) {
+    using namespace concurrency;
+
+    const int flags = ::fcntl(fd, F_GETFL);
+    if(flags == -1 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)
+        throw std::system_error(last_error(), "fcntl");
+
+    struct stat fd_stat;
+    const bool is_socket =
+        ::fstat(fd, &fd_stat) == 0 && S_ISSOCK(fd_stat.st_mode);
+
+    std::shared_ptr<detail::descriptor_state> state =
+        std::make_shared<detail::descriptor_state>(fd, is_socket);
+
+    // Registered once for both directions. Edge-triggered, so that
+    // descriptor without pending operations does not wake reactor up
+    epoll_event event = {};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = state.get();
+
+    lock_guard<mutex> lk(m_registry_mutex);
+    if(::epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        // Regular file. Its reads and writes never block
+        if(errno != EPERM)
+            throw std::system_error(last_error(), "epoll_ctl");
+
+        state->is_pollable = false;
+    }
+
+    m_descriptors.push_back(state);
+    ++m_num_descriptors;
+    return descriptor_handle(std::move(state));
+}
+
+void epoll_reactor::deregister_descriptor(
+    const descriptor_handle& handle, std::vector<invocable>& out
+) {
+    using namespace concurrency;
+
+    detail::descriptor_state* state = handle.state();
+    if(!state)
+        return;
+
+    {
+        lock_guard<mutex> lk(m_registry_mutex);
+        for(std::size_t i = 0; i < m_descriptors.size(); ++i) {
+            if(m_descriptors[i].get() != state)
+                continue;
+
+            // Descriptor might be closed already. Then it is gone from epoll
+            if(state->is_pollable)
+                ::epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, state->fd, nullptr);
+
+            m_retired.push_back(std::move(m_descriptors[i]));
+            m_descriptors[i] = std::move(m_descriptors.back());
+            m_descriptors.pop_back();
+            --m_num_descriptors;
+            break;
+        }
+    }
+
+    lock_guard<mutex> lk(state->mutex);
+    state->is_registered = false;
+
+    const std::error_code ec =
+        std::make_error_code(std::errc::operation_canceled);
+    for(std::deque<detail::io_op_ptr>* ops :
+            {&state->read_ops, &state->write_ops}
+    ) {
+        for(detail::io_op_ptr& op : *ops)
+            out.push_back(op->complete(ec, 0));
+        ops->clear();
+    }
+}
+
+invocable epoll_reactor::start_op(
+    const descriptor_handle& handle, detail::io_op_ptr op
+) {
+    using namespace concurrency;
+
+    detail::descriptor_state* state = handle.state();
+    if(!state)
+        return op->complete(std::make_error_code(std::errc::bad_file_descriptor), 0);
+
+    lock_guard<mutex> lk(state->mutex);
+    if(!state->is_registered)
+        return op->complete(std::make_error_code(std::errc::bad_file_descriptor), 0);
+
+    std::deque<detail::io_op_ptr>& ops = state->ops_of(*op);
+
+    // Try right away, unless earlier operations wait for readiness.
+    // Done under descriptor lock, so that readiness edge,
+    // which comes meanwhile, finds operation queued
+    std::error_code ec;
+    std::size_t bytes = 0;
+    if(ops.empty() && S_perform(*state, *op, ec, bytes))
+        return op->complete(ec, bytes);
+
+    ops.push_back(std::move(op));
+    return invocable();
+}
+
+std::size_t epoll_reactor::M_wait_and_perform(
+    int timeout_ms, std::vector<invocable>& out
+) {
+    using namespace concurrency;
+
+    M_free_retired();
+
+    epoll_event events[max_events_per_wait];
+    int num_events = ::epoll_wait(m_epoll_fd, events, max_events_per_wait, timeout_ms);
+    if(num_events == -1)
+        return 0; /*EINTR. Caller will come back*/
+
+    const std::size_t out_size = out.size();
+    for(int i = 0; i < num_events; ++i) {
+        if(events[i].data.ptr == nullptr) {
+            M_drain_event_fd();
+            continue;
+        }
+
+        // Not freed, while reactor is acquired (see M_free_retired())
+        detail::descriptor_state& state =
+            *static_cast<detail::descriptor_state*>(events[i].data.ptr);
+        const std::uint32_t flags = events[i].events;
+        const bool is_error = flags & (EPOLLERR | EPOLLHUP);
+
+        lock_guard<mutex> lk(state.mutex);
+        if(flags & (EPOLLIN | EPOLLRDHUP) || is_error)
+            S_perform_ops(state, state.read_ops, out);
+        if(flags & EPOLLOUT || is_error)
+            S_perform_ops(state, state.write_ops, out);
+    }
+
+    return out.size() - out_size;
+}
+
+void epoll_reactor::S_perform_ops(
+    detail::descriptor_state& state,
+    std::deque<detail::io_op_ptr>& ops,
+    std::vector<invocable>& out
+) {
+    while(!ops.empty()) {
+        std::error_code ec;
+        std::size_t bytes = 0;
+        if(!S_perform(state, *ops.front(), ec, bytes))
+            return;
+
+        out.push_back(ops.front()->complete(ec, bytes));
+        ops.pop_front();
+    }
+}
+
+bool epoll_reactor::S_perform(
+    const detail::descriptor_state& state, detail::io_op& op,
+    std::error_code& ec, std::size_t& bytes
+) {
+    for(;;) {
+        ssize_t result;
+        if(op.is_positional())
+            result = op.type == detail::io_op::read
+                ? ::pread(state.fd, op.data, op.size, op.offset)
+                : ::pwrite(state.fd, op.data, op.size, op.offset);
+        else if(op.type == detail::io_op::read)
+            result = ::read(state.fd, op.data, op.size);
+        else if(state.is_socket)
+            result = ::send(state.fd, op.data, op.size, MSG_NOSIGNAL);
+        else
+            result = ::write(state.fd, op.data, op.size);
+
+        if(result >= 0) {
+            ec = std::error_code();
+            bytes = static_cast<std::size_t>(result);
+            return true;
+        }
+
+        if(errno == EINTR)
+            continue;
+
+        if(errno == EAGAIN || errno == EWOULDBLOCK)
+            return false;
+
+        ec = last_error();
+        bytes = 0;
+        return true;
+    }
+}
+
+void epoll_reactor::M_free_retired() {
+    using namespace concurrency;
+
+    std::vector<std::shared_ptr<detail::descriptor_state>> sink;
+    {
+        lock_guard<mutex> lk(m_registry_mutex);
+        m_retired.swap(sink);
+    }
+    // Destroyed outside of lock
+}
+
+} // namespace io_service
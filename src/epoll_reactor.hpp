@@ -0,0 +1,73 @@
+#ifndef ASIO_EPOLL_REACTOR_HPP
+#define ASIO_EPOLL_REACTOR_HPP
+
+#include "io_backend.hpp"
+
+#include "mutex.hpp"
+
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <system_error>
+#include <vector>
+
+namespace io_service {
+
+// Readiness-based I/O on top of edge-triggered epoll.
+// Operations are tried right away, and queued only if they would block.
+// Regular files are not polled: their operations complete right away
+class epoll_reactor: public io_backend {
+private:
+    int m_epoll_fd;
+
+    concurrency::mutex m_registry_mutex;
+    std::vector<std::shared_ptr<detail::descriptor_state>> m_descriptors;
+    // Deregistered. Freed by owner, once events of them can not be in flight
+    std::vector<std::shared_ptr<detail::descriptor_state>> m_retired;
+
+public:
+    // Throws std::system_error, if epoll or eventfd can not be created
+    epoll_reactor();
+
+    ~epoll_reactor();
+
+public:
+    io_backend_type type() const override
+    { return io_backend_type::epoll; }
+
+    // Switches fd to non-blocking mode. Throws std::system_error
+    descriptor_handle register_descriptor(int fd) override;
+
+    void deregister_descriptor(
+        const descriptor_handle& handle, std::vector<invocable>& out) override;
+
+    // Tries operation right away. If it would block, operation is queued
+    invocable start_op(
+        const descriptor_handle& handle, detail::io_op_ptr op) override;
+
+// Impl funcs
+protected:
+    // Performs ready operations
+    std::size_t M_wait_and_perform(
+        int timeout_ms, std::vector<invocable>& out) override;
+
+private:
+    // Performs queued operations, until one would block
+    // Prereq: state.mutex - locked
+    static void S_perform_ops(
+        detail::descriptor_state& state,
+        std::deque<detail::io_op_ptr>& ops,
+        std::vector<invocable>& out);
+
+    // Returns false if operation would block
+    static bool S_perform(
+        const detail::descriptor_state& state, detail::io_op& op,
+        std::error_code& ec, std::size_t& bytes);
+
+    void M_free_retired();
+
+}; // class epoll_reactor
+
+} // namespace io_service
+
+#endif // ASIO_EPOLL_REACTOR_HPP
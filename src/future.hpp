@@ -0,0 +1,630 @@
+#ifndef ASIO_FUTURE_HPP
+#define ASIO_FUTURE_HPP
+
+#include "invocable.hpp"
+#include "node_pool.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional> // std::invoke
+#include <future> // std::future_error
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace io_service {
+
+class io_service;
+
+template<typename T>
+class future;
+
+template<typename T>
+class promise;
+
+namespace detail {
+
+// Posts continuation to service. Continuation, posted to stopped
+// service, is dropped. Defined by io_service
+void post_continuation(io_service& serv, invocable&& continuation);
+
+
+// Result of then(fn): future<void> for fn without result
+template<typename T, typename Func>
+struct then_result {
+    typedef std::invoke_result_t<std::decay_t<Func>&, T> type;
+};
+
+template<typename Func>
+struct then_result<void, Func> {
+    typedef std::invoke_result_t<std::decay_t<Func>&> type;
+};
+
+
+// Shared by promise and future. Single-shot and lock-free: result and
+// continuation are published by flags, whichever comes second fires
+// continuation
+template<typename T>
+class future_state {
+private:
+    enum flag : std::uint8_t {
+        ready = 1,          // result is set
+        has_continuation = 2,
+        has_waiter = 4      // thread blocks in wait()
+    };
+
+    typedef std::conditional_t<std::is_void_v<T>, std::monostate, T> value_type;
+
+    std::atomic<std::uint8_t> m_flags;
+    std::atomic<unsigned> m_refs;
+    // Continuations are posted to it. Null: they run inline
+    io_service* m_serv;
+
+    std::variant<std::monostate, value_type, std::exception_ptr> m_result;
+    invocable m_continuation;
+    // Continuation runs on thread, which completes state
+    bool m_is_inline;
+
+private:
+    future_state(const future_state& other) = delete;
+    future_state& operator=(const future_state& other) = delete;
+
+public:
+    explicit future_state(io_service* serv)
+        : m_flags(0)
+        , m_refs(1)
+        , m_serv(serv)
+        , m_result()
+        , m_continuation()
+        , m_is_inline(false)
+    {}
+
+    static future_state* create(io_service* serv)
+    { return new(node_pool<future_state>::allocate()) future_state(serv); }
+
+public:
+    void add_ref()
+    { m_refs.fetch_add(1, std::memory_order_relaxed); }
+
+    void release() {
+        if(m_refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+
+        this->~future_state();
+        node_pool<future_state>::deallocate(this);
+    }
+
+    io_service* service() const
+    { return m_serv; }
+
+public:
+    // Producer side. Called once
+
+    template<typename ...Args>
+    void set_value(Args&& ...args) {
+        m_result.template emplace<1>(std::forward<Args>(args)...);
+        M_complete();
+    }
+
+    void set_exception(std::exception_ptr ex_ptr) {
+        m_result.template emplace<2>(std::move(ex_ptr));
+        M_complete();
+    }
+
+public:
+    // Consumer side
+
+    bool is_ready() const
+    { return m_flags.load(std::memory_order_acquire) & ready; }
+
+    void wait() {
+        std::uint8_t flags = m_flags.fetch_or(has_waiter, std::memory_order_acquire);
+        while(!(flags & ready)) {
+            m_flags.wait(flags, std::memory_order_acquire);
+            flags = m_flags.load(std::memory_order_acquire);
+        }
+    }
+
+    // Prereq: is_ready()
+    bool has_exception() const
+    { return m_result.index() == 2; }
+
+    // Prereq: is_ready(). Moves value out
+    T take() {
+        if(m_result.index() == 2)
+            std::rethrow_exception(std::get<2>(m_result));
+
+        if constexpr (!std::is_void_v<T>)
+            return std::move(std::get<1>(m_result));
+    }
+
+    // Prereq: has_exception()
+    std::exception_ptr exception() const
+    { return std::get<2>(m_result); }
+
+    // Called once. Runs continuation right away, if result is set already.
+    // Otherwise, producer posts it, or runs it, if is_inline
+    void set_continuation(invocable&& continuation, bool is_inline) {
+        m_continuation = std::move(continuation);
+        m_is_inline = is_inline;
+
+        const std::uint8_t flags =
+            m_flags.fetch_or(has_continuation, std::memory_order_acq_rel);
+        if(flags & ready)
+            M_run_continuation();
+    }
+
+// Impl funcs
+private:
+    void M_complete() {
+        const std::uint8_t flags = m_flags.fetch_or(ready, std::memory_order_acq_rel);
+        if(flags & has_waiter)
+            m_flags.notify_all();
+
+        if(!(flags & has_continuation))
+            return;
+
+        if(m_is_inline || !m_serv)
+            M_run_continuation();
+        else
+            post_continuation(*m_serv, std::move(m_continuation));
+    }
+
+    void M_run_continuation() {
+        invocable continuation(std::move(m_continuation));
+        continuation();
+    }
+
+}; // class future_state
+
+
+// Owning pointer to future_state
+template<typename T>
+class state_ptr {
+private:
+    future_state<T>* m_state;
+
+public:
+    state_ptr() noexcept
+        : m_state(nullptr)
+    {}
+
+    // Adopts reference
+    explicit state_ptr(future_state<T>* state) noexcept
+        : m_state(state)
+    {}
+
+    state_ptr(const state_ptr& other) noexcept
+        : m_state(other.m_state)
+    {
+        if(m_state)
+            m_state->add_ref();
+    }
+
+    state_ptr(state_ptr&& other) noexcept
+        : m_state(std::exchange(other.m_state, nullptr))
+    {}
+
+    state_ptr& operator=(state_ptr other) noexcept {
+        std::swap(m_state, other.m_state);
+        return *this;
+    }
+
+    ~state_ptr() {
+        if(m_state)
+            m_state->release();
+    }
+
+public:
+    future_state<T>* operator->() const noexcept
+    { return m_state; }
+
+    explicit operator bool() const noexcept
+    { return m_state != nullptr; }
+
+}; // class state_ptr
+
+// Internals of promise and future, used by combinators
+struct future_access {
+    // Continuations of future, made by it, run inline, if serv is null
+    template<typename T>
+    static promise<T> make_promise(io_service* serv)
+    { return promise<T>(serv); }
+
+    template<typename T>
+    static io_service* service(const future<T>& fut)
+    { return fut.m_state->service(); }
+
+    // Continuation runs on thread, which sets result.
+    // It is called with state, whose result is set
+    template<typename T, typename Func>
+    static void on_ready(future<T>& fut, Func&& fn) {
+        state_ptr<T> state = std::move(fut.m_state);
+        future_state<T>* raw_state = state.operator->();
+        raw_state->set_continuation(
+            invocable(
+                [state = std::move(state),
+                 fn = std::decay_t<Func>(std::forward<Func>(fn))] () mutable {
+                    fn(*state.operator->());
+                }),
+            true);
+    }
+
+}; // struct future_access
+
+// Sets promise by result of fn, or by exception, which leaves it.
+// Promise is set outside of try: continuations, run by it, are not caught
+template<typename T, typename Func>
+void fulfill(promise<T>& prom, Func&& fn) {
+    std::exception_ptr ex_ptr;
+    if constexpr (std::is_void_v<T>) {
+        try {
+            std::invoke(std::forward<Func>(fn));
+        } catch(...) {
+            ex_ptr = std::current_exception();
+        }
+
+        if(!ex_ptr)
+            prom.set_value();
+    } else {
+        std::optional<T> value;
+        try {
+            value.emplace(std::invoke(std::forward<Func>(fn)));
+        } catch(...) {
+            ex_ptr = std::current_exception();
+        }
+
+        if(!ex_ptr)
+            prom.set_value(std::move(*value));
+    }
+
+    if(ex_ptr)
+        prom.set_exception(std::move(ex_ptr));
+}
+
+} // namespace detail
+
+
+// Producer of future. Promise, destroyed without result,
+// sets std::future_error (broken_promise)
+template<typename T>
+class promise {
+private:
+    template<typename U>
+    friend class future;
+
+    friend struct detail::future_access;
+
+    detail::state_ptr<T> m_state;
+    bool m_is_retrieved;
+    bool m_is_satisfied;
+
+private:
+    promise(const promise& other) = delete;
+    promise& operator=(const promise& other) = delete;
+
+    explicit promise(io_service* serv)
+        : m_state(detail::future_state<T>::create(serv))
+        , m_is_retrieved(false)
+        , m_is_satisfied(false)
+    {}
+
+public:
+    // Continuations, attached by future::then(), are posted to serv
+    explicit promise(io_service& serv)
+        : promise(&serv)
+    {}
+
+    promise(promise&& other) noexcept
+        : m_state(std::move(other.m_state))
+        , m_is_retrieved(other.m_is_retrieved)
+        , m_is_satisfied(other.m_is_satisfied)
+    {}
+
+    promise& operator=(promise&& other) noexcept {
+        promise(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    ~promise() {
+        if(m_state && !m_is_satisfied)
+            m_state->set_exception(std::make_exception_ptr(
+                std::future_error(std::future_errc::broken_promise)));
+    }
+
+public:
+    // Throws std::future_error, if future was retrieved already
+    future<T> get_future() {
+        M_check_state();
+        if(m_is_retrieved)
+            throw std::future_error(std::future_errc::future_already_retrieved);
+
+        m_is_retrieved = true;
+        return future<T>(m_state);
+    }
+
+    // Throws std::future_error, if result is set already.
+    // Continuation of future might run inline, within the call
+    template<typename ...Args>
+    void set_value(Args&& ...args) {
+        M_satisfy();
+        m_state->set_value(std::forward<Args>(args)...);
+    }
+
+    void set_exception(std::exception_ptr ex_ptr) {
+        M_satisfy();
+        m_state->set_exception(std::move(ex_ptr));
+    }
+
+    void swap(promise& other) noexcept {
+        std::swap(m_state, other.m_state);
+        std::swap(m_is_retrieved, other.m_is_retrieved);
+        std::swap(m_is_satisfied, other.m_is_satisfied);
+    }
+
+// Impl funcs
+private:
+    void M_check_state() {
+        if(!m_state)
+            throw std::future_error(std::future_errc::no_state);
+    }
+
+    void M_satisfy() {
+        M_check_state();
+        if(m_is_satisfied)
+            throw std::future_error(std::future_errc::promise_already_satisfied);
+
+        m_is_satisfied = true;
+    }
+
+}; // class promise
+
+
+// Result of promise. Unlike std::future, result can be handed
+// to continuation, so that no thread blocks for it
+template<typename T>
+class future {
+private:
+    template<typename U>
+    friend class promise;
+
+    friend struct detail::future_access;
+
+    detail::state_ptr<T> m_state;
+
+private:
+    future(const future& other) = delete;
+    future& operator=(const future& other) = delete;
+
+    explicit future(detail::state_ptr<T> state)
+        : m_state(std::move(state))
+    {}
+
+public:
+    future() noexcept
+        : m_state()
+    {}
+
+    future(future&& other) noexcept = default;
+    future& operator=(future&& other) noexcept = default;
+
+public:
+    // Has state: neither get() nor then() was called
+    bool valid() const noexcept
+    { return static_cast<bool>(m_state); }
+
+    bool is_ready() const
+    { return m_state->is_ready(); }
+
+    // Blocks until result is set
+    void wait() const
+    { m_state->wait(); }
+
+    // Blocks until result is set. Rethrows exception of it.
+    // Future is not valid afterwards
+    T get() {
+        detail::state_ptr<T> state = std::move(m_state);
+        state->wait();
+        return state->take();
+    }
+
+    // Attaches continuation, called with value: fn(T), or fn() for void.
+    // It is posted to service of promise, once result is set, or is run
+    // inline, if result is set already. Exception of this future, or
+    // one escaped from fn, goes to returned future, fn is not called then.
+    // Future is not valid afterwards
+    template<typename Func,
+        typename return_type = typename detail::then_result<T, Func>::type>
+    future<return_type>
+    then(Func&& fn) {
+        detail::state_ptr<T> state = std::move(m_state);
+        promise<return_type> next(state->service());
+        future<return_type> res = next.get_future();
+
+        detail::future_state<T>* raw_state = state.operator->();
+        raw_state->set_continuation(
+            invocable(
+                [state = std::move(state), next = std::move(next),
+                 fn = std::decay_t<Func>(std::forward<Func>(fn))] () mutable {
+                    if(state->has_exception()) {
+                        next.set_exception(state->exception());
+                        return;
+                    }
+
+                    if constexpr (std::is_void_v<T>)
+                        detail::fulfill(next, fn);
+                    else
+                        detail::fulfill(next,
+                            [&state, &fn] () { return std::invoke(fn, state->take()); });
+                }),
+            false);
+
+        return res;
+    }
+
+}; // class future
+
+
+// Value of when_any(): index of future, which was first, and its value
+template<typename T>
+struct when_any_result {
+    std::size_t index;
+    T value;
+
+}; // struct when_any_result
+
+template<>
+struct when_any_result<void> {
+    std::size_t index;
+
+}; // struct when_any_result<void>
+
+namespace detail {
+
+template<typename T>
+struct when_all_context {
+    typedef std::conditional_t<std::is_void_v<T>, void, std::vector<T>> result_type;
+    typedef std::conditional_t<std::is_void_v<T>, std::monostate, std::optional<T>>
+        slot_type;
+
+    std::vector<slot_type> values;
+    std::atomic<std::size_t> remaining;
+    // Set by first failed future
+    std::atomic<bool> has_exception;
+    std::exception_ptr exception;
+    promise<result_type> prom;
+
+public:
+    when_all_context(std::size_t num_futures, promise<result_type>&& in_prom)
+        : values(num_futures)
+        , remaining(num_futures)
+        , has_exception(false)
+        , exception()
+        , prom(std::move(in_prom))
+    {}
+
+    void set(std::size_t index, future_state<T>& state) {
+        if(state.has_exception()) {
+            if(!has_exception.exchange(true, std::memory_order_relaxed))
+                exception = state.exception();
+        } else if constexpr (!std::is_void_v<T>) {
+            values[index].emplace(state.take());
+        }
+
+        // Last one sees writes of others
+        if(remaining.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+
+        if(has_exception.load(std::memory_order_relaxed)) {
+            prom.set_exception(exception);
+            return;
+        }
+
+        if constexpr (std::is_void_v<T>) {
+            prom.set_value();
+        } else {
+            std::vector<T> res;
+            res.reserve(values.size());
+            for(slot_type& value : values)
+                res.push_back(std::move(*value));
+            prom.set_value(std::move(res));
+        }
+    }
+
+}; // struct when_all_context
+
+template<typename T>
+struct when_any_context {
+    std::atomic<bool> is_done;
+    promise<when_any_result<T>> prom;
+
+public:
+    explicit when_any_context(promise<when_any_result<T>>&& in_prom)
+        : is_done(false)
+        , prom(std::move(in_prom))
+    {}
+
+    void set(std::size_t index, future_state<T>& state) {
+        if(is_done.exchange(true, std::memory_order_relaxed))
+            return;
+
+        if(state.has_exception())
+            prom.set_exception(state.exception());
+        else if constexpr (std::is_void_v<T>)
+            prom.set_value(when_any_result<void>{index});
+        else
+            prom.set_value(when_any_result<T>{index, state.take()});
+    }
+
+}; // struct when_any_context
+
+} // namespace detail
+
+// Future of all values, in order of futures, or of first exception
+// among them. Set by thread, which completes last of futures.
+// Its continuations go to service of first future
+template<typename T>
+future<typename detail::when_all_context<T>::result_type>
+when_all(std::vector<future<T>> futures) {
+    typedef detail::when_all_context<T> context_type;
+
+    io_service* serv =
+        futures.empty() ? nullptr : detail::future_access::service(futures.front());
+    promise<typename context_type::result_type> prom =
+        detail::future_access::make_promise<typename context_type::result_type>(serv);
+    auto res = prom.get_future();
+
+    if(futures.empty()) {
+        if constexpr (std::is_void_v<T>)
+            prom.set_value();
+        else
+            prom.set_value(std::vector<T>());
+        return res;
+    }
+
+    std::shared_ptr<context_type> context =
+        std::make_shared<context_type>(futures.size(), std::move(prom));
+    for(std::size_t i = 0; i < futures.size(); ++i)
+        detail::future_access::on_ready(futures[i],
+            [context, i] (detail::future_state<T>& state) {
+                context->set(i, state);
+            });
+
+    return res;
+}
+
+// Future of first future to complete: its index and value, or exception.
+// Throws std::invalid_argument, if there are no futures
+template<typename T>
+future<when_any_result<T>>
+when_any(std::vector<future<T>> futures) {
+    typedef detail::when_any_context<T> context_type;
+
+    if(futures.empty())
+        throw std::invalid_argument("when_any() of no futures");
+
+    promise<when_any_result<T>> prom =
+        detail::future_access::make_promise<when_any_result<T>>(
+            detail::future_access::service(futures.front()));
+    future<when_any_result<T>> res = prom.get_future();
+
+    std::shared_ptr<context_type> context =
+        std::make_shared<context_type>(std::move(prom));
+    for(std::size_t i = 0; i < futures.size(); ++i)
+        detail::future_access::on_ready(futures[i],
+            [context, i] (detail::future_state<T>& state) {
+                context->set(i, state);
+            });
+
+    return res;
+}
+
+} // namespace io_service
+
+#endif // ASIO_FUTURE_HPP
@@ -3,21 +3,25 @@
 
 #include "helgrind_annotations.hpp"
 
+#include <chrono>
+#include <cstddef>
 #include <future>
 #include <memory>
+#include <new> // placement new
 #include <tuple>
+#include <type_traits>
+#include <utility> // std::in_place
 
 namespace io_service {
 
-struct invocable_int {
-    virtual ~invocable_int() {}
-
-    virtual void call() = 0;
-}; // struct invocable_int
-
+// Size of inline storage of invocable, in bytes.
+// Callables (with bound args) that fit it are not heap allocated
+#ifndef IO_SERVICE_INVOCABLE_INLINE_SIZE
+#define IO_SERVICE_INVOCABLE_INLINE_SIZE (6 * sizeof(void*))
+#endif
 
 template<typename SignatureT, typename TupleT>
-struct invocable_impl: public invocable_int {
+struct invocable_impl {
 public:
     typedef std::packaged_task<SignatureT> task_type;
 
@@ -30,75 +34,295 @@ private:
     invocable_impl& operator=(const invocable_impl& other) = delete;
 
 public:
-    invocable_impl(task_type&& task, TupleT&& args)
+    // Args are forwarded into stored tuple
+    template<typename ...Args>
+    invocable_impl(task_type&& task, Args&& ...args)
         : m_task(std::move(task))
-        , m_args(std::move(args))
+        , m_args(std::forward<Args>(args)...)
     {}
-    
+
+    invocable_impl(invocable_impl&& other) = default;
+
+    // Called once. Args are moved into task
     void call() {
-        std::apply(m_task, m_args);
+        std::apply(m_task, std::move(m_args));
     }
 
 }; // struct invocable_impl
 
 
-// Type Erasure of packaged_task
-struct invocable {
+// Callable with bound args, without shared state of packaged_task.
+// Result is dropped, exception leaves call()
+template<typename Callable, typename TupleT>
+struct callable_impl {
 private:
-    std::unique_ptr<invocable_int> m_inv_ptr;
+    Callable m_func;
+    TupleT m_args;
 
 private:
-    invocable(const invocable& other) = delete;
-    invocable& operator=(const invocable& other) = delete;
+    callable_impl(const callable_impl& other) = delete;
+    callable_impl& operator=(const callable_impl& other) = delete;
 
 public:
-    invocable()
-        : m_inv_ptr()
+    // Tagged, so that it is never taken for move cstr
+    template<typename Func, typename ...Args>
+    callable_impl(std::in_place_t, Func&& func, Args&& ...args)
+        : m_func(std::forward<Func>(func))
+        , m_args(std::forward<Args>(args)...)
     {}
 
-    invocable(invocable&& other)
-        : m_inv_ptr(std::move(other.m_inv_ptr))
+    callable_impl(callable_impl&& other) = default;
+
+    // Called once. Args are moved into callable
+    void call() {
+        std::apply(m_func, std::move(m_args));
+    }
+
+}; // struct callable_impl
+
+
+namespace detail {
+
+// Manual vtable of type erased callable.
+// Single pointer per invocable, instead of virtual call through heap object
+struct invocable_vtable {
+    void (*call)(void* storage);
+    // Move-constructs dst from src, destroys src
+    void (*relocate)(void* dst, void* src) noexcept;
+    void (*destroy)(void* storage) noexcept;
+    bool is_inline;
+    std::size_t size;
+}; // struct invocable_vtable
+
+// Impl, which invocable constructs for Callable with bound args
+template<typename Callable, typename TupleT>
+struct invocable_impl_for {
+    typedef callable_impl<Callable, TupleT> type;
+};
+
+template<typename SignatureT, typename TupleT>
+struct invocable_impl_for<std::packaged_task<SignatureT>, TupleT> {
+    typedef invocable_impl<SignatureT, TupleT> type;
+};
+
+// ImplT is constructed right in the storage
+template<typename ImplT>
+struct inline_invocable_ops {
+    static ImplT* S_get(void* storage)
+    { return std::launder(static_cast<ImplT*>(storage)); }
+
+    static void call(void* storage)
+    { S_get(storage)->call(); }
+
+    static void relocate(void* dst, void* src) noexcept {
+        ::new (dst) ImplT(std::move(*S_get(src)));
+        S_get(src)->~ImplT();
+    }
+
+    static void destroy(void* storage) noexcept
+    { S_get(storage)->~ImplT(); }
+
+    static constexpr invocable_vtable vtable =
+        { &call, &relocate, &destroy, true, sizeof(ImplT) };
+}; // struct inline_invocable_ops
+
+// Storage holds pointer to heap allocated ImplT
+template<typename ImplT>
+struct heap_invocable_ops {
+    static ImplT*& S_get(void* storage)
+    { return *std::launder(static_cast<ImplT**>(storage)); }
+
+    static void call(void* storage)
+    { S_get(storage)->call(); }
+
+    static void relocate(void* dst, void* src) noexcept
+    { ::new (dst) ImplT*(S_get(src)); }
+
+    static void destroy(void* storage) noexcept
+    { delete S_get(storage); }
+
+    static constexpr invocable_vtable vtable =
+        { &call, &relocate, &destroy, false, sizeof(ImplT) };
+}; // struct heap_invocable_ops
+
+} // namespace detail
+
+
+// Type Erasure of packaged_task or plain callable.
+// Small callables are stored inline, larger ones on heap
+template<std::size_t InlineSize>
+class basic_invocable {
+public:
+    static constexpr std::size_t inline_size =
+        InlineSize < sizeof(void*) ? sizeof(void*) : InlineSize;
+
+    // Stored in place only if it can be moved without throwing,
+    // since invocables are moved around by queues
+    template<typename ImplT>
+    static constexpr bool fits_inline =
+        sizeof(ImplT) <= inline_size
+        && alignof(ImplT) <= alignof(std::max_align_t)
+        && std::is_nothrow_move_constructible_v<ImplT>;
+
+private:
+    alignas(std::max_align_t) unsigned char m_storage[inline_size];
+    const detail::invocable_vtable* m_vtable;
+    // When task was queued. Takes padding after vtable pointer
+    std::chrono::steady_clock::time_point m_enqueued;
+
+private:
+    basic_invocable(const basic_invocable& other) = delete;
+    basic_invocable& operator=(const basic_invocable& other) = delete;
+
+public:
+    basic_invocable()
+        : m_vtable(nullptr)
+        , m_enqueued()
     {}
 
-    invocable& operator=(invocable&& other) {
-        invocable(std::move(other)).swap(*this);
+    basic_invocable(basic_invocable&& other) noexcept
+        : m_vtable(nullptr)
+        , m_enqueued()
+    { M_move_from(other); }
+
+    basic_invocable& operator=(basic_invocable&& other) {
+        basic_invocable(std::move(other)).swap(*this);
         return *this;
     }
 
+    ~basic_invocable()
+    { reset(); }
+
 public:
-    // TODO: Simplify interface.
-    // Let user pass packaged task and args
+    // Args are stored as decayed copies, like in std::thread.
+    // Rvalues are moved in, so move-only args are accepted
     template<typename SignatureT, typename ...Args>
-    invocable(
+    basic_invocable(
         std::packaged_task<SignatureT>&& task,
-        Args... args
+        Args&& ...args
     )
-        : m_inv_ptr( 
-            std::make_unique<
-                invocable_impl<SignatureT, std::tuple<Args...>>>(
-                    std::move(task), std::make_tuple(args...)))
-    {}
+        : m_vtable(nullptr)
+        , m_enqueued()
+    {
+        M_emplace<
+            invocable_impl<SignatureT, std::tuple<std::decay_t<Args>...>>>(
+                std::move(task), std::forward<Args>(args)...);
+    }
+
+    // Fire-and-forget callable. No future is associated with it
+    template<typename Callable, typename ...Args>
+        requires (!std::is_same_v<std::decay_t<Callable>, basic_invocable>)
+    explicit basic_invocable(
+        Callable&& func,
+        Args&& ...args
+    )
+        : m_vtable(nullptr)
+        , m_enqueued()
+    {
+        M_emplace<
+            callable_impl<
+                std::decay_t<Callable>, std::tuple<std::decay_t<Args>...>>>(
+                    std::in_place,
+                    std::forward<Callable>(func), std::forward<Args>(args)...);
+    }
 
 public:
     void operator()() {
-        if(m_inv_ptr)
-            m_inv_ptr->call();
+        if(!m_vtable)
+            return;
 
         // Stored package can be called only once
-        // erase it
-        m_inv_ptr.reset();
+        // erase it, even if call throws
+        struct reset_guard {
+            basic_invocable& inv;
+            ~reset_guard() { inv.reset(); }
+        } guard{*this};
+
+        m_vtable->call(m_storage);
+    }
+
+    void reset() {
+        if(!m_vtable)
+            return;
+
+        m_vtable->destroy(m_storage);
+        m_vtable = nullptr;
+        m_enqueued = std::chrono::steady_clock::time_point();
     }
 
+    bool empty() const
+    { return m_vtable == nullptr; }
+
+    // True if callable is stored inline, without heap allocation
+    bool is_inline() const
+    { return m_vtable != nullptr && m_vtable->is_inline; }
+
+    // Bytes taken by invocable, along with heap allocated callable
+    std::size_t footprint() const {
+        return sizeof(basic_invocable)
+            + (m_vtable && !m_vtable->is_inline ? m_vtable->size : 0);
+    }
+
+    // footprint() of invocable, constructed from Callable and Args
+    template<typename Callable, typename ...Args>
+    static constexpr std::size_t footprint_of() {
+        typedef typename detail::invocable_impl_for<
+            std::decay_t<Callable>, std::tuple<std::decay_t<Args>...>>::type impl_type;
+
+        return sizeof(basic_invocable)
+            + (fits_inline<impl_type> ? 0 : sizeof(impl_type));
+    }
+
+    // Stamped by queue owner. Moves along with callable, is cleared by reset()
+    void set_enqueue_time(std::chrono::steady_clock::time_point time)
+    { m_enqueued = time; }
+
+    // Epoch of steady_clock, if task was not stamped
+    std::chrono::steady_clock::time_point enqueue_time() const
+    { return m_enqueued; }
+
 public:
-    void swap(invocable& other) {
-        using std::swap;
-        swap(m_inv_ptr, other.m_inv_ptr);
+    void swap(basic_invocable& other) {
+        basic_invocable tmp;
+        tmp.M_move_from(other);
+        other.M_move_from(*this);
+        M_move_from(tmp);
     }
 
-    void swap(invocable& a, invocable& b)
+    friend
+    void swap(basic_invocable& a, basic_invocable& b)
     { a.swap(b); }
 
-}; // struct invocable
+// Impl funcs
+private:
+    template<typename ImplT, typename ...CtorArgs>
+    void M_emplace(CtorArgs&& ...ctor_args) {
+        if constexpr (fits_inline<ImplT>) {
+            ::new (static_cast<void*>(m_storage))
+                ImplT(std::forward<CtorArgs>(ctor_args)...);
+            m_vtable = &detail::inline_invocable_ops<ImplT>::vtable;
+        } else {
+            ::new (static_cast<void*>(m_storage))
+                ImplT*(new ImplT(std::forward<CtorArgs>(ctor_args)...));
+            m_vtable = &detail::heap_invocable_ops<ImplT>::vtable;
+        }
+    }
+
+    // Prereq: this is empty
+    void M_move_from(basic_invocable& other) noexcept {
+        if(!other.m_vtable)
+            return;
+
+        other.m_vtable->relocate(m_storage, other.m_storage);
+        m_vtable = other.m_vtable;
+        m_enqueued = other.m_enqueued;
+        other.m_vtable = nullptr;
+        other.m_enqueued = std::chrono::steady_clock::time_point();
+    }
+
+}; // class basic_invocable
+
+typedef basic_invocable<IO_SERVICE_INVOCABLE_INLINE_SIZE> invocable;
 
 } // namespace io_service
 
@@ -0,0 +1,64 @@
+#include "io_backend.hpp"
+#include "epoll_reactor.hpp"
+#include "uring_proactor.hpp"
+
+#include <cerrno>
+#include <cstdint>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace io_service {
+
+namespace detail {
+
+std::error_code last_error()
+{ return std::error_code(errno, std::system_category()); }
+
+} // namespace detail
+
+io_backend::io_backend()
+    : m_event_fd(-1)
+    , m_is_acquired(false)
+    , m_is_blocked(false)
+    , m_is_interrupted(false)
+    , m_num_descriptors(0)
+{
+    m_event_fd = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if(m_event_fd == -1)
+        throw std::system_error(detail::last_error(), "eventfd");
+}
+
+io_backend::~io_backend()
+{ ::close(m_event_fd); }
+
+void io_backend::M_write_event_fd() {
+    const std::uint64_t one = 1;
+    // Might fail only if counter overflows. Then it is readable anyway
+    ssize_t result = ::write(m_event_fd, &one, sizeof(one));
+    (void) result;
+}
+
+void io_backend::M_drain_event_fd() {
+    std::uint64_t counter;
+    ssize_t result = ::read(m_event_fd, &counter, sizeof(counter));
+    (void) result;
+
+    // Cleared after read. interrupt() coming in between is not lost:
+    // owner checks for work before it blocks again
+    M_on_interrupt_drained();
+}
+
+std::unique_ptr<io_backend> make_io_backend(io_backend_type preferred) {
+    if(preferred == io_backend_type::io_uring && uring_proactor::is_supported()) {
+        try {
+            return std::unique_ptr<io_backend>(new uring_proactor());
+        } catch(const std::system_error&) {
+            // Ring might be refused (e.g. by memlock limit). Use epoll then
+        }
+    }
+
+    return std::unique_ptr<io_backend>(new epoll_reactor());
+}
+
+} // namespace io_service
@@ -0,0 +1,294 @@
+#ifndef ASIO_IO_BACKEND_HPP
+#define ASIO_IO_BACKEND_HPP
+
+#include "invocable.hpp"
+#include "service_options.hpp"
+
+#include "mutex.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <sys/uio.h> // iovec
+
+namespace io_service {
+
+namespace detail {
+
+struct descriptor_state;
+
+// Pending read or write on descriptor
+struct io_op {
+public:
+    enum op_type { read, write };
+
+    op_type type;
+    void* data;
+    std::size_t size;
+    // Position in file. Negative for stream I/O (current position)
+    std::int64_t offset;
+
+    // Set by backends, which keep operations in flight past start_op()
+    std::shared_ptr<descriptor_state> descriptor;
+
+public:
+    io_op(op_type in_type, void* in_data, std::size_t in_size, std::int64_t in_offset)
+        : type(in_type)
+        , data(in_data)
+        , size(in_size)
+        , offset(in_offset)
+        , descriptor()
+    {}
+
+    virtual ~io_op() {}
+
+    bool is_positional() const
+    { return offset >= 0; }
+
+    // Task, which calls handler with result. Called once
+    virtual invocable complete(std::error_code ec, std::size_t bytes) = 0;
+
+}; // struct io_op
+
+// Handler is called as handler(std::error_code, std::size_t)
+template<typename Handler>
+struct io_op_impl: io_op {
+private:
+    Handler m_handler;
+
+public:
+    template<typename HandlerT>
+    io_op_impl(
+        op_type in_type, void* in_data, std::size_t in_size,
+        std::int64_t in_offset, HandlerT&& handler
+    )
+        : io_op(in_type, in_data, in_size, in_offset)
+        , m_handler(std::forward<HandlerT>(handler))
+    {}
+
+    invocable complete(std::error_code ec, std::size_t bytes) override
+    { return invocable(std::move(m_handler), ec, bytes); }
+
+}; // struct io_op_impl
+
+typedef std::unique_ptr<io_op> io_op_ptr;
+
+// Descriptor registered with io_backend.
+// Stream operations of each direction complete in order of initiation
+struct descriptor_state {
+    const int fd;
+    // write() to pipe raises SIGPIPE, send() to socket can suppress it
+    const bool is_socket;
+    // Regular files can not be polled. Their operations never block
+    bool is_pollable;
+    // Slot in registered files table of io_uring. Negative if none
+    int fixed_index;
+    // Positional operations, owned by ring of io_uring until completion
+    std::vector<io_op*> positional_ops;
+
+    concurrency::mutex mutex;
+    std::deque<io_op_ptr> read_ops;
+    std::deque<io_op_ptr> write_ops;
+    bool is_registered;
+
+public:
+    descriptor_state(int in_fd, bool in_is_socket)
+        : fd(in_fd)
+        , is_socket(in_is_socket)
+        , is_pollable(true)
+        , fixed_index(-1)
+        , positional_ops()
+        , read_ops()
+        , write_ops()
+        , is_registered(true)
+    {}
+
+    std::deque<io_op_ptr>& ops_of(const io_op& op)
+    { return op.type == io_op::read ? read_ops : write_ops; }
+
+}; // struct descriptor_state
+
+} // namespace detail
+
+
+// Refers to descriptor, registered with io_service.
+// Descriptor itself is owned (and closed) by user
+class descriptor_handle {
+private:
+    std::shared_ptr<detail::descriptor_state> m_state;
+
+public:
+    descriptor_handle()
+        : m_state()
+    {}
+
+    explicit descriptor_handle(std::shared_ptr<detail::descriptor_state> state)
+        : m_state(std::move(state))
+    {}
+
+public:
+    int native_handle() const
+    { return m_state ? m_state->fd : -1; }
+
+    bool valid() const
+    { return m_state != nullptr; }
+
+    detail::descriptor_state* state() const
+    { return m_state.get(); }
+
+    const std::shared_ptr<detail::descriptor_state>& shared_state() const
+    { return m_state; }
+
+}; // class descriptor_handle
+
+
+// Runs descriptor I/O for io_service.
+// Single thread at a time runs the backend (see try_acquire()).
+// Completions are handed out as tasks, they are never called by backend
+class io_backend {
+private:
+    // Interrupts wait of backend
+    int m_event_fd;
+
+    // Thread, which runs the backend
+    std::atomic<bool> m_is_acquired;
+    // Owner is (about to be) blocked in wait
+    std::atomic<bool> m_is_blocked;
+    // eventfd is written, and not drained yet
+    std::atomic<bool> m_is_interrupted;
+
+protected:
+    std::atomic<std::size_t> m_num_descriptors;
+
+private:
+    io_backend(const io_backend& other) = delete;
+    io_backend& operator=(const io_backend& other) = delete;
+
+public:
+    // Throws std::system_error, if eventfd can not be created
+    io_backend();
+
+    virtual ~io_backend();
+
+public:
+    virtual io_backend_type type() const = 0;
+
+    // Throws std::system_error
+    virtual descriptor_handle register_descriptor(int fd) = 0;
+
+    // Pending operations complete with operation_canceled.
+    // Their completions are appended to out
+    virtual void deregister_descriptor(
+        const descriptor_handle& handle, std::vector<invocable>& out) = 0;
+
+    // Returns completion, if operation has completed right away.
+    // Otherwise, returns empty invocable and keeps operation
+    virtual invocable start_op(
+        const descriptor_handle& handle, detail::io_op_ptr op) = 0;
+
+    // Operations on data within registered buffers use them.
+    // Replaces previously registered ones, none of which may be in use.
+    // Returns false, if backend does not support it
+    virtual bool register_buffers(const std::vector<iovec>& /*buffers*/)
+    { return false; }
+
+    // There are operations, queued for submission by owner
+    virtual bool has_pending_submissions() const
+    { return false; }
+
+public:
+    // Only one thread at a time runs the backend
+    bool try_acquire() {
+        bool expected = false;
+        return m_is_acquired.compare_exchange_strong(expected, true);
+    }
+
+    void release()
+    { m_is_acquired = false; }
+
+    bool is_acquired() const
+    { return m_is_acquired; }
+
+    // Waits for events up to timeout_ms (-1 for no timeout), and
+    // appends completions to out.
+    // has_work() is checked after backend is marked blocked, so that
+    // work arrived before that does not wait for interrupt()
+    // Prereq: backend is acquired by calling thread
+    template<typename Predicate>
+    std::size_t run_once(
+        int timeout_ms, std::vector<invocable>& out, Predicate has_work
+    ) {
+        m_is_blocked = true;
+        // Pairs with fence in interrupt()
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(has_work())
+            timeout_ms = 0;
+
+        const std::size_t num_completed = M_wait_and_perform(timeout_ms, out);
+        m_is_blocked = false;
+        return num_completed;
+    }
+
+    // Submits queued operations and takes completions, without blocking
+    // Prereq: backend is acquired by calling thread
+    std::size_t poll(std::vector<invocable>& out)
+    { return M_wait_and_perform(0, out); }
+
+    // Wakes owner up from wait. Coalesced: single eventfd write
+    // until owner drains it. Does nothing, if owner is not blocked
+    void interrupt() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(!m_is_blocked.load(std::memory_order_relaxed))
+            return;
+
+        if(m_is_interrupted.exchange(true))
+            return;
+
+        M_write_event_fd();
+    }
+
+    bool is_blocked() const
+    { return m_is_blocked; }
+
+    // True if there are registered descriptors
+    bool has_descriptors() const
+    { return m_num_descriptors != 0; }
+
+// Impl funcs
+protected:
+    virtual std::size_t M_wait_and_perform(
+        int timeout_ms, std::vector<invocable>& out) = 0;
+
+    int M_event_fd() const
+    { return m_event_fd; }
+
+    // Owner has taken interrupt off eventfd
+    void M_on_interrupt_drained()
+    { m_is_interrupted = false; }
+
+    void M_drain_event_fd();
+
+private:
+    void M_write_event_fd();
+
+}; // class io_backend
+
+namespace detail {
+
+std::error_code last_error();
+
+} // namespace detail
+
+// Falls back to epoll, if preferred backend is not available.
+// Throws std::system_error, if none is
+std::unique_ptr<io_backend> make_io_backend(io_backend_type preferred);
+
+} // namespace io_service
+
+#endif // ASIO_IO_BACKEND_HPP
@@ -1,15 +1,188 @@
 #include "io_service.hpp"
 #include "interrupt_flag.hpp"
 #include "thread_data_mngr.hpp"
+#include "cpu_relax.hpp"
 
+#include "lock_guard.hpp"
+#include "unique_lock.hpp"
+#include "condition_variable.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
 #include <memory>
 #include <thread>
 
 namespace io_service {
 
 thread_local std::unique_ptr<interrupt_handle> local_int_handle_ptr;
+thread_local detail::worker_slot* local_worker_slot_ptr = nullptr;
+
+// Minimal number of local queues. Workers beyond it use global queue only
+static const std::size_t min_worker_slots_num = 64;
+// Worker looks into global queue first every N fetches,
+// so that it is not starved by local queues
+static const unsigned global_queue_poll_interval = 61;
+
+static std::int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        timer_clock::now().time_since_epoch()).count();
+}
+
+namespace {
+
+// Time worker spends within run() / poll()
+struct activity_guard {
+    detail::worker_slot* slot;
+
+    explicit activity_guard(detail::worker_slot* in_slot)
+        : slot(in_slot)
+    {
+        if(slot)
+            slot->counters.active_since_ns = now_ns();
+    }
+
+    ~activity_guard() {
+        if(!slot)
+            return;
+
+        detail::worker_counters& counters = slot->counters;
+        counters.run_ns.add_owned(now_ns() - counters.active_since_ns);
+        counters.active_since_ns = 0;
+    }
+};
+
+// Time worker spends without task
+struct idle_guard {
+    detail::worker_slot* slot;
+
+    explicit idle_guard(detail::worker_slot* in_slot)
+        : slot(in_slot)
+    {
+        if(slot)
+            slot->counters.idle_since_ns = now_ns();
+    }
+
+    ~idle_guard() {
+        if(!slot)
+            return;
+
+        detail::worker_counters& counters = slot->counters;
+        counters.idle_ns.add_owned(now_ns() - counters.idle_since_ns);
+        counters.idle_since_ns = 0;
+    }
+};
+
+// Holds pool threads back, until all of them are started
+struct start_gate {
+    concurrency::mutex mutex;
+    concurrency::condition_variable opened;
+    bool is_open = false;
+    bool is_started = false;
+
+    void open(bool in_is_started) {
+        using namespace concurrency;
+        {
+            lock_guard<concurrency::mutex> lock(mutex);
+            is_open = true;
+            is_started = in_is_started;
+        }
+        opened.notify_all();
+    }
+
+    // Returns false, if pool failed to start
+    bool wait() {
+        using namespace concurrency;
+        unique_lock<concurrency::mutex> lock(mutex);
+        opened.wait(lock, [this] () { return is_open; });
+        return is_started;
+    }
+};
+
+} // namespace
+
+io_service::io_service(service_options options)
+    : m_options(std::move(options))
+    , m_topology(
+        m_options.numa_topology_path == detail::numa_topology::system_path
+            ? detail::numa_topology::system()
+            : m_options.numa_topology_path.empty()
+                ? detail::numa_topology()
+                : detail::numa_topology(m_options.numa_topology_path))
+    , m_shards()
+    , m_shards_num(m_topology.nodes_num())
+    , m_io(make_io_backend(m_options.io_backend))
+    , m_manager()
+    , m_worker_slots()
+    , m_worker_slots_num(
+        std::max<std::size_t>(
+            min_worker_slots_num, 2 * std::thread::hardware_concurrency()))
+    , m_worker_slots_used(0)
+    , m_idle_workers(0)
+    , m_spinning_workers(0)
+    , m_timers(
+        std::make_shared<detail::timer_queue>(m_options.timer_resolution))
+    , m_keeper_deadline(timer_clock::time_point::max().time_since_epoch().count())
+    , m_high_lane()
+    , m_low_lane()
+    , m_normal_lane()
+    , m_is_lane_used(false)
+    , m_external_counters()
+    , m_dropped_bytes(0)
+    , m_external_latency()
+    , m_external_trace()
+    , m_last_stamp(0)
+    , m_is_instrumented(
+        m_options.latency_histograms || m_options.trace_buffer_size != 0)
+    , m_pool()
+    , m_pool_mutex()
+{
+    m_shards = std::make_unique<queue_shard[]>(m_shards_num);
+
+    m_worker_slots = std::make_unique<worker_slot[]>(m_worker_slots_num);
+    for(std::size_t i = 0; i < m_worker_slots_num; ++i)
+        m_worker_slots[i].index = i;
+
+    // Allocated upfront, so that stats() never races with allocation
+    if(m_options.latency_histograms) {
+        m_external_latency = std::make_unique<detail::task_latency>();
+        for(std::size_t i = 0; i < m_worker_slots_num; ++i)
+            m_worker_slots[i].latency = std::make_unique<detail::task_latency>();
+    }
+
+    if(m_options.trace_buffer_size != 0) {
+        const std::size_t buffer_size = m_options.trace_buffer_size;
+        m_external_trace = std::make_unique<detail::trace_ring>(buffer_size);
+        for(std::size_t i = 0; i < m_worker_slots_num; ++i)
+            m_worker_slots[i].trace = std::make_unique<detail::trace_ring>(buffer_size);
+    }
 
-void io_service::run() {
+    m_manager.add_callback_on_stop(
+        [this] () {
+            for(std::size_t i = 0; i < m_shards_num; ++i)
+                m_shards[i].queue.signal();
+            m_io->interrupt();
+        });
+}
+
+std::size_t io_service::run()
+{ return M_run(SIZE_MAX, timer_clock::time_point::max()); }
+
+std::size_t io_service::run_one()
+{ return M_run(1, timer_clock::time_point::max()); }
+
+std::size_t io_service::run_until(timer_clock::time_point deadline)
+{ return M_run(SIZE_MAX, deadline); }
+
+std::size_t io_service::poll()
+{ return M_poll(SIZE_MAX); }
+
+std::size_t io_service::poll_one()
+{ return M_poll(1); }
+
+std::size_t io_service::M_run(
+    std::size_t max_tasks, timer_clock::time_point deadline
+) {
     // Check if it is valid to interact with io_service
     // Throws if io_service is stopped
     M_check_validity();
@@ -20,37 +193,148 @@ void io_service::run() {
     // Alternative to throwing exception ^^^^^^^^^^^^^^^^^
     thread_data_mngr data_mngr(
         local_int_handle_ptr,
-        std::make_unique<interrupt_handle>(m_manager.make_handle()));
+        std::make_unique<interrupt_handle>(m_manager.make_handle()),
+        local_worker_slot_ptr,
+        M_acquire_worker_slot());
+
+    activity_guard activity(local_worker_slot_ptr);
 
     auto is_stopped =
         [this] () { return local_int_handle_ptr->is_stopped(); };
 
-    while(!is_stopped()) {
+    // Wake up either to stop, or to steal from peers
+    auto is_interrupted =
+        [this, &is_stopped] () {
+            return is_stopped() || M_has_stealable_task() || M_has_lane_task();
+        };
+
+    // Returns false, if nothing was fetched
+    auto wait_for_task =
+        [this, &is_interrupted, deadline] (task_type& task) {
+            idle_guard idle(local_worker_slot_ptr);
+            if(M_spin_for_task(task))
+                return true;
+
+            // Either wait for I/O as backend runner, or for tasks
+            return !M_try_run_io(deadline)
+                && M_wait_and_pop_task(task, is_interrupted, deadline);
+        };
+
+    // Clock is read only if there is deadline
+    auto is_expired =
+        [deadline] () {
+            return deadline != timer_clock::time_point::max()
+                && timer_clock::now() >= deadline;
+        };
+
+    std::size_t num_done = 0;
+    while(num_done < max_tasks && !is_stopped() && !is_expired()) {
+        M_process_timers();
+        M_flush_io();
+
         task_type task;
-        if(!M_wait_and_pop_task(task, is_stopped))
-            break; /*could not fetch task. Was interrupted by predicate*/
+        if(!M_try_fetch_task(task) && !wait_for_task(task))
+            continue; /*could not fetch task. Was interrupted by predicate*/
 
         /*execute task*/
-        task();
+        M_execute_task(task);
+        ++num_done;
     }
 
     // Release thread related resources, as we leave run() 
     // Released by thread_data_mngr
+    return num_done;
+}
+
+std::size_t io_service::M_poll(std::size_t max_tasks) {
+    M_check_validity();
+
+    thread_data_mngr data_mngr(
+        local_int_handle_ptr,
+        std::make_unique<interrupt_handle>(m_manager.make_handle()),
+        local_worker_slot_ptr,
+        M_acquire_worker_slot());
+    activity_guard activity(local_worker_slot_ptr);
+
+    std::size_t num_done = 0;
+    while(num_done < max_tasks && !local_int_handle_ptr->is_stopped()) {
+        M_process_timers();
+        M_flush_io();
+
+        task_type task;
+        if(!M_try_fetch_task(task)) {
+            // Backend is polled only when queues run dry
+            if(M_poll_io() == 0)
+                break;
+            continue;
+        }
+
+        M_execute_task(task);
+        ++num_done;
+    }
+
+    return num_done;
 }
 
 void io_service::run_pending_task() {
+    M_process_timers();
+    M_flush_io();
+
     invocable task;
     if(M_try_fetch_task(task)) {
-        task();
+        M_execute_task(task);
     } else {
         std::this_thread::yield();
     }
 }
 
+void io_service::start(std::size_t num_threads, const pool_options& options) {
+    using namespace concurrency;
+
+    M_check_validity();
+
+    lock_guard<mutex> lock(m_pool_mutex);
+    if(!m_pool.empty())
+        throw std::logic_error("Pool of service is running already");
+
+    const std::shared_ptr<start_gate> gate = std::make_shared<start_gate>();
+    const std::vector<unsigned> not_pinned;
+    try {
+        m_pool.reserve(num_threads);
+        for(std::size_t i = 0; i < num_threads; ++i) {
+            const std::vector<unsigned>& cpus =
+                i < options.cpu_sets.size() ? options.cpu_sets[i] : not_pinned;
+
+            m_pool.emplace_back(
+                invocable(
+                    [this, gate] () {
+                        if(!gate->wait())
+                            return;
+
+                        try {
+                            run();
+                        } catch(const service_stopped_error&) {}
+                    }),
+                cpus, options.name_prefix + std::to_string(i), options.stack_size);
+        }
+    } catch(...) {
+        // Threads, started so far, leave without running tasks.
+        // Joined by destructors
+        gate->open(false);
+        m_pool.clear();
+        throw;
+    }
+
+    gate->open(true);
+}
+
 void io_service::stop() {
     m_manager.signal_stop();
     m_manager.wait_all();
 
+    // Owned threads leave run(), or do not enter it
+    M_join_pool();
+
     // Clear task queues
     M_clear_tasks();
 }
@@ -63,13 +347,791 @@ void io_service::restart() {
 
     // reason of immovability of io_service
     m_manager.add_callback_on_stop(
-        [this] () { m_global_queue.signal(); });
+        [this] () {
+            for(std::size_t i = 0; i < m_shards_num; ++i)
+                m_shards[i].queue.signal();
+            m_io->interrupt();
+        });
+}
+
+void io_service::M_push_task(task_type&& task, const char* label) {
+    worker_slot* local_slot = M_local_worker_slot();
+    M_count_posted(local_slot, 1, task.footprint());
+
+    // Delay of normal level is recorded, once task is fetched.
+    // Without lanes and instrumentation, clock is not read
+    if(m_is_instrumented)
+        task.set_enqueue_time(M_stamp(local_slot, label));
+    else if(m_is_lane_used.load(std::memory_order_relaxed))
+        task.set_enqueue_time(timer_clock::now());
+
+    if(!local_slot) {
+        queue_shard& shard = M_local_shard(nullptr);
+        shard.queue.push(std::move(task));
+        M_wake_remote_worker(shard);
+        M_interrupt_io();
+        return;
+    }
+
+    local_slot->local_queue.push(std::move(task));
+    M_wake_idle_workers(1);
+    M_interrupt_io();
+}
+
+void io_service::M_push_task(task_priority priority, task_type&& task) {
+    // Same as post()
+    if(priority == task_priority::normal) {
+        M_push_task(std::move(task));
+        return;
+    }
+
+    if(!m_is_lane_used.load(std::memory_order_relaxed))
+        m_is_lane_used.store(true, std::memory_order_relaxed);
+
+    worker_slot* local_slot = M_local_worker_slot();
+    M_count_posted(local_slot, 1, task.footprint());
+
+    // Lanes stamp tasks anyway. Stamp has to be unique while tracing
+    const timer_clock::time_point now =
+        m_is_instrumented ? M_stamp(local_slot, nullptr) : timer_clock::now();
+    if(priority == task_priority::high)
+        m_high_lane.push(std::move(task), now);
+    else
+        m_low_lane.push(std::move(task), now);
+
+    // Lanes are not stealable. Wake worker, as local queue does
+    M_wake_idle_workers(1);
+    M_interrupt_io();
+}
+
+timer_clock::time_point io_service::M_stamp(worker_slot* slot, const char* label) {
+    const timer_clock::time_point now = timer_clock::now();
+    if(!m_external_trace)
+        return now;
+
+    // Tasks, posted within same tick of clock, get ticks after it
+    timer_clock::rep last = m_last_stamp.load(std::memory_order_relaxed);
+    timer_clock::rep stamp;
+    do {
+        stamp = std::max(now.time_since_epoch().count(), last + 1);
+    } while(!m_last_stamp.compare_exchange_weak(
+        last, stamp, std::memory_order_relaxed));
+
+    const timer_clock::time_point time{timer_clock::duration(stamp)};
+    M_trace(trace_event_type::post, time, time, label, slot);
+    return time;
+}
+
+void io_service::M_wake_idle_workers(std::size_t num_tasks) {
+    // Polling workers will steal some of tasks without being woken
+    const std::size_t spinning_workers = m_spinning_workers;
+    if(num_tasks <= spinning_workers)
+        return;
+    num_tasks -= spinning_workers;
+
+    // Let sleeping peers steal tasks, while this worker is busy
+    const int idle_workers = m_idle_workers;
+    if(idle_workers <= 0)
+        return;
+
+    // Peers of same node first
+    worker_slot* local_slot = M_local_worker_slot();
+    M_wake_blocked_workers(
+        std::min(num_tasks, static_cast<std::size_t>(idle_workers)),
+        local_slot ? local_slot->node.load() : 0);
+}
+
+void io_service::M_wake_blocked_workers(
+    std::size_t num_workers, std::size_t first_shard
+) {
+    if(m_shards_num == 1) {
+        m_shards[0].queue.wake(num_workers);
+        return;
+    }
+
+    for(std::size_t i = 0; i < m_shards_num && num_workers != 0; ++i) {
+        queue_shard& shard = m_shards[(first_shard + i) % m_shards_num];
+        const int idle_workers = shard.idle_workers;
+        if(idle_workers <= 0)
+            continue;
+
+        const std::size_t num_woken =
+            std::min(num_workers, static_cast<std::size_t>(idle_workers));
+        shard.queue.wake(num_woken);
+        num_workers -= num_woken;
+    }
+}
+
+void io_service::M_wake_remote_worker(const queue_shard& shard) {
+    // Idle worker of shard's node is woken by push itself
+    if(m_shards_num == 1 || shard.idle_workers > 0 || m_idle_workers <= 0)
+        return;
+
+    M_wake_blocked_workers(
+        1, static_cast<std::size_t>(&shard - m_shards.get()) + 1);
+}
+
+timer_handle io_service::M_schedule_timer(
+    std::shared_ptr<detail::timer_state> state
+) {
+    timer_handle handle(state, m_timers);
+
+    // Idle workers wait for later deadline, if any
+    if(m_timers->schedule(std::move(state)))
+        M_wake_timer_keeper();
+
+    return handle;
+}
+
+void io_service::M_process_timers() {
+    // Clock is not read, if there are no timers
+    if(!m_timers->has_timers())
+        return;
+
+    const timer_clock::time_point now = timer_clock::now();
+    if(now < m_timers->next_deadline())
+        return;
+
+    std::vector<task_type> expired;
+    m_timers->expire(now,
+        [this, &expired] (std::shared_ptr<detail::timer_state>&& state) {
+            if(!state->is_periodic()) {
+                expired.push_back(std::move(state->task));
+                return;
+            }
+
+            expired.emplace_back(
+                [this, state = std::move(state)] () {
+                    M_run_periodic_timer(state);
+                });
+        });
+
+    M_push_task_bulk(
+        std::make_move_iterator(expired.begin()),
+        std::make_move_iterator(expired.end()));
+}
+
+void io_service::M_run_periodic_timer(
+    const std::shared_ptr<detail::timer_state>& state
+) {
+    if(state->status != detail::timer_status::pending)
+        return;
+
+    // Rearmed even if callback throws
+    struct rearm_guard {
+        io_service& serv;
+        const std::shared_ptr<detail::timer_state>& state;
+        ~rearm_guard() { serv.M_rearm_periodic_timer(state); }
+    } guard{*this, state};
+
+    state->callback();
+}
+
+void io_service::M_rearm_periodic_timer(
+    const std::shared_ptr<detail::timer_state>& state
+) {
+    if(state->status != detail::timer_status::pending
+        || m_manager.is_stopped()
+    )
+        return;
+
+    // Skip runs, which were missed
+    const timer_clock::time_point now = timer_clock::now();
+    state->deadline += state->period;
+    if(state->deadline <= now)
+        state->deadline +=
+            ((now - state->deadline) / state->period + 1) * state->period;
+
+    if(m_timers->schedule(state))
+        M_wake_timer_keeper();
+
+    // Cancelled meanwhile. cancel() might have missed it in timer_queue
+    if(state->status != detail::timer_status::pending)
+        m_timers->remove(*state);
+}
+
+void io_service::M_wake_timer_keeper() {
+    // Any of them would do, rather than all
+    if(m_idle_workers > 0)
+        M_wake_blocked_workers(1, 0);
+
+    // Backend waits for old deadline as well
+    m_io->interrupt();
+}
+
+bool io_service::M_needs_timer_keeper() {
+    return m_timers->next_deadline().time_since_epoch().count()
+        < m_keeper_deadline.load();
+}
+
+bool io_service::M_try_keep_timers(timer_clock::time_point& deadline) {
+    const timer_clock::rep next_deadline =
+        m_timers->next_deadline().time_since_epoch().count();
+
+    timer_clock::rep kept_deadline = m_keeper_deadline;
+    do {
+        if(next_deadline >= kept_deadline)
+            return false;
+    } while(!m_keeper_deadline.compare_exchange_weak(kept_deadline, next_deadline));
+
+    deadline = timer_clock::time_point(timer_clock::duration(next_deadline));
+    return true;
+}
+
+void io_service::M_leave_timers(timer_clock::time_point deadline) {
+    timer_clock::rep kept_deadline = deadline.time_since_epoch().count();
+    m_keeper_deadline.compare_exchange_strong(kept_deadline,
+        timer_clock::time_point::max().time_since_epoch().count());
+}
+
+descriptor_handle io_service::register_descriptor(int fd) {
+    descriptor_handle handle = m_io->register_descriptor(fd);
+
+    // Workers, blocked before first descriptor, do not run backend
+    if(m_idle_workers > 0)
+        M_wake_blocked_workers(1, 0);
+
+    return handle;
+}
+
+void io_service::deregister_descriptor(const descriptor_handle& handle) {
+    std::vector<task_type> cancelled;
+    m_io->deregister_descriptor(handle, cancelled);
+
+    M_push_task_bulk(
+        std::make_move_iterator(cancelled.begin()),
+        std::make_move_iterator(cancelled.end()));
+}
+
+void io_service::M_start_io_op(
+    const descriptor_handle& handle, detail::io_op_ptr op
+) {
+    // Completed right away, or queued until descriptor is ready
+    task_type completion = m_io->start_op(handle, std::move(op));
+    if(!completion.empty())
+        M_push_task(std::move(completion));
+}
+
+bool io_service::M_try_run_io(timer_clock::time_point until) {
+    if(!m_io->has_descriptors() || !m_io->try_acquire())
+        return false;
+
+    // Backend wakes up for next timer deadline, or for caller's one
+    const timer_clock::time_point deadline =
+        m_timers->has_timers() ? std::min(m_timers->next_deadline(), until) : until;
+
+    int timeout_ms = -1;
+    if(deadline != timer_clock::time_point::max()) {
+        const timer_clock::duration until_deadline =
+            deadline - timer_clock::now();
+        const std::chrono::milliseconds::rep until_deadline_ms =
+            std::chrono::ceil<std::chrono::milliseconds>(until_deadline).count();
+
+        timeout_ms = static_cast<int>(
+            std::clamp<std::chrono::milliseconds::rep>(
+                until_deadline_ms, 0, INT_MAX));
+    }
+
+    std::vector<task_type> completions;
+    m_io->run_once(timeout_ms, completions,
+        [this] () {
+            return local_int_handle_ptr->is_stopped() || M_has_pending_task();
+        });
+    m_io->release();
+
+    M_push_task_bulk(
+        std::make_move_iterator(completions.begin()),
+        std::make_move_iterator(completions.end()));
+    return true;
+}
+
+void io_service::M_flush_io() {
+    // Cheap check. Runner submits them anyway
+    if(!m_io->has_pending_submissions())
+        return;
+
+    M_poll_io();
+}
+
+std::size_t io_service::M_poll_io() {
+    if(!(m_io->has_descriptors() || m_io->has_pending_submissions())
+        || !m_io->try_acquire()
+    )
+        return 0;
+
+    std::vector<task_type> completions;
+    m_io->poll(completions);
+    m_io->release();
+
+    M_push_task_bulk(
+        std::make_move_iterator(completions.begin()),
+        std::make_move_iterator(completions.end()));
+    return completions.size();
+}
+
+std::int64_t io_service::S_to_offset(std::uint64_t offset) {
+    if(offset > static_cast<std::uint64_t>(INT64_MAX))
+        throw std::invalid_argument("File offset is out of range");
+
+    return static_cast<std::int64_t>(offset);
+}
+
+void io_service::M_interrupt_io() {
+    // Blocked workers take the task
+    if(!m_io->has_descriptors() || m_idle_workers > 0)
+        return;
+
+    m_io->interrupt();
+}
+
+bool io_service::M_needs_io_runner() {
+    return m_io->has_descriptors() && !m_io->is_acquired();
+}
+
+service_stats io_service::stats() const {
+    using std::chrono::nanoseconds;
+
+    service_stats res{};
+    std::uint64_t bytes_posted = 0;
+    std::uint64_t bytes_executed = 0;
+
+    auto add_counters =
+        [&] (const detail::worker_counters& counters) {
+            res.tasks_posted += counters.tasks_posted.load();
+            res.tasks_dispatched += counters.tasks_dispatched.load();
+            res.tasks_executed += counters.tasks_executed.load();
+            res.wakeups += counters.wakeups.load();
+            bytes_posted += counters.bytes_posted.load();
+            bytes_executed += counters.bytes_executed.load();
+        };
+
+    add_counters(m_external_counters);
+
+    // Periods in progress count up to now
+    const std::int64_t now = now_ns();
+    const std::size_t slots_used = m_worker_slots_used;
+    for(std::size_t i = 0; i < slots_used; ++i) {
+        const worker_slot& slot = m_worker_slots[i];
+        const detail::worker_counters& counters = slot.counters;
+        add_counters(counters);
+
+        const std::int64_t active_since = counters.active_since_ns;
+        const std::int64_t idle_since = counters.idle_since_ns;
+        const std::int64_t run_ns = counters.run_ns.load()
+            + (active_since != 0 ? now - active_since : 0);
+        const std::int64_t idle_ns = counters.idle_ns.load()
+            + (idle_since != 0 ? now - idle_since : 0);
+
+        worker_stats worker{};
+        worker.index = slot.index;
+        worker.is_active = active_since != 0;
+        worker.tasks_posted = counters.tasks_posted.load();
+        worker.tasks_dispatched = counters.tasks_dispatched.load();
+        worker.tasks_executed = counters.tasks_executed.load();
+        worker.wakeups = counters.wakeups.load();
+        worker.busy_time = nanoseconds(std::max<std::int64_t>(0, run_ns - idle_ns));
+        worker.idle_time = nanoseconds(idle_ns);
+        worker.local_queue_depth = slot.local_queue.size();
+
+        res.busy_time += worker.busy_time;
+        res.idle_time += worker.idle_time;
+        res.local_queue_depth += worker.local_queue_depth;
+        res.workers.push_back(worker);
+    }
+
+    res.global_queue_depth = 0;
+    for(std::size_t i = 0; i < m_shards_num; ++i)
+        res.global_queue_depth += m_shards[i].queue.size();
+    res.priority_queue_depth = m_high_lane.size() + m_low_lane.size();
+
+    // Counters are read one by one. Might be behind each other
+    const std::uint64_t bytes_done = bytes_executed + m_dropped_bytes;
+    res.queued_bytes = bytes_posted > bytes_done ? bytes_posted - bytes_done : 0;
+
+    res.queue_delays = {
+        m_high_lane.delay.snapshot(),
+        m_normal_lane.delay.snapshot(),
+        m_low_lane.delay.snapshot()};
+
+    if(m_external_latency) {
+        auto merge_latency =
+            [&res] (const detail::task_latency& latency) {
+                latency.queue_delay.merge_into(res.queue_delay_histogram);
+                latency.run_time.merge_into(res.run_time_histogram);
+            };
+
+        merge_latency(*m_external_latency);
+        for(std::size_t i = 0; i < slots_used; ++i)
+            merge_latency(*m_worker_slots[i].latency);
+    }
+
+    return res;
+}
+
+service_trace io_service::trace() const {
+    service_trace res;
+    if(!m_external_trace)
+        return res;
+
+    res.threads.push_back(thread_trace{0, false, {}});
+    m_external_trace->snapshot(res.threads.back().events);
+
+    const std::size_t slots_used = m_worker_slots_used;
+    for(std::size_t i = 0; i < slots_used; ++i) {
+        const worker_slot& slot = m_worker_slots[i];
+        res.threads.push_back(thread_trace{slot.index, true, {}});
+        slot.trace->snapshot(res.threads.back().events);
+    }
+
+    return res;
+}
+
+void io_service::M_execute_task(task_type& task) {
+    worker_slot* local_slot = M_local_worker_slot();
+    M_count(&detail::worker_counters::tasks_executed, 1, local_slot);
+    M_count(&detail::worker_counters::bytes_executed, task.footprint(), local_slot);
+
+    if(m_is_instrumented) {
+        M_execute_timed_task(task, local_slot);
+        return;
+    }
+
+    try {
+        task();
+    } catch(...) {
+        M_handle_task_exception(std::current_exception());
+    }
+}
+
+void io_service::M_execute_timed_task(task_type& task, worker_slot* slot) {
+    const timer_clock::time_point start = timer_clock::now();
+
+    // Tasks of post_bulk(), timers and I/O are not stamped
+    const timer_clock::time_point enqueued = task.enqueue_time();
+    if(m_external_latency && enqueued != timer_clock::time_point())
+        M_record_latency(&detail::task_latency::queue_delay, start - enqueued, slot);
+    if(m_external_trace)
+        M_trace(trace_event_type::start, start, enqueued, nullptr, slot);
+
+    // Run time is recorded before exception policy is applied,
+    // since rethrow leaves run()
+    std::exception_ptr ex_ptr;
+    try {
+        task();
+    } catch(...) {
+        ex_ptr = std::current_exception();
+    }
+
+    const timer_clock::time_point end = timer_clock::now();
+    if(m_external_latency)
+        M_record_latency(&detail::task_latency::run_time, end - start, slot);
+    if(m_external_trace)
+        M_trace(trace_event_type::end, end, enqueued, nullptr, slot);
+
+    if(ex_ptr)
+        M_handle_task_exception(ex_ptr);
+}
+
+void io_service::M_handle_task_exception(std::exception_ptr ex_ptr) {
+    switch(m_options.on_task_exception) {
+    case exception_policy::discard:
+        break;
+    case exception_policy::terminate:
+        std::terminate();
+    case exception_policy::handler:
+        m_options.exception_handler(ex_ptr);
+        break;
+    case exception_policy::rethrow:
+        std::rethrow_exception(ex_ptr);
+    }
+}
+
+bool io_service::M_try_fetch_task(task_type& task) {
+    // Without prioritized tasks, levels cost two size loads
+    if(M_has_lane_task())
+        return M_try_fetch_by_priority(task);
+
+    m_normal_lane.mark_served();
+    return M_try_fetch_normal_task(task);
+}
+
+bool io_service::M_try_fetch_by_priority(task_type& task) {
+    const timer_clock::time_point now = timer_clock::now();
+    const timer_clock::duration aging = m_options.priority_aging;
+
+    // Lower aged level first, so that each of them moves on
+    if(aging > timer_clock::duration::zero()) {
+        if(m_low_lane.is_aged(now, aging) && m_low_lane.try_pop(task, now))
+            return true;
+
+        if(m_normal_lane.is_aged(now, aging) && M_try_fetch_normal_task(task)) {
+            m_normal_lane.mark_served();
+            return true;
+        }
+    }
+
+    // Levels with tasks are passed over. Drained ones are not
+    auto pass_over =
+        [now] (detail::lane_state& lane, bool has_tasks) {
+            if(has_tasks)
+                lane.mark_passed_over(now);
+            else
+                lane.mark_served();
+        };
+
+    if(m_high_lane.try_pop(task, now)) {
+        pass_over(m_normal_lane, M_has_normal_task());
+        pass_over(m_low_lane, !m_low_lane.empty());
+        return true;
+    }
+
+    if(M_try_fetch_normal_task(task)) {
+        m_normal_lane.mark_served();
+        pass_over(m_low_lane, !m_low_lane.empty());
+        return true;
+    }
+
+    return m_low_lane.try_pop(task, now);
+}
+
+bool io_service::M_try_fetch_normal_task(task_type& task) {
+    if(!M_try_pop_normal_task(task))
+        return false;
+
+    M_record_normal_delay(task);
+    return true;
+}
+
+void io_service::M_record_normal_delay(const task_type& task) {
+    // Stamped only while lanes or instrumentation are in use.
+    // Tasks of post_bulk() are not stamped at all
+    const timer_clock::time_point enqueued = task.enqueue_time();
+    if(enqueued != timer_clock::time_point())
+        m_normal_lane.delay.record(timer_clock::now() - enqueued);
 }
 
 // TODO: Learn if perfect forwarding could be suitable here
-bool io_service::M_try_fetch_task(invocable& task) {
-    // TODO: fetch from local / others / global
-    return m_global_queue.try_pop(task);
+bool io_service::M_try_pop_normal_task(task_type& task) {
+    worker_slot* local_slot = M_local_worker_slot();
+
+    // Not in pool. Help workers with their queues first
+    if(!local_slot) {
+        queue_shard& shard = M_local_shard(nullptr);
+        return M_try_steal_task(task, nullptr)
+            || shard.queue.try_pop(task)
+            || M_try_pop_remote_task(task, shard);
+    }
+
+    if(++local_slot->fetch_tick % global_queue_poll_interval == 0
+        && M_try_pop_global_task(task, local_slot)
+    )
+        return true;
+
+    // fetch from local / others / global, then cross node
+    return local_slot->local_queue.try_pop(task)
+        || M_try_steal_task(task, local_slot)
+        || M_try_pop_global_task(task, local_slot)
+        || M_try_fetch_remote_task(task, local_slot);
+}
+
+bool io_service::M_try_pop_global_task(task_type& task, worker_slot* local_slot) {
+    global_queue_type& queue = M_local_shard(local_slot).queue;
+    if(m_options.fetch_batch_size <= 1)
+        return queue.try_pop(task);
+
+    // Popped tasks are not lost to allocation of buffer
+    local_slot->fetch_buffer.reserve(m_options.fetch_batch_size);
+    queue.try_pop_n(
+        std::back_inserter(local_slot->fetch_buffer),
+        m_options.fetch_batch_size);
+    return M_take_fetched_batch(local_slot, task);
+}
+
+bool io_service::M_try_pop_remote_task(
+    task_type& task, const queue_shard& local_shard
+) {
+    if(m_shards_num == 1)
+        return false;
+
+    // Single task. Batch would pull more of remote memory
+    const std::size_t local_idx =
+        static_cast<std::size_t>(&local_shard - m_shards.get());
+    for(std::size_t i = 1; i < m_shards_num; ++i) {
+        queue_shard& shard = m_shards[(local_idx + i) % m_shards_num];
+        if(shard.queue.size() != 0 && shard.queue.try_pop(task))
+            return true;
+    }
+
+    return false;
+}
+
+bool io_service::M_try_fetch_remote_task(task_type& task, worker_slot* local_slot) {
+    if(m_shards_num == 1)
+        return false;
+
+    return M_try_steal_task(task, local_slot, false)
+        || M_try_pop_remote_task(task, M_local_shard(local_slot));
+}
+
+bool io_service::M_take_fetched_batch(worker_slot* local_slot, task_type& task) {
+    std::vector<task_type>& batch = local_slot->fetch_buffer;
+    if(batch.empty())
+        return false;
+
+    // Rest stays stealable, so that batch does not hold tasks back
+    std::size_t num_pushed = 0;
+    try {
+        num_pushed = local_slot->local_queue.push_bulk(
+            std::make_move_iterator(batch.begin() + 1),
+            std::make_move_iterator(batch.end()));
+    } catch(...) {
+        // Tasks, which were not moved into local queue, are returned
+        // to global one, rather than lost
+        std::vector<task_type> rest(std::move(batch));
+        batch.clear();
+        rest.erase(
+            std::remove_if(rest.begin(), rest.end(),
+                [] (const task_type& left) { return left.empty(); }),
+            rest.end());
+        M_local_shard(local_slot).queue.push_bulk(
+            std::make_move_iterator(rest.begin()),
+            std::make_move_iterator(rest.end()));
+        throw;
+    }
+
+    task = std::move(batch.front());
+    batch.clear();
+
+    M_wake_idle_workers(num_pushed);
+    return true;
+}
+
+bool io_service::M_try_steal_task(
+    task_type& task, worker_slot* thief_slot, bool local_node
+) {
+    const std::size_t slots_used = m_worker_slots_used;
+    if(slots_used == 0)
+        return false;
+
+    // Single node: every victim is local. Threads outside of pool
+    // belong to no node, so they steal from any
+    const bool is_filtered = thief_slot && m_shards_num > 1;
+    if(!local_node && !is_filtered)
+        return false;
+    const std::size_t thief_node = thief_slot ? thief_slot->node.load() : 0;
+
+    // Start from neighbour, so that thieves spread over victims
+    const std::size_t start_idx =
+        thief_slot ? thief_slot->index + 1 : 0;
+
+    for(std::size_t i = 0; i < slots_used; ++i) {
+        worker_slot& victim = m_worker_slots[(start_idx + i) % slots_used];
+        if(&victim == thief_slot)
+            continue;
+
+        if(is_filtered && (victim.node.load() == thief_node) != local_node)
+            continue;
+
+        if(victim.local_queue.try_steal(task))
+            return true;
+    }
+
+    return false;
+}
+
+bool io_service::M_has_stealable_task() {
+    const std::size_t slots_used = m_worker_slots_used;
+    for(std::size_t i = 0; i < slots_used; ++i)
+        if(!m_worker_slots[i].local_queue.empty())
+            return true;
+
+    return false;
+}
+
+bool io_service::M_has_remote_task(const queue_shard& local_shard) {
+    for(std::size_t i = 0; i < m_shards_num; ++i)
+        if(&m_shards[i] != &local_shard && m_shards[i].queue.size() != 0)
+            return true;
+
+    return false;
+}
+
+bool io_service::M_has_pending_task() {
+    return M_has_normal_task() || M_has_lane_task();
+}
+
+bool io_service::M_has_normal_task() {
+    for(std::size_t i = 0; i < m_shards_num; ++i)
+        if(m_shards[i].queue.size() != 0)
+            return true;
+
+    return M_has_stealable_task();
+}
+
+bool io_service::M_has_lane_task() {
+    return !m_high_lane.empty() || !m_low_lane.empty();
+}
+
+bool io_service::M_spin_for_task(task_type& task) {
+    const idle_strategy& idle = m_options.idle;
+    const unsigned num_polls = idle.spin_iterations + idle.yield_iterations;
+    if(num_polls == 0)
+        return false;
+
+    // Enough workers are polling already. Block
+    if(++m_spinning_workers > idle.max_spinning_workers) {
+        --m_spinning_workers;
+        return false;
+    }
+
+    bool is_fetched = false;
+    for(unsigned i = 0; i < num_polls && !is_fetched; ++i) {
+        if(local_int_handle_ptr->is_stopped())
+            break;
+
+        if(i < idle.spin_iterations)
+            cpu_relax();
+        else
+            std::this_thread::yield();
+
+        // Locks are taken only if there is something to fetch
+        if(M_has_pending_task())
+            is_fetched = M_try_fetch_task(task);
+    }
+
+    --m_spinning_workers;
+    return is_fetched;
+}
+
+io_service::worker_slot* io_service::M_acquire_worker_slot() {
+    for(std::size_t i = 0; i < m_worker_slots_num; ++i) {
+        if(!m_worker_slots[i].try_acquire())
+            continue;
+
+        // Shard, which worker waits on, and peers it steals from first
+        m_worker_slots[i].node.store(
+            m_shards_num > 1 ? m_topology.thread_node() : 0);
+
+        // Extend area scanned by thieves
+        std::size_t slots_used = m_worker_slots_used;
+        while(slots_used < i + 1
+            && !m_worker_slots_used.compare_exchange_weak(slots_used, i + 1)
+        )
+            ;
+
+        return &m_worker_slots[i];
+    }
+
+    // Out of slots. Worker will use global queue only
+    return nullptr;
+}
+
+io_service::worker_slot* io_service::M_local_worker_slot() {
+    // Slot belongs to pool of other io_service
+    if(!M_is_in_pool())
+        return nullptr;
+
+    return local_worker_slot_ptr;
 }
 
 bool io_service::M_is_in_pool() {
@@ -84,10 +1146,57 @@ void io_service::M_check_validity() {
         throw service_stopped_error("Service is stopped");
 }
 
+void io_service::M_join_pool() {
+    using namespace concurrency;
+
+    std::vector<detail::pool_thread> pool;
+    {
+        lock_guard<mutex> lock(m_pool_mutex);
+        pool.swap(m_pool);
+    }
+    // Joined by destructors
+}
+
 void io_service::M_clear_tasks() {
+    // Dropped tasks are not queued anymore. Timers are not counted
+    // as posted, until they fire
+    std::uint64_t dropped_bytes = 0;
+    auto count_dropped =
+        [&dropped_bytes] (const task_type& task) {
+            dropped_bytes += task.footprint();
+        };
+
+    // cancel timers
+    m_timers->clear();
+
     // clear global queue
-    threadsafe_queue<task_type> sink(
-        std::move(m_global_queue));
+    for(std::size_t i = 0; i < m_shards_num; ++i)
+        m_shards[i].queue.clear(count_dropped);
+
+    // clear local queues
+    const std::size_t slots_used = m_worker_slots_used;
+    for(std::size_t i = 0; i < slots_used; ++i)
+        m_worker_slots[i].local_queue.clear(count_dropped);
+
+    // clear priority lanes
+    m_high_lane.clear(count_dropped);
+    m_low_lane.clear(count_dropped);
+    m_normal_lane.mark_served();
+
+    m_dropped_bytes += dropped_bytes;
 }
 
+namespace detail {
+
+void post_continuation(io_service& serv, invocable&& continuation) {
+    // Dropped one is destroyed here. It owns state of future, which
+    // owns it back, until it runs
+    invocable task(std::move(continuation));
+    try {
+        serv.post(std::move(task));
+    } catch(const service_stopped_error&) {}
+}
+
+} // namespace detail
+
 } // namespace io_service
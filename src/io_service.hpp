@@ -4,15 +4,40 @@
 #include "helgrind_annotations.hpp"
 
 #include <iostream>
+#include <functional> // std::invoke
 #include <stdexcept>
 #include <type_traits>
 
+#include <algorithm>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
 #include <future>
+#include <iterator>
+#include <memory>
+#include <utility> // std::exchange
+#include <vector>
 #include "invocable.hpp"
 #include "interrupt_flag.hpp"
 #include "threadsafe_queue.hpp"
+#include "mpmc_bounded_queue.hpp"
+#include "worker_slot.hpp"
+#include "numa_topology.hpp"
+#include "pool_thread.hpp"
+#include "timer_queue.hpp"
+#include "io_backend.hpp"
+#include "priority_lane.hpp"
+#include "service_stats.hpp"
+#include "service_options.hpp"
+#include "task_trace.hpp"
+#include "task.hpp"
+#include "future.hpp"
 #include "false_func.hpp"
 
+#include "mutex.hpp"
+
 namespace io_service {
 
 // Service is stopped
@@ -25,13 +50,95 @@ public:
 }; // class service_stopped_error
 
 
+// Result of Callable, invoked by stored task with stored (decayed) args
+template<typename Callable, typename ...Args>
+using task_result_t =
+    std::invoke_result_t<std::decay_t<Callable>&, std::decay_t<Args>...>;
+
+
 class io_service {
 private:
     typedef invocable task_type;
 
+    // Lock-free ring is bounded. post() into full queue waits for space
+#ifdef IO_SERVICE_MPMC_GLOBAL_QUEUE
+    typedef mpmc_bounded_queue<task_type> global_queue_type;
+#else
+    typedef threadsafe_queue<task_type> global_queue_type;
+#endif
+
+    typedef detail::worker_slot worker_slot;
+
+    // Part of global queue, which belongs to single NUMA node
+    struct alignas(64) queue_shard {
+        global_queue_type queue;
+        // Workers of node, blocked on queue
+        std::atomic<int> idle_workers;
+
+        queue_shard()
+            : queue()
+            , idle_workers(0)
+        {}
+    };
+
 private:
-    threadsafe_queue<task_type> m_global_queue;
+    service_options m_options; /*fixed at construction*/
+
+    detail::numa_topology m_topology;
+    // Global queue. Shard per node of m_topology
+    std::unique_ptr<queue_shard[]> m_shards;
+    std::size_t m_shards_num;
+    // Run by one of idle workers, instead of waiting on global queue.
+    // Outlives m_manager, whose stop callback interrupts it
+    std::unique_ptr<io_backend> m_io;
     interrupt_flag m_manager;
+
+    // Local queues of workers. Leased by run()
+    std::unique_ptr<worker_slot[]> m_worker_slots;
+    std::size_t m_worker_slots_num;
+    // Upper bound of slots ever leased. Limits steal scanning
+    std::atomic<std::size_t> m_worker_slots_used;
+
+    // Workers blocked on any shard of global queue
+    std::atomic<int> m_idle_workers;
+    // Workers polling queues before they block
+    std::atomic<unsigned> m_spinning_workers;
+
+    // Shared with timer_handles, which might outlive io_service
+    std::shared_ptr<detail::timer_queue> m_timers;
+    // Deadline, which idle timer keeper waits for.
+    // time_point::max() if there is no keeper
+    std::atomic<timer_clock::rep> m_keeper_deadline;
+
+    // Tasks of high and low priority. Normal ones use queues above,
+    // so that post() without priority costs nothing extra
+    detail::priority_lane m_high_lane;
+    detail::priority_lane m_low_lane;
+    detail::lane_state m_normal_lane;
+    // Some task was posted with high or low priority. Since then,
+    // tasks of normal level are stamped, so that their delay is recorded
+    std::atomic<bool> m_is_lane_used;
+
+    // Counters of threads without worker slot: posters outside of pool,
+    // and workers, which ran out of slots
+    detail::worker_counters m_external_counters;
+    // Bytes of tasks, dropped by stop()
+    std::atomic<std::uint64_t> m_dropped_bytes;
+    // Histograms of threads without worker slot. Null, unless enabled
+    std::unique_ptr<detail::task_latency> m_external_latency;
+    // Trace of threads without worker slot. Null, unless enabled
+    std::unique_ptr<detail::trace_ring> m_external_trace;
+    // Last stamp handed out while tracing. Stamps are unique then,
+    // so that they identify tasks in trace
+    std::atomic<timer_clock::rep> m_last_stamp;
+    // Histograms or tracing are on: tasks are stamped at push,
+    // and timed when they run
+    bool m_is_instrumented;
+
+    // Threads started by start(). Joined by stop()
+    std::vector<detail::pool_thread> m_pool;
+    concurrency::mutex m_pool_mutex;
+
    
 private:
     io_service(const io_service& other) = delete;
@@ -41,91 +148,509 @@ private:
     io_service& operator=(io_service&& other) = delete;
 
 public:
-    io_service() {
-        m_manager.add_callback_on_stop(
-            [this] () { m_global_queue.signal(); });
-    }
+    explicit io_service(service_options options = service_options());
 
     ~io_service() {
         stop();
     }
 
 public:
-    void run();
+    // Run tasks on calling thread, which joins the pool meanwhile.
+    // Each returns number of tasks executed. Stop ends any of them.
+    // Throws service_stopped_error, if service is stopped
+
+    // Until stop()
+    std::size_t run();
+    // Blocks until single task is executed
+    std::size_t run_one();
+
+    // Until deadline. Task, started before it, is not interrupted
+    template<typename Rep, typename Period>
+    std::size_t
+    run_for(const std::chrono::duration<Rep, Period>& timeout) {
+        return run_until(S_deadline_after(timeout));
+    }
+
+    std::size_t run_until(timer_clock::time_point deadline);
+
+    // Never block: run tasks, which are ready, including due timers
+    // and completed I/O. Tasks, posted by them, are run as well
+    std::size_t poll();
+    std::size_t poll_one();
 
     void run_pending_task();
 
+    // Starts threads, owned by service, which call run().
+    // stop() joins them, so it may not be called by them.
+    // Throws std::logic_error, if pool is running already, and
+    // std::system_error, if thread can not be started: ones started
+    // before are joined, without running tasks. Exception, which leaves
+    // run() of owned thread (exception_policy::rethrow), terminates program
+    void start(std::size_t num_threads, const pool_options& options = pool_options());
+
 public:
+    // Callable and args are forwarded down to stored task.
+    // Stored as decayed copies (like std::thread): rvalues are moved,
+    // lvalues are copied once. Move-only types are accepted
+
     template<typename Callable, typename ...Args,
-        typename return_type = std::result_of_t<Callable(Args...)>,
-        typename Signature = return_type(Args...)>
+        typename return_type = task_result_t<Callable, Args...>,
+        typename Signature = return_type(std::decay_t<Args>...)>
     std::future<return_type>
-    post_waitable(Callable func, Args ...args) {
+    post_waitable(Callable&& func, Args&& ...args) {
         // Check validity of io_service state before proceeding 
         M_check_validity();
 
-        std::packaged_task<Signature> new_task(func);
+        std::packaged_task<Signature> new_task(std::forward<Callable>(func));
         // obtain future of task
         std::future<return_type> fut(new_task.get_future());
 
-        M_post_task(std::move(new_task), args...);
+        M_post_task(nullptr, std::move(new_task), std::forward<Args>(args)...);
 
         return fut;
     }
 
+    // Label names task in trace. Ignored, unless tracing is enabled
     template<typename Callable, typename ...Args,
-        typename return_type = std::result_of_t<Callable(Args...)>,
-        typename Signature = return_type(Args...)>
+        typename return_type = task_result_t<Callable, Args...>,
+        typename Signature = return_type(std::decay_t<Args>...)>
     std::future<return_type>
-    dispatch_waitable(Callable func, Args ...args) {
+    post_waitable(task_label label, Callable&& func, Args&& ...args) {
+        // Check validity of io_service state before proceeding 
+        M_check_validity();
+
+        std::packaged_task<Signature> new_task(std::forward<Callable>(func));
+        std::future<return_type> fut(new_task.get_future());
+
+        M_post_task(label.name, std::move(new_task), std::forward<Args>(args)...);
+
+        return fut;
+    }
+
+    template<typename Callable, typename ...Args,
+        typename return_type = task_result_t<Callable, Args...>,
+        typename Signature = return_type(std::decay_t<Args>...)>
+    std::future<return_type>
+    dispatch_waitable(Callable&& func, Args&& ...args) {
         std::future<return_type> fut_res;
 
         if( M_is_in_pool() ) {
             /*if this_thread is among m_thread_pool, execute input task immediately*/
-            // func(args...);
-            std::packaged_task<Signature> task(func);
+            std::packaged_task<Signature> task(std::forward<Callable>(func));
             fut_res = task.get_future();
             // No need to create task_type, invoke packaged_task directly
-            task(args...);
+            task(std::forward<Args>(args)...);
+            M_count(&detail::worker_counters::tasks_dispatched, 1);
         } else {
-            fut_res = post_waitable(func, args...);
+            fut_res = post_waitable(
+                std::forward<Callable>(func), std::forward<Args>(args)...);
         }
 
         return fut_res;
     }
 
 public:
-    // Post/Dispatch tasks without future
+    // Post/Dispatch tasks with future of this service (see future.hpp),
+    // instead of std::future. Result can be handed to continuation
+    // by then() or combinators, so that no thread blocks in get()
 
     template<typename Callable, typename ...Args,
-        typename return_type = std::result_of_t<Callable(Args...)>,
-        typename Signature = return_type(Args...)>
-    void
-    post(Callable func, Args ...args) {
+        typename return_type = task_result_t<Callable, Args...>>
+    future<return_type>
+    post_async(Callable&& func, Args&& ...args) {
         // Check validity of io_service state before proceeding 
         M_check_validity();
 
-        std::packaged_task<Signature> new_task(func);
+        promise<return_type> prom(*this);
+        future<return_type> fut(prom.get_future());
+
+        M_push_task(
+            task_type(
+                [prom = std::move(prom),
+                 func = S_decay_copy(std::forward<Callable>(func))]
+                (auto&& ...stored_args) mutable {
+                    detail::fulfill(prom,
+                        [&func, &stored_args...] () -> return_type {
+                            return std::invoke(std::move(func),
+                                std::forward<decltype(stored_args)>(stored_args)...);
+                        });
+                },
+                std::forward<Args>(args)...));
 
-        M_post_task(std::move(new_task), args...);
+        return fut;
     }
 
     template<typename Callable, typename ...Args,
-        typename return_type = std::result_of_t<Callable(Args...)>,
-        typename Signature = return_type(Args...)>
+        typename return_type = task_result_t<Callable, Args...>>
+    future<return_type>
+    dispatch_async(Callable&& func, Args&& ...args) {
+        if(!M_is_in_pool())
+            return post_async(
+                std::forward<Callable>(func), std::forward<Args>(args)...);
+
+        /*if this_thread is among m_thread_pool, execute input task immediately*/
+        promise<return_type> prom(*this);
+        future<return_type> fut(prom.get_future());
+        detail::fulfill(prom,
+            [&func, &args...] () -> return_type {
+                return std::invoke(
+                    S_decay_copy(std::forward<Callable>(func)),
+                    S_decay_copy(std::forward<Args>(args))...);
+            });
+        M_count(&detail::worker_counters::tasks_dispatched, 1);
+
+        return fut;
+    }
+
+public:
+    // Post/Dispatch tasks without future.
+    // Callable is stored in task directly, without packaged_task.
+    // Escaped exception is handled by service_options::on_task_exception
+
+    template<typename Callable, typename ...Args>
     void
-    dispatch(Callable func, Args ...args) {
+    post(Callable&& func, Args&& ...args) {
+        // Check validity of io_service state before proceeding 
+        M_check_validity();
+
+        M_push_task(
+            task_type(std::forward<Callable>(func), std::forward<Args>(args)...));
+    }
+
+    // Label names task in trace. Ignored, unless tracing is enabled
+    template<typename Callable, typename ...Args>
+    void
+    post(task_label label, Callable&& func, Args&& ...args) {
+        // Check validity of io_service state before proceeding 
+        M_check_validity();
+
+        M_push_task(
+            task_type(std::forward<Callable>(func), std::forward<Args>(args)...),
+            label.name);
+    }
+
+    template<typename Callable, typename ...Args>
+    void
+    dispatch(Callable&& func, Args&& ...args) {
         if( M_is_in_pool() ) {
             /*if this_thread is among m_thread_pool, execute input task immediately*/
-            // func(args...);
-            std::packaged_task<Signature> task(func);
-            // No need to create task_type, invoke packaged_task directly
-            task(args...);
+            // No need to create task_type, invoke callable directly.
+            // Args are passed as if they were stored in task
+            M_count(&detail::worker_counters::tasks_dispatched, 1);
+            try {
+                std::invoke(
+                    S_decay_copy(std::forward<Callable>(func)),
+                    S_decay_copy(std::forward<Args>(args))...);
+            } catch(...) {
+                M_handle_task_exception(std::current_exception());
+            }
         } else {
-            post(func, args...);
+            post(std::forward<Callable>(func), std::forward<Args>(args)...);
+        }
+    }
+
+public:
+    // Post task with priority. Workers take high ones first,
+    // then normal ones (post() without priority), then low ones.
+    // Level, passed over for longer than service_options::priority_aging,
+    // gets next task. Time spent in queue is recorded per level.
+    // Tasks of post() count as normal ones, once any task is posted
+    // with high or low priority. Until then, they are not timed.
+    // Task, already taken by worker, is not preempted
+
+    template<typename Callable, typename ...Args>
+    void
+    post(task_priority priority, Callable&& func, Args&& ...args) {
+        // Check validity of io_service state before proceeding 
+        M_check_validity();
+
+        M_push_task(priority,
+            task_type(std::forward<Callable>(func), std::forward<Args>(args)...));
+    }
+
+
+public:
+    // Post batch of callables (without args) at once.
+    // Tasks are linked into queue under single lock,
+    // and no more workers are woken than tasks posted.
+    // Elements are copied, unless iterators yield rvalues (std::move_iterator)
+
+    template<typename InputIt>
+    void
+    post_bulk(InputIt first, InputIt last) {
+        // Check validity of io_service state before proceeding 
+        M_check_validity();
+
+        M_push_task_bulk(first, last);
+    }
+
+    template<typename Range>
+    void
+    post_bulk(Range&& range)
+    { post_bulk(std::begin(range), std::end(range)); }
+
+    template<typename InputIt,
+        typename return_type =
+            task_result_t<typename std::iterator_traits<InputIt>::reference>,
+        typename Signature = return_type()>
+    std::vector<std::future<return_type>>
+    post_bulk_waitable(InputIt first, InputIt last) {
+        // Check validity of io_service state before proceeding 
+        M_check_validity();
+
+        std::vector<std::packaged_task<Signature>> tasks;
+        std::vector<std::future<return_type>> futs;
+        for(; first != last; ++first) {
+            tasks.emplace_back(*first);
+            futs.push_back(tasks.back().get_future());
         }
+
+        M_push_task_bulk(
+            std::make_move_iterator(tasks.begin()),
+            std::make_move_iterator(tasks.end()));
+
+        return futs;
     }
 
+    template<typename Range>
+    auto
+    post_bulk_waitable(Range&& range)
+    { return post_bulk_waitable(std::begin(range), std::end(range)); }
+
+public:
+    // Timers. Task is posted once deadline is reached,
+    // and is handled like one of post().
+    // Deadline is rounded up to service_options::timer_resolution
+
+    template<typename Callable, typename ...Args>
+    timer_handle
+    post_at(timer_clock::time_point deadline, Callable&& func, Args&& ...args) {
+        // Check validity of io_service state before proceeding 
+        M_check_validity();
+
+        std::shared_ptr<detail::timer_state> state =
+            std::make_shared<detail::timer_state>();
+        state->task =
+            task_type(std::forward<Callable>(func), std::forward<Args>(args)...);
+        state->deadline = deadline;
+
+        return M_schedule_timer(std::move(state));
+    }
+
+    template<typename Rep, typename Period, typename Callable, typename ...Args>
+    timer_handle
+    post_after(
+        const std::chrono::duration<Rep, Period>& delay,
+        Callable&& func, Args&& ...args
+    ) {
+        return post_at(
+            S_deadline_after(delay),
+            std::forward<Callable>(func), std::forward<Args>(args)...);
+    }
+
+    // Task is posted every period, until timer is cancelled.
+    // Next run is scheduled when previous one ends, so runs do not overlap.
+    // Missed runs are skipped. Callable and args have to be copyable,
+    // args are passed as lvalues (like std::bind)
+    template<typename Rep, typename Period, typename Callable, typename ...Args>
+    timer_handle
+    post_every(
+        const std::chrono::duration<Rep, Period>& period,
+        Callable&& func, Args&& ...args
+    ) {
+        // Check validity of io_service state before proceeding 
+        M_check_validity();
+
+        if(period <= std::chrono::duration<Rep, Period>::zero())
+            throw std::invalid_argument("Timer period must be positive");
+
+        std::shared_ptr<detail::timer_state> state =
+            std::make_shared<detail::timer_state>();
+        state->callback =
+            [func = S_decay_copy(std::forward<Callable>(func)),
+             ...args = S_decay_copy(std::forward<Args>(args))] () mutable {
+                std::invoke(func, args...);
+            };
+        state->period = std::chrono::ceil<timer_clock::duration>(period);
+        state->deadline = timer_clock::now() + state->period;
+
+        return M_schedule_timer(std::move(state));
+    }
+
+public:
+    // Coroutines. Frames are resumed by run() directly, as tasks.
+    // Coroutine, whose resumption is dropped by stop(), is resumed
+    // with service_stopped_error instead, so that its frames unwind
+
+    template<typename T = void>
+    using task = ::io_service::task<T>;
+
+    class schedule_awaiter {
+    private:
+        struct resumer {
+            std::coroutine_handle<> handle;
+            bool* is_dropped;
+
+            resumer(std::coroutine_handle<> in_handle, bool* in_is_dropped)
+                : handle(in_handle)
+                , is_dropped(in_is_dropped)
+            {}
+
+            resumer(resumer&& other) noexcept
+                : handle(std::exchange(other.handle, nullptr))
+                , is_dropped(other.is_dropped)
+            {}
+
+            ~resumer() {
+                if(!handle)
+                    return;
+
+                // Push has failed. Exception resumes coroutine instead
+                if(handle.address() == S_pushed_frame())
+                    return;
+
+                *is_dropped = true;
+                std::exchange(handle, nullptr).resume();
+            }
+
+            void operator()()
+            { std::exchange(handle, nullptr).resume(); }
+
+            // Frame of coroutine, whose resumer this thread pushes
+            static void*& S_pushed_frame() {
+                static thread_local void* frame = nullptr;
+                return frame;
+            }
+        };
+
+        io_service& m_serv;
+        bool m_is_dropped;
+
+    public:
+        explicit schedule_awaiter(io_service& serv)
+            : m_serv(serv)
+            , m_is_dropped(false)
+        {}
+
+    public:
+        // Coroutine is always queued, even if it runs on worker already
+        bool await_ready() const noexcept
+        { return false; }
+
+        void await_suspend(std::coroutine_handle<> awaiting) {
+            m_serv.M_check_validity();
+
+            // Awaiter is not touched after push: coroutine might be
+            // resumed by worker already
+            resumer::S_pushed_frame() = awaiting.address();
+            try {
+                m_serv.M_push_task(task_type(resumer(awaiting, &m_is_dropped)));
+            } catch(...) {
+                resumer::S_pushed_frame() = nullptr;
+                throw;
+            }
+            resumer::S_pushed_frame() = nullptr;
+        }
+
+        void await_resume() const {
+            if(m_is_dropped)
+                throw service_stopped_error("Service is stopped");
+        }
+
+    }; // class schedule_awaiter
+
+    // co_await schedule() resumes coroutine on worker of service.
+    // Throws service_stopped_error, if service is stopped
+    schedule_awaiter schedule()
+    { return schedule_awaiter(*this); }
+
+    // Starts coroutine on worker of service, detached from caller.
+    // Exception, escaped from it, is handled by on_task_exception,
+    // as one of post(). Throws service_stopped_error, if service is stopped
+    template<typename T>
+    friend void co_spawn(io_service& serv, task<T> coro);
+
+public:
+    // Descriptor I/O, driven by io_backend inside run().
+    // Backend is chosen by service_options::io_backend.
+    // Handler is called as handler(std::error_code, std::size_t bytes)
+    // from task, posted to the service. Data has to stay valid until then.
+    // End of file is reported as 0 bytes without error
+
+    // Adapts blocking mode of fd to backend. Throws std::system_error
+    descriptor_handle register_descriptor(int fd);
+
+    // Pending operations complete with std::errc::operation_canceled.
+    // Has to be called before fd is closed
+    void deregister_descriptor(const descriptor_handle& handle);
+
+    // Backend in use. Differs from requested one after fallback
+    io_backend_type backend_type() const
+    { return m_io->type(); }
+
+    // Operations on data within buffers are done with registered
+    // (pinned) memory. Replaces buffers registered before. None of them
+    // may be in use by pending operations.
+    // Returns false, if backend does not support it (epoll)
+    bool register_buffers(const std::vector<iovec>& buffers)
+    { return m_io->register_buffers(buffers); }
+
+    template<typename Handler>
+    void
+    async_read_some(
+        const descriptor_handle& handle,
+        void* data, std::size_t size, Handler&& handler
+    ) {
+        M_start_io_op(handle, detail::io_op::read,
+            data, size, -1, std::forward<Handler>(handler));
+    }
+
+    template<typename Handler>
+    void
+    async_write_some(
+        const descriptor_handle& handle,
+        const void* data, std::size_t size, Handler&& handler
+    ) {
+        M_start_io_op(handle, detail::io_op::write,
+            const_cast<void*>(data), size, -1, std::forward<Handler>(handler));
+    }
+
+    // Positional I/O (like pread / pwrite). Does not move file position.
+    // Meant for regular files, which epoll can not wait for:
+    // there they are done right away by initiating thread
+    template<typename Handler>
+    void
+    async_read_at(
+        const descriptor_handle& handle, std::uint64_t offset,
+        void* data, std::size_t size, Handler&& handler
+    ) {
+        M_start_io_op(handle, detail::io_op::read,
+            data, size, S_to_offset(offset), std::forward<Handler>(handler));
+    }
+
+    template<typename Handler>
+    void
+    async_write_at(
+        const descriptor_handle& handle, std::uint64_t offset,
+        const void* data, std::size_t size, Handler&& handler
+    ) {
+        M_start_io_op(handle, detail::io_op::write,
+            const_cast<void*>(data), size, S_to_offset(offset),
+            std::forward<Handler>(handler));
+    }
+
+public:
+    // Snapshot of counters, queue depths and queueing delays.
+    // Counters are kept per worker, and summed up here.
+    // Queueing delay covers tasks, posted with priority only.
+    // Latency histograms are merged here as well, if they are enabled
+    service_stats stats() const;
+
+    // Last events of each worker: post, start and end of tasks.
+    // Empty, unless service_options::trace_buffer_size is set.
+    // Dumped by write_chrome_trace()
+    service_trace trace() const;
+
 public:
     void stop();
 
@@ -135,33 +660,337 @@ public:
 private:
 
     template<typename SignatureT, typename ...Args>
-    void M_post_task(std::packaged_task<SignatureT>&& pack_task, Args... args) {
-        invocable new_task(
-            std::forward<
-                std::packaged_task<SignatureT>>(pack_task),
-            args...);
+    void M_post_task(const char* label,
+        std::packaged_task<SignatureT>&& pack_task, Args&& ...args
+    ) {
+        M_push_task(
+            task_type(std::move(pack_task), std::forward<Args>(args)...), label);
+    }
+
+    template<typename T>
+    static std::decay_t<T> S_decay_copy(T&& val)
+    { return std::forward<T>(val); }
+
+    // Saturates to time_point::max(), instead of overflowing clock
+    template<typename Rep, typename Period>
+    static timer_clock::time_point
+    S_deadline_after(const std::chrono::duration<Rep, Period>& delay) {
+        const timer_clock::time_point now = timer_clock::now();
+        // Compared in long double, so that large delays are not wrapped
+        if(std::chrono::duration<long double, timer_clock::period>(delay)
+            >= timer_clock::time_point::max() - now
+        )
+            return timer_clock::time_point::max();
+
+        return now + std::chrono::ceil<timer_clock::duration>(delay);
+    }
+
+    // Pushes to local queue, if called from within the pool.
+    // Otherwise, to global one
+    void M_push_task(task_type&& task, const char* label = nullptr);
+    void M_push_task(task_priority priority, task_type&& task);
+    // Enqueue time of task. Traces post, if tracing is enabled
+    timer_clock::time_point M_stamp(worker_slot* slot, const char* label);
+
+    template<typename InputIt>
+    void M_push_task_bulk(InputIt first, InputIt last) {
+        typedef std::decay_t<typename std::iterator_traits<InputIt>::reference>
+            value_type;
+
+        // Tasks are measured before they are moved into queue.
+        // Others are constructed by queue, their size is known upfront
+        std::uint64_t num_bytes = 0;
+        if constexpr (
+            std::is_same_v<value_type, task_type> && std::forward_iterator<InputIt>
+        ) {
+            for(InputIt it = first; it != last; ++it) {
+                const task_type& task = *it;
+                num_bytes += task.footprint();
+            }
+        }
+
+        worker_slot* local_slot = M_local_worker_slot();
+        queue_shard& shard = M_local_shard(local_slot);
+        const std::size_t num_pushed =
+            local_slot
+                ? local_slot->local_queue.push_bulk(first, last)
+                : shard.queue.push_bulk(first, last);
+
+        if constexpr (!std::is_same_v<value_type, task_type>)
+            num_bytes = num_pushed * task_type::footprint_of<value_type>();
+        else if constexpr (!std::forward_iterator<InputIt>)
+            num_bytes = num_pushed * sizeof(task_type);
+        M_count_posted(local_slot, num_pushed, num_bytes);
+
+        if(local_slot)
+            M_wake_idle_workers(num_pushed);
+        else if(num_pushed != 0)
+            M_wake_remote_worker(shard);
+        M_interrupt_io();
+    }
+
+    // Wakes idle workers, so that they steal from local queues
+    void M_wake_idle_workers(std::size_t num_tasks);
+    // Wakes up to num_workers blocked on shards, starting from first_shard
+    void M_wake_blocked_workers(std::size_t num_workers, std::size_t first_shard);
+    // Task was pushed into shard, whose node has no idle worker.
+    // Wakes worker of other node, so that it steals task
+    void M_wake_remote_worker(const queue_shard& shard);
+
+    // Shard of slot's node. Shard of current node, if there is no slot
+    queue_shard& M_local_shard(worker_slot* slot) {
+        if(m_shards_num == 1)
+            return m_shards[0];
+
+        return m_shards[
+            slot ? slot->node.load(std::memory_order_relaxed)
+                : m_topology.current_node()];
+    }
+
+    // Counters of slot, or shared ones, if there is no slot
+    void M_count(
+        detail::stat_counter detail::worker_counters::* counter,
+        std::uint64_t num, worker_slot* slot
+    ) {
+        if(slot)
+            (slot->counters.*counter).add_owned(num);
+        else
+            (m_external_counters.*counter).add(num);
+    }
+
+    void M_count(
+        detail::stat_counter detail::worker_counters::* counter, std::uint64_t num
+    ) { M_count(counter, num, M_local_worker_slot()); }
+
+    void M_count_posted(
+        worker_slot* slot, std::uint64_t num_tasks, std::uint64_t num_bytes
+    ) {
+        M_count(&detail::worker_counters::tasks_posted, num_tasks, slot);
+        M_count(&detail::worker_counters::bytes_posted, num_bytes, slot);
+    }
+
+    // Ring of slot, or shared one, if there is no slot.
+    // Prereq: tracing is enabled
+    void M_trace(
+        trace_event_type type, timer_clock::time_point time,
+        timer_clock::time_point enqueued, const char* label, worker_slot* slot
+    ) {
+        const trace_event event{
+            type, S_to_ns(time), static_cast<std::uint64_t>(S_to_ns(enqueued)), label};
+        if(slot)
+            slot->trace->record_owned(event);
+        else
+            m_external_trace->record(event);
+    }
+
+    static std::int64_t S_to_ns(timer_clock::time_point time) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            time.time_since_epoch()).count();
+    }
+
+    // Histogram of slot, or shared one, if there is no slot.
+    // Prereq: histograms are enabled
+    void M_record_latency(
+        detail::latency_recorder detail::task_latency::* recorder,
+        timer_clock::duration dur, worker_slot* slot
+    ) {
+        if(slot)
+            (slot->latency.get()->*recorder).record_owned(dur);
+        else
+            (m_external_latency.get()->*recorder).record(dur);
+    }
 
-        // TODO: in order to reduce std::move, make argument rval ref?
-        // push to global
-        m_global_queue.push(std::move(new_task));
+    template<typename Handler>
+    void M_start_io_op(
+        const descriptor_handle& handle, detail::io_op::op_type type,
+        void* data, std::size_t size, std::int64_t offset, Handler&& handler
+    ) {
+        // Check validity of io_service state before proceeding 
+        M_check_validity();
+
+        M_start_io_op(handle,
+            std::make_unique<detail::io_op_impl<std::decay_t<Handler>>>(
+                type, data, size, offset, std::forward<Handler>(handler)));
     }
 
+    void M_start_io_op(const descriptor_handle& handle, detail::io_op_ptr op);
+
+    // Throws std::invalid_argument, if offset is out of file range
+    static std::int64_t S_to_offset(std::uint64_t offset);
+
+    // Runs single turn of backend, if no other worker runs it.
+    // Returns false, if backend was not run
+    bool M_try_run_io(
+        timer_clock::time_point until = timer_clock::time_point::max());
+    // Submits operations, queued by tasks, if no other worker runs backend
+    void M_flush_io();
+    // Submits and harvests, without waiting. Returns number of completions
+    std::size_t M_poll_io();
+    // Backend might be the only idle worker. Wakes it up for new task
+    void M_interrupt_io();
+    // There are descriptors, but no worker runs backend
+    bool M_needs_io_runner();
+
+    timer_handle M_schedule_timer(std::shared_ptr<detail::timer_state> state);
+    // Posts tasks of expired timers
+    void M_process_timers();
+    void M_run_periodic_timer(const std::shared_ptr<detail::timer_state>& state);
+    void M_rearm_periodic_timer(const std::shared_ptr<detail::timer_state>& state);
+    // Wakes single idle worker, which takes keeper role over for new deadline
+    void M_wake_timer_keeper();
+    // Worker becomes timer keeper, if next deadline is earlier than
+    // one of current keeper, or there is no keeper
+    bool M_try_keep_timers(timer_clock::time_point& out_deadline);
+    // Role is left, unless it was taken over meanwhile
+    void M_leave_timers(timer_clock::time_point deadline);
+    // There are timers, but no idle worker waits for next deadline
+    bool M_needs_timer_keeper();
+
+    // Loop of run() family. Waits for tasks until deadline
+    std::size_t M_run(std::size_t max_tasks, timer_clock::time_point deadline);
+    // Loop of poll() family
+    std::size_t M_poll(std::size_t max_tasks);
+
+    // Applies exception policy to escaped exceptions
+    void M_execute_task(task_type& task);
+    // Records queueing delay and run time of task, or traces it
+    void M_execute_timed_task(task_type& task, worker_slot* slot);
+    void M_handle_task_exception(std::exception_ptr ex_ptr);
+
     bool M_try_fetch_task(task_type& out_task);
+    // Picks level by priority and aging
+    bool M_try_fetch_by_priority(task_type& out_task);
+    // From local / others / global queues. Records delay of normal level
+    bool M_try_fetch_normal_task(task_type& out_task);
+    bool M_try_pop_normal_task(task_type& out_task);
+    void M_record_normal_delay(const task_type& task);
+    // Victims of thief's node only, if local_node. Otherwise, of other nodes
+    bool M_try_steal_task(
+        task_type& out_task, worker_slot* thief_slot, bool local_node = true);
+    bool M_has_stealable_task();
+    bool M_has_remote_task(const queue_shard& local_shard);
+    // Cheap checks, without taking locks. Might give false positives
+    bool M_has_pending_task();
+    bool M_has_normal_task();
+    bool M_has_lane_task();
+
+    // Polls queues for a while, as configured by idle_strategy.
+    // Returns false, if nothing was fetched or worker was stopped
+    bool M_spin_for_task(task_type& out_task);
 
     // Returns true if task was fetched
-    // Otherwise, predicate has disrupted it
+    // Otherwise, predicate has disrupted it, or until was reached.
+    // Single idle worker waits until next timer deadline,
+    // others wait for tasks only
     template<typename Predicate = false_func>
-    bool M_wait_and_pop_task(task_type& out_task, Predicate pred = Predicate()) {
-        return m_global_queue.wait_and_pop(out_task, pred);
+    bool M_wait_and_pop_task(
+        task_type& out_task, Predicate pred = Predicate(),
+        timer_clock::time_point until = timer_clock::time_point::max()
+    ) {
+        worker_slot* local_slot = M_local_worker_slot();
+        queue_shard& shard = M_local_shard(local_slot);
+
+        // Popped tasks are not lost to allocation of buffer
+        if(local_slot && m_options.fetch_batch_size > 1)
+            local_slot->fetch_buffer.reserve(m_options.fetch_batch_size);
+
+        // Both before predicate is checked, so that pushes into other
+        // shards either are seen by it, or see this worker idle
+        ++m_idle_workers;
+        ++shard.idle_workers;
+
+        timer_clock::time_point keeper_deadline;
+        const bool is_timer_keeper = M_try_keep_timers(keeper_deadline);
+        const timer_clock::time_point deadline =
+            is_timer_keeper ? std::min(keeper_deadline, until) : until;
+
+        // Deadline earlier than keeper's one, or timers without keeper,
+        // let woken worker take role over
+        auto is_interrupted =
+            [this, &pred, &shard] () {
+                return pred() || M_needs_io_runner()
+                    || M_has_remote_task(shard) || M_needs_timer_keeper();
+            };
+
+        bool is_fetched = false;
+        if(local_slot && m_options.fetch_batch_size > 1) {
+            shard.queue.wait_and_pop_n_until(
+                std::back_inserter(local_slot->fetch_buffer),
+                m_options.fetch_batch_size, deadline, is_interrupted);
+            is_fetched = M_take_fetched_batch(local_slot, out_task);
+        } else {
+            is_fetched =
+                shard.queue.wait_and_pop_until(out_task, deadline, is_interrupted);
+        }
+        --shard.idle_workers;
+        --m_idle_workers;
+        M_count(&detail::worker_counters::wakeups, 1, local_slot);
+        if(is_fetched)
+            M_record_normal_delay(out_task);
+
+        if(is_timer_keeper) {
+            M_leave_timers(keeper_deadline);
+            // Leaves to execute task. Hand timers over to other idle worker
+            if(is_fetched && M_needs_timer_keeper() && m_idle_workers > 0)
+                M_wake_blocked_workers(
+                    1, static_cast<std::size_t>(&shard - m_shards.get()));
+        }
+
+        return is_fetched;
     }
 
+    // From shard of worker's node
+    bool M_try_pop_global_task(task_type& out_task, worker_slot* local_slot);
+    // From shards of other nodes
+    bool M_try_pop_remote_task(task_type& out_task, const queue_shard& local_shard);
+    // From local queues and shards of other nodes
+    bool M_try_fetch_remote_task(task_type& out_task, worker_slot* local_slot);
+    // Hands first task of fetch_buffer out, moves rest into local queue
+    bool M_take_fetched_batch(worker_slot* local_slot, task_type& out_task);
+
+    worker_slot* M_acquire_worker_slot();
+    worker_slot* M_local_worker_slot();
+
     bool M_is_in_pool();
 
     void M_check_validity() noexcept(false);
     void M_clear_tasks();
+    void M_join_pool();
 
 }; // class io_service
 
+
+namespace detail {
+
+template<typename T>
+detached_task spawn_task(io_service& serv, task<T> coro) {
+    std::exception_ptr ex_ptr;
+    try {
+        co_await serv.schedule();
+        co_await std::move(coro);
+    } catch(const service_stopped_error&) {
+        /*dropped by stop()*/
+    } catch(...) {
+        ex_ptr = std::current_exception();
+    }
+
+    if(!ex_ptr)
+        co_return;
+
+    // Handled by worker, which runs it
+    try {
+        serv.post([ex_ptr] () { std::rethrow_exception(ex_ptr); });
+    } catch(const service_stopped_error&) {}
+}
+
+} // namespace detail
+
+template<typename T>
+void co_spawn(io_service& serv, task<T> coro) {
+    serv.M_check_validity();
+    detail::spawn_task(serv, std::move(coro));
+}
+
 } // namespace io_service
 
 #endif
@@ -0,0 +1,138 @@
+#ifndef ASIO_LATENCY_HISTOGRAM_HPP
+#define ASIO_LATENCY_HISTOGRAM_HPP
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace io_service {
+
+namespace detail {
+class latency_recorder;
+} // namespace detail
+
+// Histogram of durations with log-scaled buckets, like HdrHistogram.
+// Each power of two is split into 16 linear sub-buckets, so that
+// reported values are within 1/16 of recorded ones.
+// Covers up to ~68 s, longer durations fall into last bucket
+class latency_histogram {
+public:
+    static constexpr unsigned sub_bucket_bits = 4;
+    static constexpr std::size_t sub_bucket_count = std::size_t(1) << sub_bucket_bits;
+    // Highest power of two with buckets of its own
+    static constexpr unsigned max_exponent = 35;
+    static constexpr std::size_t bucket_count =
+        (max_exponent - sub_bucket_bits + 2) * sub_bucket_count;
+
+private:
+    std::array<std::uint64_t, bucket_count> m_buckets;
+    std::uint64_t m_count;
+    std::uint64_t m_total_ns;
+    std::uint64_t m_max_ns;
+
+    friend class detail::latency_recorder;
+
+public:
+    latency_histogram()
+        : m_buckets()
+        , m_count(0)
+        , m_total_ns(0)
+        , m_max_ns(0)
+    {}
+
+public:
+    void record(std::chrono::nanoseconds dur) {
+        const std::uint64_t ns = S_to_ns(dur);
+        ++m_buckets[bucket_index(ns)];
+        ++m_count;
+        m_total_ns += ns;
+        m_max_ns = std::max(m_max_ns, ns);
+    }
+
+    void merge(const latency_histogram& other) {
+        for(std::size_t i = 0; i < bucket_count; ++i)
+            m_buckets[i] += other.m_buckets[i];
+        m_count += other.m_count;
+        m_total_ns += other.m_total_ns;
+        m_max_ns = std::max(m_max_ns, other.m_max_ns);
+    }
+
+    std::uint64_t count() const
+    { return m_count; }
+
+    // Sum of durations
+    std::chrono::nanoseconds total() const
+    { return std::chrono::nanoseconds(m_total_ns); }
+
+    std::chrono::nanoseconds max() const
+    { return std::chrono::nanoseconds(m_max_ns); }
+
+    std::chrono::nanoseconds mean() const {
+        return std::chrono::nanoseconds(
+            m_count == 0 ? 0 : m_total_ns / m_count);
+    }
+
+    // Value, which percent of durations do not exceed. Percent is within
+    // [0, 100]. Upper bound of bucket is reported, capped by max()
+    std::chrono::nanoseconds percentile(double percent) const {
+        if(m_count == 0)
+            return std::chrono::nanoseconds::zero();
+
+        const double clamped = std::clamp(percent, 0.0, 100.0);
+        const std::uint64_t rank = std::max<std::uint64_t>(1,
+            static_cast<std::uint64_t>(std::ceil(clamped / 100.0 * m_count)));
+
+        std::uint64_t seen = 0;
+        for(std::size_t i = 0; i < bucket_count; ++i) {
+            seen += m_buckets[i];
+            if(seen >= rank)
+                return std::chrono::nanoseconds(
+                    std::min(bucket_upper_bound(i), m_max_ns));
+        }
+
+        return max();
+    }
+
+    // Durations, which fell into bucket
+    std::uint64_t count_at(std::size_t index) const
+    { return m_buckets[index]; }
+
+public:
+    static constexpr std::size_t bucket_index(std::uint64_t ns) {
+        if(ns < sub_bucket_count)
+            return static_cast<std::size_t>(ns);
+
+        const unsigned exponent = std::min<unsigned>(
+            max_exponent, static_cast<unsigned>(std::bit_width(ns)) - 1);
+        const unsigned shift = exponent - sub_bucket_bits;
+        const std::uint64_t sub_bucket =
+            std::min<std::uint64_t>(ns >> shift, 2 * sub_bucket_count - 1);
+
+        return (shift + 1) * sub_bucket_count + sub_bucket - sub_bucket_count;
+    }
+
+    // Largest value, which falls into bucket
+    static constexpr std::uint64_t bucket_upper_bound(std::size_t index) {
+        if(index < sub_bucket_count)
+            return index;
+
+        const unsigned shift =
+            static_cast<unsigned>(index / sub_bucket_count) - 1;
+        const std::uint64_t sub_bucket = index % sub_bucket_count + sub_bucket_count;
+        return ((sub_bucket + 1) << shift) - 1;
+    }
+
+// Impl funcs
+private:
+    static std::uint64_t S_to_ns(std::chrono::nanoseconds dur)
+    { return dur.count() > 0 ? static_cast<std::uint64_t>(dur.count()) : 0; }
+
+}; // class latency_histogram
+
+} // namespace io_service
+
+#endif // ASIO_LATENCY_HISTOGRAM_HPP
@@ -0,0 +1,386 @@
+#ifndef ASIO_MPMC_BOUNDED_QUEUE_HPP
+#define ASIO_MPMC_BOUNDED_QUEUE_HPP
+
+#include "helgrind_annotations.hpp"
+
+#include "mutex.hpp"
+#include "condition_variable.hpp"
+#include "lock_guard.hpp"
+#include "unique_lock.hpp"
+#include "false_func.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <new> // placement new
+#include <thread> // std::this_thread::yield
+
+namespace io_service {
+
+// Capacity of queue, constructed by default
+#ifndef IO_SERVICE_MPMC_QUEUE_CAPACITY
+#define IO_SERVICE_MPMC_QUEUE_CAPACITY (1 << 14)
+#endif
+
+// Lock-free bounded multi-producer multi-consumer queue.
+// Ring of slots with per-slot sequence numbers (D. Vyukov's design).
+// Push/pop never take a lock. Mutex is used only to park consumers
+// on an empty queue, and is not touched while nobody is parked.
+// Has the same interface as threadsafe_queue
+template<typename T>
+class mpmc_bounded_queue {
+private:
+    static const std::size_t cache_line_size = 64;
+
+    struct slot {
+        // pos      - free for producer at pos
+        // pos + 1  - holds data for consumer at pos
+        std::atomic<std::size_t> sequence;
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        T* data()
+        { return reinterpret_cast<T*>(storage); }
+    };
+
+private:
+    std::unique_ptr<slot[]> m_buffer;
+    std::size_t m_buffer_mask;
+
+    alignas(cache_line_size) std::atomic<std::size_t> m_enqueue_pos;
+    alignas(cache_line_size) std::atomic<std::size_t> m_dequeue_pos;
+
+    // Parking of consumers
+    alignas(cache_line_size) std::atomic<int> m_waiters;
+    // Waiter is notified, but has not looked into queue yet.
+    // Pushes meanwhile do not wake others. Woken one passes wake up on
+    std::atomic<bool> m_waking;
+    concurrency::mutex m_wait_mutex;
+    concurrency::condition_variable m_data_cv;
+
+private:
+    mpmc_bounded_queue(const mpmc_bounded_queue& other) = delete;
+    mpmc_bounded_queue& operator=(const mpmc_bounded_queue& other) = delete;
+
+    // Slots are referenced by concurrent producers/consumers
+    mpmc_bounded_queue(mpmc_bounded_queue&& other) = delete;
+    mpmc_bounded_queue& operator=(mpmc_bounded_queue&& other) = delete;
+
+public:
+    // Capacity is rounded up to power of 2
+    explicit mpmc_bounded_queue(
+        std::size_t capacity = IO_SERVICE_MPMC_QUEUE_CAPACITY
+    )
+        : m_buffer()
+        , m_buffer_mask(S_round_up_pow2(capacity) - 1)
+        , m_enqueue_pos(0)
+        , m_dequeue_pos(0)
+        , m_waiters(0)
+        , m_waking(false)
+    {
+        m_buffer = std::make_unique<slot[]>(m_buffer_mask + 1);
+        for(std::size_t i = 0; i <= m_buffer_mask; ++i)
+            m_buffer[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    ~mpmc_bounded_queue()
+    { clear(); }
+
+public:
+    // Returns false if queue is full
+    bool try_push(T& in_data) {
+        if(!M_try_enqueue(in_data))
+            return false;
+
+        M_notify_one();
+        return true;
+    }
+
+    // Blocks (yielding) while queue is full
+    void push(T in_data) {
+        while(!try_push(in_data))
+            std::this_thread::yield();
+    }
+
+    // Pushes elements, constructed from [first, last).
+    // Wakes no more waiters than elements pushed.
+    // Blocks (yielding) while queue is full.
+    // Returns number of elements pushed
+    template<typename InputIt>
+    std::size_t push_bulk(InputIt first, InputIt last) {
+        std::size_t num_pushed = 0;
+        for(; first != last; ++first, ++num_pushed) {
+            T in_data(*first);
+            while(!M_try_enqueue(in_data)) {
+                // Let consumers drain what is pushed so far
+                M_notify_waiters(num_pushed);
+                std::this_thread::yield();
+            }
+        }
+
+        M_notify_waiters(num_pushed);
+        return num_pushed;
+    }
+
+public:
+    bool try_pop(T& out_data) {
+        slot* cell;
+        std::size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        for(;;) {
+            cell = &m_buffer[pos & m_buffer_mask];
+            std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t diff =
+                static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+
+            if(diff == 0) {
+                if(m_dequeue_pos.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if(diff < 0) {
+                return false; /*empty*/
+            } else {
+                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        out_data = std::move(*cell->data());
+        cell->data()->~T();
+        // Slot is free for producer of next lap
+        cell->sequence.store(pos + m_buffer_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    template<typename Predicate = false_func>
+    bool wait_and_pop(T& out_data, Predicate pred = Predicate()) {
+        return wait_and_pop_until(
+            out_data, std::chrono::steady_clock::time_point::max(), pred);
+    }
+
+    // Same as wait_and_pop, but gives up at deadline
+    template<typename Clock, typename Duration, typename Predicate = false_func>
+    bool wait_and_pop_until(
+        T& out_data,
+        const std::chrono::time_point<Clock, Duration>& deadline,
+        Predicate pred = Predicate()
+    ) {
+        if(!M_wait_and_pop(out_data, deadline, pred))
+            return false;
+
+        M_pass_wake_on();
+        return true;
+    }
+
+    // Pops up to max_elems into out.
+    // Returns number of elements popped
+    template<typename OutputIt>
+    std::size_t try_pop_n(OutputIt out, std::size_t max_elems) {
+        std::size_t num_popped = 0;
+        T out_data;
+        for(; num_popped < max_elems && try_pop(out_data); ++num_popped) {
+            *out = std::move(out_data);
+            ++out;
+        }
+
+        return num_popped;
+    }
+
+    // Blocks until there is at least one element, then pops up to max_elems.
+    // Returns 0, if predicate has disrupted waiting
+    template<typename OutputIt, typename Predicate = false_func>
+    std::size_t wait_and_pop_n(
+        OutputIt out, std::size_t max_elems, Predicate pred = Predicate()
+    ) {
+        return wait_and_pop_n_until(
+            out, max_elems, std::chrono::steady_clock::time_point::max(), pred);
+    }
+
+    // Same as wait_and_pop_n, but gives up at deadline
+    template<
+        typename OutputIt, typename Clock, typename Duration,
+        typename Predicate = false_func>
+    std::size_t wait_and_pop_n_until(
+        OutputIt out, std::size_t max_elems,
+        const std::chrono::time_point<Clock, Duration>& deadline,
+        Predicate pred = Predicate()
+    ) {
+        if(max_elems == 0)
+            return 0;
+
+        T out_data;
+        if(!M_wait_and_pop(out_data, deadline, pred))
+            return 0;
+
+        *out = std::move(out_data);
+        ++out;
+        const std::size_t num_popped = 1 + try_pop_n(out, max_elems - 1);
+        M_pass_wake_on();
+        return num_popped;
+    }
+
+public:
+    // Hint only. Might be outdated by the time it is used
+    bool empty() const {
+        std::size_t pos = m_dequeue_pos.load(std::memory_order_acquire);
+        const slot& cell = m_buffer[pos & m_buffer_mask];
+        return cell.sequence.load(std::memory_order_acquire) != pos + 1;
+    }
+
+    // Hint only. Might be outdated by the time it is used
+    std::size_t size() const {
+        std::size_t dequeue_pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        std::size_t enqueue_pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+    }
+
+    std::size_t capacity() const
+    { return m_buffer_mask + 1; }
+
+    // External signal to unblock threads waiting for data
+    void signal() {
+        using namespace concurrency;
+        lock_guard<mutex> lk(m_wait_mutex);
+        m_data_cv.notify_all();
+    }
+
+    // Wake up to num_waiters, so that they re-evaluate their predicate
+    void wake(std::size_t num_waiters = 1) {
+        using namespace concurrency;
+        lock_guard<mutex> lk(m_wait_mutex);
+        for(std::size_t i = 0; i < num_waiters; ++i)
+            m_data_cv.notify_one();
+    }
+
+    // Drops queued elements
+    void clear()
+    { clear([] (const T&) {}); }
+
+    // Same as clear, but calls on_dropped(const T&) for each element
+    template<typename Func>
+    void clear(Func on_dropped) {
+        T sink;
+        while(try_pop(sink)) {
+            on_dropped(static_cast<const T&>(sink));
+            sink = T();
+        }
+    }
+
+// Impl funcs
+private:
+    // Publishes element. Waiters are not notified
+    bool M_try_enqueue(T& in_data) {
+        slot* cell;
+        std::size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        for(;;) {
+            cell = &m_buffer[pos & m_buffer_mask];
+            std::size_t seq = cell->sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t diff =
+                static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+
+            if(diff == 0) {
+                if(m_enqueue_pos.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            } else if(diff < 0) {
+                return false; /*full*/
+            } else {
+                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        ::new (static_cast<void*>(cell->data())) T(std::move(in_data));
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // time_point::max() waits without deadline
+    template<typename Clock, typename Duration, typename Predicate>
+    bool M_wait_and_pop(
+        T& out_data,
+        const std::chrono::time_point<Clock, Duration>& deadline,
+        Predicate& pred
+    ) {
+        using namespace concurrency;
+
+        const bool has_deadline =
+            deadline != std::chrono::time_point<Clock, Duration>::max();
+
+        for(;;) {
+            // if predicate is true, no data is fetched
+            if(pred())
+                return false;
+
+            if(try_pop(out_data))
+                return true;
+
+            if(has_deadline && Clock::now() >= deadline)
+                return false;
+
+            unique_lock<mutex> lk(m_wait_mutex);
+            ++m_waiters;
+            auto is_ready =
+                [this, &pred] () {
+                    // Next push may wake another waiter.
+                    // Pairs with fence in M_notify_one() / M_notify_waiters()
+                    m_waking = false;
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    return !empty() || pred();
+                };
+
+            if(has_deadline)
+                m_data_cv.wait_until(lk, deadline, is_ready);
+            else
+                m_data_cv.wait(lk, is_ready);
+            --m_waiters;
+        }
+    }
+
+    // Wakes single waiter, unless there is none, or one is being woken
+    void M_notify_one() {
+        // Either waiter sees published data, or push sees the waiter
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(m_waiters.load(std::memory_order_relaxed) == 0)
+            return;
+
+        if(m_waking.exchange(true))
+            return; /*woken waiter will take data, or pass wake up on*/
+
+        using namespace concurrency;
+        lock_guard<mutex> lk(m_wait_mutex);
+        m_data_cv.notify_one();
+    }
+
+    // Wakes up to num_elems waiters
+    void M_notify_waiters(std::size_t num_elems) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int num_waiters = m_waiters.load(std::memory_order_relaxed);
+        if(num_waiters == 0 || num_elems == 0)
+            return;
+
+        if(static_cast<std::size_t>(num_waiters) > num_elems)
+            num_waiters = static_cast<int>(num_elems);
+
+        m_waking = true;
+        using namespace concurrency;
+        lock_guard<mutex> lk(m_wait_mutex);
+        for(int i = 0; i < num_waiters; ++i)
+            m_data_cv.notify_one();
+    }
+
+    // Woken waiter leaves rest of data to next one
+    void M_pass_wake_on() {
+        if(!empty())
+            M_notify_one();
+    }
+
+    static std::size_t S_round_up_pow2(std::size_t val) {
+        std::size_t pow2 = 2;
+        while(pow2 < val)
+            pow2 <<= 1;
+        return pow2;
+    }
+
+}; // class mpmc_bounded_queue
+
+} // namespace io_service
+
+#endif // ASIO_MPMC_BOUNDED_QUEUE_HPP
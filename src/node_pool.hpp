@@ -0,0 +1,223 @@
+#ifndef ASIO_NODE_POOL_HPP
+#define ASIO_NODE_POOL_HPP
+
+#include "mutex.hpp"
+#include "lock_guard.hpp"
+#include "numa_topology.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <new> // operator new, placement new
+
+namespace io_service {
+
+namespace detail {
+
+// Intrusive list of free blocks. Next pointer is kept inside block itself
+struct free_block {
+    free_block* next;
+};
+
+struct free_list {
+    free_block* head;
+    std::size_t count;
+
+    free_list()
+        : head(nullptr)
+        , count(0)
+    {}
+
+    void push(free_block* block) {
+        block->next = head;
+        head = block;
+        ++count;
+    }
+
+    free_block* pop() {
+        free_block* block = head;
+        head = block->next;
+        --count;
+        return block;
+    }
+
+    bool empty() const
+    { return head == nullptr; }
+
+}; // struct free_list
+
+} // namespace detail
+
+
+// Recycles memory of NodeT, so that steady flow of
+// allocations and deallocations does not reach the heap.
+// Each thread keeps small cache of free blocks.
+// Caches exchange blocks in batches through central free list
+// of their NUMA node, so that blocks, touched on one node, are reused
+// there, and threads of other nodes do not contend for the list.
+// Blocks above limits are returned to the heap, which caps memory
+// retained after a burst. Once cache of thread is destroyed, blocks of
+// thread go to the heap directly, so that objects, destroyed later
+// (static or thread_local ones), are still able to release them
+template<typename NodeT>
+class node_pool {
+public:
+    // Max blocks cached by single thread
+    static constexpr std::size_t thread_cache_max = 256;
+    // Blocks moved between thread cache and central list at once
+    static constexpr std::size_t transfer_batch = 64;
+    // Max blocks kept in central list of single node
+    static constexpr std::size_t central_max = 4096;
+
+private:
+    static constexpr std::size_t block_size =
+        sizeof(NodeT) < sizeof(detail::free_block)
+            ? sizeof(detail::free_block) : sizeof(NodeT);
+    static constexpr std::size_t block_align =
+        alignof(NodeT) < alignof(detail::free_block)
+            ? alignof(detail::free_block) : alignof(NodeT);
+
+    struct central_list {
+        concurrency::mutex mutex;
+        detail::free_list blocks;
+
+        ~central_list() {
+            while(!blocks.empty())
+                S_free_block(blocks.pop());
+        }
+    };
+
+    struct thread_cache {
+        detail::free_list blocks;
+        // Node, which thread ran on, when it first used pool
+        std::size_t node;
+
+        thread_cache()
+            : blocks()
+            , node(detail::numa_topology::system().current_node())
+        { S_central(node); /*constructed before, destroyed after cache*/ }
+
+        // Thread exits. Hand blocks over to others
+        ~thread_cache() {
+            S_flush(*this, blocks.count);
+            S_is_cache_destroyed() = true;
+        }
+    };
+
+private:
+    node_pool() = delete;
+
+public:
+    // Returns uninitialized memory for NodeT
+    static void* allocate() {
+        if(S_is_cache_destroyed())
+            return S_new_block();
+
+        thread_cache& cache = S_cache();
+        if(cache.blocks.empty())
+            S_refill(cache);
+
+        if(cache.blocks.empty())
+            return S_new_block();
+
+        return cache.blocks.pop();
+    }
+
+    // Takes memory of already destroyed NodeT
+    static void deallocate(void* ptr) {
+        if(S_is_cache_destroyed()) {
+            S_free_block(static_cast<detail::free_block*>(ptr));
+            return;
+        }
+
+        thread_cache& cache = S_cache();
+        if(cache.blocks.count >= thread_cache_max)
+            S_flush(cache, transfer_batch);
+
+        cache.blocks.push(static_cast<detail::free_block*>(ptr));
+    }
+
+    // Blocks cached by calling thread
+    static std::size_t thread_cached()
+    { return S_is_cache_destroyed() ? 0 : S_cache().blocks.count; }
+
+    // Blocks kept in central free list of calling thread's node
+    static std::size_t central_cached() {
+        using namespace concurrency;
+        central_list& central = S_central(S_cache().node);
+        lock_guard<mutex> lk(central.mutex);
+        return central.blocks.count;
+    }
+
+// Impl funcs
+private:
+    static thread_cache& S_cache() {
+        static thread_local thread_cache cache;
+        return cache;
+    }
+
+    // Trivial, so that it is alive after cache is destroyed
+    static bool& S_is_cache_destroyed() {
+        static thread_local bool is_destroyed = false;
+        return is_destroyed;
+    }
+
+    static central_list& S_central(std::size_t node) {
+        static const std::unique_ptr<central_list[]> centrals(
+            new central_list[detail::numa_topology::system().nodes_num()]);
+        return centrals[node];
+    }
+
+    static void S_refill(thread_cache& cache) {
+        using namespace concurrency;
+        central_list& central = S_central(cache.node);
+        lock_guard<mutex> lk(central.mutex);
+        for(std::size_t i = 0;
+            i < transfer_batch && !central.blocks.empty(); ++i
+        )
+            cache.blocks.push(central.blocks.pop());
+    }
+
+    // Moves num_blocks from cache to central list.
+    // Overflow of central list is returned to the heap
+    static void S_flush(thread_cache& cache, std::size_t num_blocks) {
+        using namespace concurrency;
+        detail::free_list overflow;
+        {
+            central_list& central = S_central(cache.node);
+            lock_guard<mutex> lk(central.mutex);
+            for(std::size_t i = 0;
+                i < num_blocks && !cache.blocks.empty(); ++i
+            ) {
+                if(central.blocks.count < central_max)
+                    central.blocks.push(cache.blocks.pop());
+                else
+                    overflow.push(cache.blocks.pop());
+            }
+        }
+
+        // Free outside of lock
+        while(!overflow.empty())
+            S_free_block(overflow.pop());
+    }
+
+    static void* S_new_block()
+    { return ::operator new(block_size, std::align_val_t(block_align)); }
+
+    static void S_free_block(detail::free_block* block)
+    { ::operator delete(block, std::align_val_t(block_align)); }
+
+}; // class node_pool
+
+
+// Deleter of unique_ptr, returning node memory to node_pool
+template<typename NodeT>
+struct node_pool_deleter {
+    void operator()(NodeT* node) const {
+        node->~NodeT();
+        node_pool<NodeT>::deallocate(node);
+    }
+}; // struct node_pool_deleter
+
+} // namespace io_service
+
+#endif // ASIO_NODE_POOL_HPP
@@ -0,0 +1,163 @@
+#include "numa_topology.hpp"
+#include "pool_thread.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+#include <utility>
+
+#include <sched.h>
+
+namespace io_service {
+
+namespace detail {
+
+namespace {
+
+// CPU ids are bounded by kernel. Guards against garbage in list
+const unsigned max_cpu = 1u << 16;
+
+const char* parse_cpu(const char* first, const char* last, unsigned& cpu) {
+    const std::from_chars_result res = std::from_chars(first, last, cpu);
+    if(res.ec != std::errc() || cpu >= max_cpu)
+        return nullptr;
+
+    return res.ptr;
+}
+
+// Node id out of directory name "node<id>"
+bool parse_node_id(const std::string& name, unsigned& id) {
+    static const std::string prefix = "node";
+    if(name.size() <= prefix.size() || name.compare(0, prefix.size(), prefix) != 0)
+        return false;
+
+    const char* first = name.data() + prefix.size();
+    const char* last = name.data() + name.size();
+    const std::from_chars_result res = std::from_chars(first, last, id);
+    return res.ec == std::errc() && res.ptr == last;
+}
+
+} // namespace
+
+const char* const numa_topology::system_path = "/sys/devices/system/node";
+
+numa_topology::numa_topology()
+    : m_node_ids(1, 0)
+    , m_node_cpus(1)
+    , m_cpu_nodes()
+{}
+
+numa_topology::numa_topology(const std::string& root)
+    : numa_topology()
+{
+    namespace fs = std::filesystem;
+
+    std::vector<std::pair<unsigned, std::vector<unsigned>>> nodes;
+
+    std::error_code ec;
+    for(fs::directory_iterator it(root, ec), end; !ec && it != end; it.increment(ec)) {
+        unsigned id = 0;
+        if(!parse_node_id(it->path().filename().string(), id))
+            continue;
+
+        std::ifstream file(it->path() / "cpulist");
+        std::string list;
+        if(!std::getline(file, list))
+            continue;
+
+        std::vector<unsigned> cpus = parse_cpu_list(list);
+        if(!cpus.empty())
+            nodes.emplace_back(id, std::move(cpus));
+    }
+
+    if(nodes.empty())
+        return;
+
+    std::sort(nodes.begin(), nodes.end());
+
+    m_node_ids.clear();
+    m_node_cpus.clear();
+    for(std::pair<unsigned, std::vector<unsigned>>& node : nodes) {
+        const std::size_t index = m_node_ids.size();
+        for(unsigned cpu : node.second) {
+            if(cpu >= m_cpu_nodes.size())
+                m_cpu_nodes.resize(cpu + 1, 0);
+            m_cpu_nodes[cpu] = index;
+        }
+
+        m_node_ids.push_back(node.first);
+        m_node_cpus.push_back(std::move(node.second));
+    }
+}
+
+const numa_topology& numa_topology::system() {
+    static const numa_topology topology(system_path);
+    return topology;
+}
+
+std::size_t numa_topology::current_node() const {
+    if(nodes_num() == 1)
+        return 0;
+
+    const int cpu = sched_getcpu();
+    return cpu < 0 ? 0 : node_of_cpu(static_cast<unsigned>(cpu));
+}
+
+std::size_t numa_topology::thread_node() const {
+    if(nodes_num() == 1)
+        return 0;
+
+    const std::vector<unsigned> cpus = allowed_cpus();
+    if(cpus.empty())
+        return current_node();
+
+    const std::size_t node = node_of_cpu(cpus.front());
+    for(unsigned cpu : cpus)
+        if(node_of_cpu(cpu) != node)
+            return current_node();
+
+    return node;
+}
+
+std::vector<unsigned> parse_cpu_list(const std::string& list) {
+    std::vector<unsigned> cpus;
+
+    const char* first = list.data();
+    const char* last = list.data() + list.size();
+    // Trailing newline of sysfs
+    while(last != first && (last[-1] == '\n' || last[-1] == ' '))
+        --last;
+
+    while(first != last) {
+        unsigned low = 0;
+        first = parse_cpu(first, last, low);
+        if(!first)
+            return {};
+
+        unsigned high = low;
+        if(first != last && *first == '-') {
+            first = parse_cpu(first + 1, last, high);
+            if(!first || high < low)
+                return {};
+        }
+
+        for(unsigned cpu = low; cpu <= high; ++cpu)
+            cpus.push_back(cpu);
+
+        if(first != last) {
+            if(*first != ',' || first + 1 == last)
+                return {};
+            ++first;
+        }
+    }
+
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return cpus;
+}
+
+} // namespace detail
+
+} // namespace io_service
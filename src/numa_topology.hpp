@@ -0,0 +1,70 @@
+#ifndef ASIO_NUMA_TOPOLOGY_HPP
+#define ASIO_NUMA_TOPOLOGY_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace io_service {
+
+namespace detail {
+
+// NUMA nodes and their CPUs. Nodes are numbered densely from zero,
+// in order of their ids. Nodes without CPUs (memory only) are left out
+class numa_topology {
+public:
+    // Where Linux exposes topology
+    static const char* const system_path;
+
+private:
+    // Id of node, as named by system
+    std::vector<unsigned> m_node_ids;
+    std::vector<std::vector<unsigned>> m_node_cpus;
+    // Node of each CPU, by CPU index
+    std::vector<std::size_t> m_cpu_nodes;
+
+public:
+    // Single node. Every CPU belongs to it
+    numa_topology();
+
+    // Reads node<id>/cpulist under root.
+    // Single node, if there are none, or root can not be read
+    explicit numa_topology(const std::string& root);
+
+public:
+    // Read once, from system_path
+    static const numa_topology& system();
+
+    std::size_t nodes_num() const
+    { return m_node_cpus.size(); }
+
+    unsigned node_id(std::size_t node) const
+    { return m_node_ids[node]; }
+
+    // Empty for single node, made up without topology
+    const std::vector<unsigned>& cpus(std::size_t node) const
+    { return m_node_cpus[node]; }
+
+    // Zero for CPU, which is not listed
+    std::size_t node_of_cpu(unsigned cpu) const {
+        return cpu < m_cpu_nodes.size() ? m_cpu_nodes[cpu] : 0;
+    }
+
+    // Node, which calling thread runs on now
+    std::size_t current_node() const;
+
+    // Node, which calling thread is bound to by its CPU affinity.
+    // If allowed CPUs span several nodes, node it runs on now
+    std::size_t thread_node() const;
+
+}; // class numa_topology
+
+// Parses list of CPUs in format of sysfs: "0-3,8,10-11".
+// Returns empty list, if format is broken
+std::vector<unsigned> parse_cpu_list(const std::string& list);
+
+} // namespace detail
+
+} // namespace io_service
+
+#endif // ASIO_NUMA_TOPOLOGY_HPP
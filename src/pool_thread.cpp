@@ -0,0 +1,150 @@
+#include "pool_thread.hpp"
+#include "numa_topology.hpp"
+#include "service_options.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <system_error>
+
+#include <sched.h>
+
+namespace io_service {
+
+namespace detail {
+
+namespace {
+
+// Linux limit, without terminating null
+const std::size_t max_thread_name = 15;
+
+void* thread_entry(void* arg) {
+    std::unique_ptr<invocable> body(static_cast<invocable*>(arg));
+    // Escaped exception terminates, as it does with std::thread
+    [&body] () noexcept { (*body)(); }();
+    return nullptr;
+}
+
+void throw_on_error(int err, const char* what) {
+    if(err != 0)
+        throw std::system_error(err, std::system_category(), what);
+}
+
+// Destroys attributes on any exit
+struct attr_guard {
+    pthread_attr_t attr;
+
+    attr_guard()
+    { throw_on_error(pthread_attr_init(&attr), "pthread_attr_init"); }
+
+    ~attr_guard()
+    { pthread_attr_destroy(&attr); }
+};
+
+} // namespace
+
+pool_thread::pool_thread(invocable&& body, const std::vector<unsigned>& cpus,
+    const std::string& name, std::size_t stack_size
+)
+    : m_handle()
+    , m_is_joinable(false)
+{
+    attr_guard guard;
+
+    if(stack_size != 0)
+        throw_on_error(
+            pthread_attr_setstacksize(&guard.attr, stack_size),
+            "pthread_attr_setstacksize");
+
+    if(!cpus.empty()) {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        for(unsigned cpu : cpus) {
+            if(cpu >= CPU_SETSIZE)
+                throw std::invalid_argument("CPU index is out of range");
+            CPU_SET(cpu, &cpu_set);
+        }
+
+        throw_on_error(
+            pthread_attr_setaffinity_np(&guard.attr, sizeof(cpu_set), &cpu_set),
+            "pthread_attr_setaffinity_np");
+    }
+
+    std::unique_ptr<invocable> arg = std::make_unique<invocable>(std::move(body));
+    throw_on_error(
+        pthread_create(&m_handle, &guard.attr, &thread_entry, arg.get()),
+        "pthread_create");
+    arg.release(); /*owned by thread now*/
+    m_is_joinable = true;
+
+    // Name is cosmetic. Failure is ignored
+    if(!name.empty())
+        pthread_setname_np(m_handle, name.substr(0, max_thread_name).c_str());
+}
+
+void pool_thread::join() {
+    if(!m_is_joinable)
+        return;
+
+    pthread_join(m_handle, nullptr);
+    m_is_joinable = false;
+}
+
+std::vector<unsigned> allowed_cpus() {
+    std::vector<unsigned> cpus;
+
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    if(sched_getaffinity(0, sizeof(cpu_set), &cpu_set) != 0)
+        return cpus;
+
+    for(unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        if(CPU_ISSET(cpu, &cpu_set))
+            cpus.push_back(cpu);
+
+    return cpus;
+}
+
+} // namespace detail
+
+pool_options pool_options::one_cpu_per_worker(std::size_t num_workers) {
+    pool_options options;
+
+    const std::vector<unsigned> cpus = detail::allowed_cpus();
+    if(cpus.empty())
+        return options;
+
+    for(std::size_t i = 0; i < num_workers; ++i)
+        options.cpu_sets.push_back({cpus[i % cpus.size()]});
+
+    return options;
+}
+
+pool_options pool_options::per_numa_node(std::size_t num_workers) {
+    pool_options options;
+
+    const detail::numa_topology& topology = detail::numa_topology::system();
+    const std::vector<unsigned> allowed = detail::allowed_cpus();
+
+    // Nodes, which process may run on
+    std::vector<std::vector<unsigned>> node_cpus;
+    for(std::size_t node = 0; node < topology.nodes_num(); ++node) {
+        const std::vector<unsigned>& cpus = topology.cpus(node);
+        std::vector<unsigned> usable;
+        std::set_intersection(cpus.begin(), cpus.end(),
+            allowed.begin(), allowed.end(), std::back_inserter(usable));
+        if(!usable.empty())
+            node_cpus.push_back(std::move(usable));
+    }
+
+    if(node_cpus.empty())
+        return options;
+
+    for(std::size_t i = 0; i < num_workers; ++i)
+        options.cpu_sets.push_back(node_cpus[i % node_cpus.size()]);
+
+    return options;
+}
+
+} // namespace io_service
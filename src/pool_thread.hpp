@@ -0,0 +1,58 @@
+#ifndef ASIO_POOL_THREAD_HPP
+#define ASIO_POOL_THREAD_HPP
+
+#include "invocable.hpp"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+
+namespace io_service {
+
+namespace detail {
+
+// Thread with attributes, which std::thread does not expose:
+// stack size, CPU affinity and name. Joined on destruction
+class pool_thread {
+private:
+    pthread_t m_handle;
+    bool m_is_joinable;
+
+private:
+    pool_thread(const pool_thread& other) = delete;
+    pool_thread& operator=(const pool_thread& other) = delete;
+
+public:
+    // CPUs are set before thread starts, so that it never runs elsewhere.
+    // Empty cpus and zero stack_size keep defaults. Name is truncated
+    // to 15 characters. Throws std::system_error, std::invalid_argument
+    // for CPU out of range. Exception, which leaves body, terminates program
+    pool_thread(invocable&& body, const std::vector<unsigned>& cpus,
+        const std::string& name, std::size_t stack_size);
+
+    pool_thread(pool_thread&& other) noexcept
+        : m_handle(other.m_handle)
+        , m_is_joinable(other.m_is_joinable)
+    { other.m_is_joinable = false; }
+
+    ~pool_thread()
+    { join(); }
+
+public:
+    void join();
+
+    pthread_t native_handle() const
+    { return m_handle; }
+
+}; // class pool_thread
+
+// CPUs, which calling thread is allowed to run on, in ascending order
+std::vector<unsigned> allowed_cpus();
+
+} // namespace detail
+
+} // namespace io_service
+
+#endif // ASIO_POOL_THREAD_HPP
@@ -0,0 +1,153 @@
+#ifndef ASIO_PRIORITY_LANE_HPP
+#define ASIO_PRIORITY_LANE_HPP
+
+#include "invocable.hpp"
+#include "service_stats.hpp" // queue_delay_stats
+#include "threadsafe_queue.hpp"
+#include "timer_queue.hpp" // timer_clock
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace io_service {
+
+namespace detail {
+
+class delay_counter {
+private:
+    std::atomic<std::uint64_t> m_num_tasks;
+    std::atomic<std::uint64_t> m_total_ns;
+    std::atomic<std::uint64_t> m_max_ns;
+
+public:
+    delay_counter()
+        : m_num_tasks(0)
+        , m_total_ns(0)
+        , m_max_ns(0)
+    {}
+
+public:
+    void record(timer_clock::duration delay) {
+        // Unique trace stamps might run ahead of clock
+        if(delay < timer_clock::duration::zero())
+            delay = timer_clock::duration::zero();
+
+        const std::uint64_t delay_ns = static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(delay).count());
+
+        m_num_tasks.fetch_add(1, std::memory_order_relaxed);
+        m_total_ns.fetch_add(delay_ns, std::memory_order_relaxed);
+
+        std::uint64_t max_ns = m_max_ns.load(std::memory_order_relaxed);
+        while(max_ns < delay_ns
+            && !m_max_ns.compare_exchange_weak(
+                max_ns, delay_ns, std::memory_order_relaxed)
+        )
+            ;
+    }
+
+    queue_delay_stats snapshot() const {
+        return queue_delay_stats{
+            m_num_tasks.load(std::memory_order_relaxed),
+            std::chrono::nanoseconds(m_total_ns.load(std::memory_order_relaxed)),
+            std::chrono::nanoseconds(m_max_ns.load(std::memory_order_relaxed))};
+    }
+
+}; // class delay_counter
+
+
+// Aging state of priority level. Level, which is passed over in favour
+// of higher ones for longer than aging period, gets its turn
+class lane_state {
+private:
+    static constexpr timer_clock::rep not_passed_over =
+        timer_clock::time_point::max().time_since_epoch().count();
+
+    // Since when tasks of level wait behind higher ones
+    std::atomic<timer_clock::rep> m_passed_over_since;
+
+public:
+    delay_counter delay;
+
+public:
+    lane_state()
+        : m_passed_over_since(not_passed_over)
+        , delay()
+    {}
+
+public:
+    // Only first one since level was served counts
+    void mark_passed_over(timer_clock::time_point now) {
+        timer_clock::rep expected = not_passed_over;
+        m_passed_over_since.compare_exchange_strong(
+            expected, now.time_since_epoch().count(),
+            std::memory_order_relaxed);
+    }
+
+    // Single load, unless level was passed over
+    void mark_served() {
+        if(m_passed_over_since.load(std::memory_order_relaxed) != not_passed_over)
+            m_passed_over_since.store(not_passed_over, std::memory_order_relaxed);
+    }
+
+    bool is_aged(timer_clock::time_point now, timer_clock::duration aging) const {
+        const timer_clock::rep since =
+            m_passed_over_since.load(std::memory_order_relaxed);
+        return since != not_passed_over
+            && now - timer_clock::time_point(timer_clock::duration(since)) >= aging;
+    }
+
+}; // class lane_state
+
+
+// Queue of single priority level, along with its aging state.
+// Tasks are stamped at push, delay is recorded at pop
+class priority_lane: public lane_state {
+private:
+    threadsafe_queue<invocable> m_queue;
+
+public:
+    priority_lane()
+        : lane_state()
+        , m_queue()
+    {}
+
+public:
+    void push(invocable&& task, timer_clock::time_point now) {
+        task.set_enqueue_time(now);
+        m_queue.push(std::move(task));
+    }
+
+    bool try_pop(invocable& out_task, timer_clock::time_point now) {
+        if(!m_queue.try_pop(out_task))
+            return false;
+
+        delay.record(now - out_task.enqueue_time());
+        mark_served();
+        return true;
+    }
+
+    // Without lock. Might be stale
+    bool empty() const
+    { return m_queue.size() == 0; }
+
+    std::size_t size() const
+    { return m_queue.size(); }
+
+    // Calls on_dropped(const invocable&) for each dropped task
+    template<typename Func>
+    void clear(Func on_dropped) {
+        m_queue.clear(on_dropped);
+        mark_served();
+    }
+
+}; // class priority_lane
+
+} // namespace detail
+
+} // namespace io_service
+
+#endif // ASIO_PRIORITY_LANE_HPP
@@ -0,0 +1,162 @@
+#ifndef ASIO_SERVICE_OPTIONS_HPP
+#define ASIO_SERVICE_OPTIONS_HPP
+
+#include "function.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <exception>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace io_service {
+
+// What happens to exception, escaped from task without future
+// (posted or dispatched by post() / dispatch()).
+// Tasks with future keep exception in it
+enum class exception_policy {
+    discard,    // exception is dropped, worker continues
+    terminate,  // std::terminate() is called
+    handler,    // service_options::exception_handler is called by worker
+    rethrow     // exception leaves run() of worker that executed the task
+};
+
+
+// Mechanism behind descriptor I/O
+enum class io_backend_type {
+    epoll,      // readiness-based reactor
+    io_uring    // completion-based proactor. Falls back to epoll,
+                // if io_uring is not available
+};
+
+
+// Priority levels of tasks. Workers take tasks of higher level first
+enum class task_priority {
+    high,
+    normal,     // post() without priority
+    low
+};
+
+
+// How worker waits, when there is no task for it.
+// It polls queues with pause instruction first, then with yield,
+// and only then blocks. Polling saves wake up of blocked worker
+// for tasks, posted shortly after queues ran dry
+struct idle_strategy {
+    // Polls with pause instruction between them
+    unsigned spin_iterations;
+    // Polls with std::this_thread::yield() between them
+    unsigned yield_iterations;
+    // Max workers polling at once. Rest of idle workers block right away,
+    // so that idle service does not occupy all cores
+    unsigned max_spinning_workers;
+
+public:
+    idle_strategy()
+        : spin_iterations(128)
+        , yield_iterations(16)
+        , max_spinning_workers(
+            std::max(1u, std::thread::hardware_concurrency() / 2))
+    {}
+
+    // Worker blocks as soon as queues are empty
+    static idle_strategy block() {
+        idle_strategy strategy;
+        strategy.spin_iterations = 0;
+        strategy.yield_iterations = 0;
+        return strategy;
+    }
+
+}; // struct idle_strategy
+
+
+// Threads, which io_service::start() starts and owns
+struct pool_options {
+    // CPUs, which worker of given index may run on. Workers past
+    // the end, and ones with empty set, are not pinned
+    std::vector<std::vector<unsigned>> cpu_sets;
+    // Workers are named by prefix and index ("io_worker-3").
+    // Linux keeps first 15 characters of name
+    std::string name_prefix;
+    // Zero keeps default of platform
+    std::size_t stack_size;
+
+public:
+    pool_options()
+        : cpu_sets()
+        , name_prefix("io_worker-")
+        , stack_size(0)
+    {}
+
+    // Each worker is pinned to single CPU, out of ones process may use.
+    // Workers go round them, if there are more workers than CPUs
+    static pool_options one_cpu_per_worker(std::size_t num_workers);
+
+    // Each worker is bound to CPUs of single NUMA node, out of ones
+    // process may use. Workers are spread over nodes evenly
+    static pool_options per_numa_node(std::size_t num_workers);
+
+}; // struct pool_options
+
+
+// Configuration of io_service, fixed at construction
+struct service_options {
+    typedef func::function<void(std::exception_ptr)> exception_handler_type;
+
+    exception_policy on_task_exception;
+    // Used by exception_policy::handler. Does nothing by default.
+    // Exception thrown by handler leaves run()
+    exception_handler_type exception_handler;
+
+    // Max tasks taken by worker from global queue at once.
+    // Extra tasks go to worker's local queue, where peers can steal them.
+    // Single task by default
+    std::size_t fetch_batch_size;
+
+    idle_strategy idle;
+
+    // Granularity of timer deadlines. Timers never fire early,
+    // but might fire up to one resolution late
+    std::chrono::steady_clock::duration timer_resolution;
+
+    io_backend_type io_backend;
+
+    // Level, passed over in favour of higher ones for this long,
+    // gets next task. Zero means strict priority: lower levels might starve
+    std::chrono::steady_clock::duration priority_aging;
+
+    // Keep per worker histograms of queueing delay and run time of tasks,
+    // merged by io_service::stats(). Costs two clock reads per task
+    bool latency_histograms;
+
+    // Events kept per worker by tracing (see io_service::trace()),
+    // older ones are overwritten. Zero disables tracing
+    std::size_t trace_buffer_size;
+
+    // Directory of NUMA topology (node<id>/cpulist). Global queue is
+    // split into shard per node: tasks, posted from outside of pool, go
+    // to shard of node they are posted on, and workers take tasks of
+    // their node first. Empty string keeps single shard
+    std::string numa_topology_path;
+
+public:
+    service_options()
+        : on_task_exception(exception_policy::discard)
+        , exception_handler([] (std::exception_ptr) {})
+        , fetch_batch_size(1)
+        , idle()
+        , timer_resolution(std::chrono::milliseconds(1))
+        , io_backend(io_backend_type::epoll)
+        , priority_aging(std::chrono::milliseconds(50))
+        , latency_histograms(false)
+        , trace_buffer_size(0)
+        , numa_topology_path("/sys/devices/system/node")
+    {}
+
+}; // struct service_options
+
+} // namespace io_service
+
+#endif // ASIO_SERVICE_OPTIONS_HPP
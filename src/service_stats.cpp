@@ -0,0 +1,210 @@
+#include "service_stats.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iterator> // std::size
+#include <ostream>
+#include <string>
+
+namespace io_service {
+
+namespace {
+
+const char* const priority_names[] = {"high", "normal", "low"};
+
+// Reported by write_prometheus() and write_json()
+const double latency_quantiles[] = {0.5, 0.9, 0.99, 0.999};
+const char* const latency_quantile_names[] = {"0.5", "0.9", "0.99", "0.999"};
+const char* const latency_percentile_keys[] = {"p50", "p90", "p99", "p999"};
+
+double to_seconds(std::chrono::nanoseconds dur)
+{ return std::chrono::duration<double>(dur).count(); }
+
+// Writes HELP and TYPE lines once per metric
+class prometheus_writer {
+private:
+    std::ostream& m_os;
+    const std::string& m_prefix;
+
+public:
+    prometheus_writer(std::ostream& os, const std::string& prefix)
+        : m_os(os)
+        , m_prefix(prefix)
+    {}
+
+public:
+    void header(const char* name, const char* type, const char* help) {
+        m_os << "# HELP " << m_prefix << '_' << name << ' ' << help << '\n'
+            << "# TYPE " << m_prefix << '_' << name << ' ' << type << '\n';
+    }
+
+    template<typename T>
+    void sample(const char* name, T value) {
+        m_os << m_prefix << '_' << name << ' ' << value << '\n';
+    }
+
+    template<typename T>
+    void sample(const char* name, const char* label,
+        const std::string& label_value, T value
+    ) {
+        m_os << m_prefix << '_' << name
+            << '{' << label << "=\"" << label_value << "\"} " << value << '\n';
+    }
+
+    template<typename T>
+    void metric(const char* name, const char* type, const char* help, T value) {
+        header(name, type, help);
+        sample(name, value);
+    }
+
+    // Summary with quantiles, sum and count. Skipped, if histogram is empty
+    void summary(const char* name, const char* help,
+        const latency_histogram& histogram
+    ) {
+        if(histogram.count() == 0)
+            return;
+
+        header(name, "summary", help);
+        for(std::size_t i = 0; i < std::size(latency_quantiles); ++i)
+            sample(name, "quantile", latency_quantile_names[i],
+                to_seconds(histogram.percentile(latency_quantiles[i] * 100)));
+
+        const std::string base(name);
+        sample((base + "_sum").c_str(), to_seconds(histogram.total()));
+        sample((base + "_count").c_str(), histogram.count());
+    }
+
+}; // class prometheus_writer
+
+void write_histogram_json(std::ostream& os, const latency_histogram& histogram) {
+    os << "{\"count\":" << histogram.count()
+        << ",\"mean_ns\":" << histogram.mean().count()
+        << ",\"max_ns\":" << histogram.max().count();
+    for(std::size_t i = 0; i < std::size(latency_quantiles); ++i)
+        os << ",\"" << latency_percentile_keys[i] << "_ns\":"
+            << histogram.percentile(latency_quantiles[i] * 100).count();
+    os << '}';
+}
+
+} // namespace
+
+void write_prometheus(
+    std::ostream& os, const service_stats& stats, const std::string& prefix
+) {
+    prometheus_writer out(os, prefix);
+
+    out.metric("tasks_posted_total", "counter",
+        "Tasks queued into service", stats.tasks_posted);
+    out.metric("tasks_dispatched_total", "counter",
+        "Tasks run right away by dispatch", stats.tasks_dispatched);
+    out.metric("tasks_executed_total", "counter",
+        "Tasks run by workers", stats.tasks_executed);
+    out.metric("wakeups_total", "counter",
+        "Returns of workers from blocking wait", stats.wakeups);
+
+    out.header("queue_depth", "gauge", "Tasks waiting in queues");
+    out.sample("queue_depth", "queue", "global", stats.global_queue_depth);
+    out.sample("queue_depth", "queue", "local", stats.local_queue_depth);
+    out.sample("queue_depth", "queue", "priority", stats.priority_queue_depth);
+
+    out.metric("queued_bytes", "gauge",
+        "Memory held by queued tasks", stats.queued_bytes);
+    out.metric("busy_seconds_total", "counter",
+        "Time workers spent running tasks", to_seconds(stats.busy_time));
+    out.metric("idle_seconds_total", "counter",
+        "Time workers spent waiting for tasks", to_seconds(stats.idle_time));
+
+    out.header("queue_delay_tasks_total", "counter",
+        "Tasks of priority level, which started");
+    for(std::size_t i = 0; i < stats.queue_delays.size(); ++i)
+        out.sample("queue_delay_tasks_total", "priority", priority_names[i],
+            stats.queue_delays[i].num_tasks);
+
+    out.header("queue_delay_seconds_total", "counter",
+        "Time tasks of priority level spent in queue");
+    for(std::size_t i = 0; i < stats.queue_delays.size(); ++i)
+        out.sample("queue_delay_seconds_total", "priority", priority_names[i],
+            to_seconds(stats.queue_delays[i].total_delay));
+
+    out.header("queue_delay_max_seconds", "gauge",
+        "Longest time task of priority level spent in queue");
+    for(std::size_t i = 0; i < stats.queue_delays.size(); ++i)
+        out.sample("queue_delay_max_seconds", "priority", priority_names[i],
+            to_seconds(stats.queue_delays[i].max_delay));
+
+    out.header("worker_tasks_executed_total", "counter",
+        "Tasks run by worker");
+    for(const worker_stats& worker : stats.workers)
+        out.sample("worker_tasks_executed_total", "worker",
+            std::to_string(worker.index), worker.tasks_executed);
+
+    out.header("worker_busy_seconds_total", "counter",
+        "Time worker spent running tasks");
+    for(const worker_stats& worker : stats.workers)
+        out.sample("worker_busy_seconds_total", "worker",
+            std::to_string(worker.index), to_seconds(worker.busy_time));
+
+    out.header("worker_idle_seconds_total", "counter",
+        "Time worker spent waiting for tasks");
+    for(const worker_stats& worker : stats.workers)
+        out.sample("worker_idle_seconds_total", "worker",
+            std::to_string(worker.index), to_seconds(worker.idle_time));
+
+    out.header("worker_local_queue_depth", "gauge",
+        "Tasks waiting in local queue of worker");
+    for(const worker_stats& worker : stats.workers)
+        out.sample("worker_local_queue_depth", "worker",
+            std::to_string(worker.index), worker.local_queue_depth);
+
+    out.summary("task_queue_delay_seconds",
+        "Time from enqueue of task until it started",
+        stats.queue_delay_histogram);
+    out.summary("task_run_seconds",
+        "Time task was running", stats.run_time_histogram);
+}
+
+void write_json(std::ostream& os, const service_stats& stats) {
+    os << "{\"tasks_posted\":" << stats.tasks_posted
+        << ",\"tasks_dispatched\":" << stats.tasks_dispatched
+        << ",\"tasks_executed\":" << stats.tasks_executed
+        << ",\"wakeups\":" << stats.wakeups
+        << ",\"queue_depth\":{\"global\":" << stats.global_queue_depth
+            << ",\"local\":" << stats.local_queue_depth
+            << ",\"priority\":" << stats.priority_queue_depth << '}'
+        << ",\"queued_bytes\":" << stats.queued_bytes
+        << ",\"busy_ns\":" << stats.busy_time.count()
+        << ",\"idle_ns\":" << stats.idle_time.count()
+        << ",\"queue_delay\":{";
+
+    for(std::size_t i = 0; i < stats.queue_delays.size(); ++i) {
+        const queue_delay_stats& delay = stats.queue_delays[i];
+        os << (i == 0 ? "" : ",") << '"' << priority_names[i] << "\":{"
+            << "\"tasks\":" << delay.num_tasks
+            << ",\"total_ns\":" << delay.total_delay.count()
+            << ",\"max_ns\":" << delay.max_delay.count() << '}';
+    }
+
+    os << "},\"workers\":[";
+    for(std::size_t i = 0; i < stats.workers.size(); ++i) {
+        const worker_stats& worker = stats.workers[i];
+        os << (i == 0 ? "" : ",")
+            << "{\"index\":" << worker.index
+            << ",\"active\":" << (worker.is_active ? "true" : "false")
+            << ",\"tasks_posted\":" << worker.tasks_posted
+            << ",\"tasks_dispatched\":" << worker.tasks_dispatched
+            << ",\"tasks_executed\":" << worker.tasks_executed
+            << ",\"wakeups\":" << worker.wakeups
+            << ",\"busy_ns\":" << worker.busy_time.count()
+            << ",\"idle_ns\":" << worker.idle_time.count()
+            << ",\"local_queue_depth\":" << worker.local_queue_depth << '}';
+    }
+
+    os << "],\"queue_delay_histogram\":";
+    write_histogram_json(os, stats.queue_delay_histogram);
+    os << ",\"run_time_histogram\":";
+    write_histogram_json(os, stats.run_time_histogram);
+    os << '}';
+}
+
+} // namespace io_service
@@ -0,0 +1,234 @@
+#ifndef ASIO_SERVICE_STATS_HPP
+#define ASIO_SERVICE_STATS_HPP
+
+#include "latency_histogram.hpp"
+#include "service_options.hpp" // task_priority
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace io_service {
+
+// Time tasks of priority level spent in queue, before they started
+struct queue_delay_stats {
+    std::uint64_t num_tasks;
+    std::chrono::nanoseconds total_delay;
+    std::chrono::nanoseconds max_delay;
+
+public:
+    std::chrono::nanoseconds mean_delay() const {
+        return num_tasks == 0
+            ? std::chrono::nanoseconds::zero()
+            : total_delay / static_cast<std::int64_t>(num_tasks);
+    }
+
+}; // struct queue_delay_stats
+
+
+// Counters of single worker slot. Slot outlives workers, which lease it
+struct worker_stats {
+    std::size_t index;
+    // Leased by run() / poll() at the moment
+    bool is_active;
+
+    std::uint64_t tasks_posted;
+    std::uint64_t tasks_dispatched;
+    std::uint64_t tasks_executed;
+    // Returns from blocking wait for tasks
+    std::uint64_t wakeups;
+
+    // Within run() / poll(): running tasks or waiting for them.
+    // Waiting for I/O as backend runner counts as idle
+    std::chrono::nanoseconds busy_time;
+    std::chrono::nanoseconds idle_time;
+
+    std::size_t local_queue_depth;
+
+}; // struct worker_stats
+
+
+// Snapshot of io_service, taken by io_service::stats().
+// Counters are read one by one, without stopping workers,
+// so they might be slightly inconsistent with each other
+struct service_stats {
+    // Queued into service: posted by user, and by timers, I/O and strands
+    std::uint64_t tasks_posted;
+    // Run right away by dispatch()
+    std::uint64_t tasks_dispatched;
+    std::uint64_t tasks_executed;
+    std::uint64_t wakeups;
+
+    std::size_t global_queue_depth;
+    // Sum of local queues of workers
+    std::size_t local_queue_depth;
+    // Tasks of high and low priority
+    std::size_t priority_queue_depth;
+
+    // Queued invocables, along with callables they allocated
+    std::uint64_t queued_bytes;
+
+    std::chrono::nanoseconds busy_time;
+    std::chrono::nanoseconds idle_time;
+
+    // Indexed by task_priority
+    std::array<queue_delay_stats, 3> queue_delays;
+
+    std::vector<worker_stats> workers;
+
+    // Merged over workers. Empty, unless
+    // service_options::latency_histograms is set.
+    // From enqueue of task until it starts: covers post(), post_waitable()
+    // and post() with priority, but not post_bulk(), timers and I/O
+    latency_histogram queue_delay_histogram;
+    // Of every task run by workers
+    latency_histogram run_time_histogram;
+
+public:
+    std::size_t queue_depth() const
+    { return global_queue_depth + local_queue_depth + priority_queue_depth; }
+
+    const queue_delay_stats& queue_delay(task_priority priority) const
+    { return queue_delays[static_cast<std::size_t>(priority)]; }
+
+}; // struct service_stats
+
+// Prometheus text exposition format. Metric names start with prefix.
+// Non-empty latency histograms are written as summaries
+void write_prometheus(std::ostream& os, const service_stats& stats,
+    const std::string& prefix = "io_service");
+
+void write_json(std::ostream& os, const service_stats& stats);
+
+namespace detail {
+
+class stat_counter {
+private:
+    std::atomic<std::uint64_t> m_value;
+
+public:
+    stat_counter()
+        : m_value(0)
+    {}
+
+public:
+    void add(std::uint64_t num)
+    { m_value.fetch_add(num, std::memory_order_relaxed); }
+
+    // Without locked instruction
+    // Prereq: calling thread is the only writer
+    void add_owned(std::uint64_t num) {
+        m_value.store(
+            m_value.load(std::memory_order_relaxed) + num,
+            std::memory_order_relaxed);
+    }
+
+    std::uint64_t load() const
+    { return m_value.load(std::memory_order_relaxed); }
+
+}; // class stat_counter
+
+
+// Written by owner of worker slot, or by any thread outside of pool.
+// Occupies cache lines of its own, so that readers do not disturb queues
+struct alignas(64) worker_counters {
+    stat_counter tasks_posted;
+    stat_counter tasks_dispatched;
+    stat_counter tasks_executed;
+    stat_counter bytes_posted;
+    stat_counter bytes_executed;
+    stat_counter wakeups;
+
+    stat_counter run_ns;
+    stat_counter idle_ns;
+    // Since when owner is within run() / poll(), and since when it is
+    // without task. Zero, if it is not
+    std::atomic<std::int64_t> active_since_ns;
+    std::atomic<std::int64_t> idle_since_ns;
+
+public:
+    worker_counters()
+        : active_since_ns(0)
+        , idle_since_ns(0)
+    {}
+
+}; // struct worker_counters
+
+
+// Buckets of latency_histogram, written by owner of worker slot,
+// or by any thread outside of pool
+class latency_recorder {
+private:
+    stat_counter m_buckets[latency_histogram::bucket_count];
+    stat_counter m_total_ns;
+    std::atomic<std::uint64_t> m_max_ns;
+
+public:
+    latency_recorder()
+        : m_max_ns(0)
+    {}
+
+public:
+    void record(std::chrono::nanoseconds dur)
+    { M_record<false>(dur); }
+
+    // Prereq: calling thread is the only writer
+    void record_owned(std::chrono::nanoseconds dur)
+    { M_record<true>(dur); }
+
+    // Count is summed up from buckets, so that percentiles agree with it
+    void merge_into(latency_histogram& out) const {
+        for(std::size_t i = 0; i < latency_histogram::bucket_count; ++i) {
+            const std::uint64_t num = m_buckets[i].load();
+            out.m_buckets[i] += num;
+            out.m_count += num;
+        }
+        out.m_total_ns += m_total_ns.load();
+        out.m_max_ns = std::max(
+            out.m_max_ns, m_max_ns.load(std::memory_order_relaxed));
+    }
+
+// Impl funcs
+private:
+    template<bool IsOwned>
+    void M_record(std::chrono::nanoseconds dur) {
+        const std::uint64_t ns = latency_histogram::S_to_ns(dur);
+        stat_counter& bucket = m_buckets[latency_histogram::bucket_index(ns)];
+
+        std::uint64_t max_ns = m_max_ns.load(std::memory_order_relaxed);
+        if constexpr (IsOwned) {
+            bucket.add_owned(1);
+            m_total_ns.add_owned(ns);
+            if(max_ns < ns)
+                m_max_ns.store(ns, std::memory_order_relaxed);
+        } else {
+            bucket.add(1);
+            m_total_ns.add(ns);
+            while(max_ns < ns
+                && !m_max_ns.compare_exchange_weak(
+                    max_ns, ns, std::memory_order_relaxed)
+            )
+                ;
+        }
+    }
+
+}; // class latency_recorder
+
+
+// Histograms of worker slot. Allocated only if they are enabled
+struct task_latency {
+    latency_recorder queue_delay;
+    latency_recorder run_time;
+}; // struct task_latency
+
+} // namespace detail
+
+} // namespace io_service
+
+#endif // ASIO_SERVICE_STATS_HPP
@@ -0,0 +1,305 @@
+#ifndef ASIO_STRAND_HPP
+#define ASIO_STRAND_HPP
+
+#include "io_service.hpp"
+#include "invocable.hpp"
+#include "node_pool.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <functional> // std::invoke
+#include <memory>
+#include <utility>
+
+namespace io_service {
+
+namespace detail {
+
+struct strand_node {
+    std::atomic<strand_node*> next;
+    invocable task;
+
+public:
+    strand_node()
+        : next(nullptr)
+        , task()
+    {}
+
+    explicit strand_node(invocable&& in_task)
+        : next(nullptr)
+        , task(std::move(in_task))
+    {}
+
+}; // struct strand_node
+
+
+// Handlers of strand, queued in intrusive MPSC queue (by D. Vyukov).
+// Push is wait-free. Whoever sets running flag is the only consumer,
+// and runs handlers from task, posted to io_service
+class strand_impl {
+public:
+    // Handlers run by single task. Then strand is posted anew,
+    // so that tasks behind it in queue are not starved
+    static constexpr std::size_t max_handlers_per_turn = 64;
+
+private:
+    typedef std::unique_ptr<strand_node, node_pool_deleter<strand_node>> node_ptr;
+
+    // Keeps strand alive, while it is scheduled.
+    // Strand, whose task was dropped by stop(), is abandoned
+    struct invoker {
+        std::shared_ptr<strand_impl> impl;
+
+        invoker(std::shared_ptr<strand_impl> in_impl)
+            : impl(std::move(in_impl))
+        {}
+
+        invoker(invoker&& other) = default;
+
+        ~invoker() {
+            if(impl)
+                impl->M_abandon();
+        }
+
+        void operator()() {
+            std::shared_ptr<strand_impl> running = std::move(impl);
+            running->M_run_turn();
+        }
+    };
+
+    // Ends turn, even if handler throws
+    struct turn_guard {
+        strand_impl& impl;
+        strand_impl* const outer;
+
+        ~turn_guard() {
+            S_current() = outer;
+            impl.M_finish_turn();
+        }
+    };
+
+private:
+    io_service& m_service;
+
+    // Producers push at head, consumer pops at tail
+    std::atomic<strand_node*> m_head;
+    strand_node* m_tail;
+    strand_node m_stub;
+
+    std::atomic<bool> m_is_running;
+
+    std::weak_ptr<strand_impl> m_self;
+
+private:
+    strand_impl(const strand_impl& other) = delete;
+    strand_impl& operator=(const strand_impl& other) = delete;
+
+    explicit strand_impl(io_service& service)
+        : m_service(service)
+        , m_head(&m_stub)
+        , m_tail(&m_stub)
+        , m_stub()
+        , m_is_running(false)
+        , m_self()
+    {}
+
+public:
+    static std::shared_ptr<strand_impl> create(io_service& service) {
+        std::shared_ptr<strand_impl> impl(new strand_impl(service));
+        impl->m_self = impl;
+        return impl;
+    }
+
+    // No consumer is left. Pending handlers are dropped
+    ~strand_impl() {
+        while(node_ptr node = M_pop()) {}
+    }
+
+public:
+    // Throws service_stopped_error, if strand had to be scheduled
+    // on stopped service. Then task is dropped
+    void post(invocable&& task) {
+        void* mem = node_pool<strand_node>::allocate();
+        strand_node* node = new (mem) strand_node(std::move(task));
+        M_push(node);
+
+        // Single owner of running flag consumes the queue
+        if(!m_is_running.exchange(true))
+            M_schedule();
+    }
+
+    bool running_in_this_thread() const
+    { return S_current() == this; }
+
+    io_service& get_io_service() const
+    { return m_service; }
+
+// Impl funcs
+private:
+    void M_schedule()
+    { m_service.post(invoker(m_self.lock())); }
+
+    void M_run_turn() {
+        turn_guard guard{*this, S_current()};
+        S_current() = this;
+
+        for(std::size_t i = 0; i < max_handlers_per_turn; ++i) {
+            node_ptr node = M_pop();
+            if(!node)
+                break;
+
+            node->task();
+        }
+    }
+
+    void M_finish_turn() {
+        // Still running. Left handlers go to next turn
+        if(!M_is_empty()) {
+            M_reschedule();
+            return;
+        }
+
+        m_is_running = false;
+        // Push might have seen flag set, before it was cleared.
+        // Flag is released: only head is ours to read
+        if(M_has_pushed() && !m_is_running.exchange(true))
+            M_reschedule();
+    }
+
+    void M_reschedule() {
+        try {
+            M_schedule();
+        } catch(const service_stopped_error&) {
+            // Dropped task has abandoned strand
+        }
+    }
+
+    // Drops pending handlers, as stop() does with tasks
+    void M_abandon() {
+        do {
+            // Push in progress is waited for, while flag is owned
+            do {
+                while(node_ptr node = M_pop()) {}
+            } while(!M_is_empty());
+
+            m_is_running = false;
+        } while(M_has_pushed() && !m_is_running.exchange(true));
+    }
+
+    void M_push(strand_node* node) {
+        node->next.store(nullptr, std::memory_order_relaxed);
+        strand_node* prev = m_head.exchange(node);
+        // Until linked, consumer sees queue cut at prev
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // Returns nullptr if queue is empty, or push is in progress
+    // Prereq: running flag is owned by caller
+    node_ptr M_pop() {
+        strand_node* tail = m_tail;
+        strand_node* next = tail->next.load(std::memory_order_acquire);
+        if(tail == &m_stub) {
+            if(!next)
+                return node_ptr();
+
+            m_tail = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+
+        if(next) {
+            m_tail = next;
+            return node_ptr(tail);
+        }
+
+        if(tail != m_head.load())
+            return node_ptr(); /*push in progress*/
+
+        // Last node. Stub takes its place, so that it can be taken
+        M_push(&m_stub);
+        next = tail->next.load(std::memory_order_acquire);
+        if(next) {
+            m_tail = next;
+            return node_ptr(tail);
+        }
+
+        return node_ptr();
+    }
+
+    // Node, being pushed, makes queue non-empty
+    // Prereq: running flag is owned by caller
+    bool M_is_empty() const
+    { return m_tail == &m_stub && m_head.load() == &m_stub; }
+
+    // Something was pushed, since queue was seen empty by M_is_empty().
+    // Safe without running flag
+    bool M_has_pushed() const
+    { return m_head.load() != &m_stub; }
+
+    // Strand, whose handler runs on this thread. Nested for dispatch()
+    // of another strand
+    static strand_impl*& S_current() {
+        static thread_local strand_impl* current = nullptr;
+        return current;
+    }
+
+}; // class strand_impl
+
+} // namespace detail
+
+
+// Serializes handlers, posted through it: they never run concurrently,
+// and run in order of posting. Strand occupies at most one worker
+// of io_service at a time, without blocking others.
+// Copies refer to the same strand. io_service has to outlive it
+class strand {
+private:
+    std::shared_ptr<detail::strand_impl> m_impl;
+
+public:
+    explicit strand(io_service& service)
+        : m_impl(detail::strand_impl::create(service))
+    {}
+
+public:
+    // Callable and args are stored as in io_service::post().
+    // Escaped exception is handled by service_options::on_task_exception,
+    // strand goes on with next handler
+    template<typename Callable, typename ...Args>
+    void
+    post(Callable&& func, Args&& ...args) {
+        m_impl->post(
+            invocable(std::forward<Callable>(func), std::forward<Args>(args)...));
+    }
+
+    // Runs handler right away, if called from handler of this strand.
+    // Otherwise, posts it
+    template<typename Callable, typename ...Args>
+    void
+    dispatch(Callable&& func, Args&& ...args) {
+        if(running_in_this_thread()) {
+            std::invoke(
+                S_decay_copy(std::forward<Callable>(func)),
+                S_decay_copy(std::forward<Args>(args))...);
+        } else {
+            post(std::forward<Callable>(func), std::forward<Args>(args)...);
+        }
+    }
+
+    bool running_in_this_thread() const
+    { return m_impl->running_in_this_thread(); }
+
+    io_service& get_io_service() const
+    { return m_impl->get_io_service(); }
+
+// Impl funcs
+private:
+    template<typename T>
+    static std::decay_t<T> S_decay_copy(T&& val)
+    { return std::forward<T>(val); }
+
+}; // class strand
+
+} // namespace io_service
+
+#endif // ASIO_STRAND_HPP
@@ -0,0 +1,295 @@
+#ifndef ASIO_TASK_HPP
+#define ASIO_TASK_HPP
+
+#include "node_pool.hpp"
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <new> // operator new
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace io_service {
+
+namespace detail {
+
+// Frames of coroutines are taken from node_pool of their size class,
+// so that steady flow of coroutines does not reach the heap.
+// Frames above max_pooled_size are allocated by operator new
+class frame_allocator {
+public:
+    static constexpr std::size_t size_class = 64;
+    static constexpr std::size_t max_pooled_size = 1024;
+
+private:
+    static constexpr std::size_t classes_num = max_pooled_size / size_class;
+
+    template<std::size_t Size>
+    struct alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) frame_block {
+        unsigned char data[Size];
+    };
+
+    template<std::size_t Class>
+    using class_pool = node_pool<frame_block<(Class + 1) * size_class>>;
+
+    struct class_funcs {
+        void* (*allocate)();
+        void (*deallocate)(void*);
+    };
+
+    // Functions of each class, indexed by class
+    template<typename Classes>
+    struct class_table;
+
+    template<std::size_t ...Classes>
+    struct class_table<std::index_sequence<Classes...>> {
+        static constexpr class_funcs funcs[] = {
+            {&class_pool<Classes>::allocate, &class_pool<Classes>::deallocate}...};
+    };
+
+    typedef class_table<std::make_index_sequence<classes_num>> funcs_table;
+
+private:
+    frame_allocator() = delete;
+
+public:
+    static void* allocate(std::size_t size) {
+        if(size == 0 || size > max_pooled_size)
+            return ::operator new(size);
+
+        return funcs_table::funcs[S_class_of(size)].allocate();
+    }
+
+    // Size is the one, passed to allocate()
+    static void deallocate(void* ptr, std::size_t size) {
+        if(size == 0 || size > max_pooled_size) {
+            ::operator delete(ptr);
+            return;
+        }
+
+        funcs_table::funcs[S_class_of(size)].deallocate(ptr);
+    }
+
+// Impl funcs
+private:
+    static std::size_t S_class_of(std::size_t size)
+    { return (size - 1) / size_class; }
+
+}; // class frame_allocator
+
+
+// Base of promises. Frames are allocated by frame_allocator
+struct pooled_frame {
+    static void* operator new(std::size_t size)
+    { return frame_allocator::allocate(size); }
+
+    static void operator delete(void* ptr, std::size_t size)
+    { frame_allocator::deallocate(ptr, size); }
+
+}; // struct pooled_frame
+
+
+// Resumes coroutine, which awaits finished task.
+// Transfer is symmetric: chains of tasks do not grow stack
+struct final_awaiter {
+    std::coroutine_handle<> continuation;
+
+public:
+    bool await_ready() const noexcept
+    { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<>) noexcept {
+        return continuation ? continuation : std::noop_coroutine();
+    }
+
+    void await_resume() const noexcept {}
+
+}; // struct final_awaiter
+
+
+class task_promise_base: public pooled_frame {
+private:
+    std::coroutine_handle<> m_continuation;
+
+public:
+    task_promise_base()
+        : m_continuation()
+    {}
+
+public:
+    // Task is lazy: body runs, once task is awaited
+    std::suspend_always initial_suspend() const noexcept
+    { return {}; }
+
+    final_awaiter final_suspend() const noexcept
+    { return final_awaiter{m_continuation}; }
+
+    void set_continuation(std::coroutine_handle<> continuation)
+    { m_continuation = continuation; }
+
+}; // class task_promise_base
+
+
+template<typename T>
+class task_promise: public task_promise_base {
+private:
+    std::variant<std::monostate, T, std::exception_ptr> m_result;
+
+public:
+    template<typename U>
+    void return_value(U&& value)
+    { m_result.template emplace<1>(std::forward<U>(value)); }
+
+    void unhandled_exception()
+    { m_result.template emplace<2>(std::current_exception()); }
+
+    T result() {
+        if(m_result.index() == 2)
+            std::rethrow_exception(std::get<2>(m_result));
+
+        return std::move(std::get<1>(m_result));
+    }
+
+}; // class task_promise
+
+
+template<>
+class task_promise<void>: public task_promise_base {
+private:
+    std::exception_ptr m_exception;
+
+public:
+    void return_void() {}
+
+    void unhandled_exception()
+    { m_exception = std::current_exception(); }
+
+    void result() {
+        if(m_exception)
+            std::rethrow_exception(m_exception);
+    }
+
+}; // class task_promise<void>
+
+} // namespace detail
+
+
+// Coroutine, which returns T. Lazy: it starts, when it is awaited,
+// on thread of awaiting coroutine, and resumes it on completion.
+// co_await io_service::schedule() moves it onto worker of service.
+// Exception, escaped from coroutine, is rethrown to awaiting one.
+// Owns its frame: destroying task, which is not awaited, destroys it
+template<typename T = void>
+class task {
+    static_assert(!std::is_reference_v<T>, "task of reference is not supported");
+
+public:
+    class promise_type: public detail::task_promise<T> {
+    public:
+        task get_return_object() {
+            return task(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+    };
+
+    typedef std::coroutine_handle<promise_type> handle_type;
+
+private:
+    handle_type m_handle;
+
+private:
+    task(const task& other) = delete;
+    task& operator=(const task& other) = delete;
+
+    explicit task(handle_type handle)
+        : m_handle(handle)
+    {}
+
+public:
+    task() noexcept
+        : m_handle()
+    {}
+
+    task(task&& other) noexcept
+        : m_handle(std::exchange(other.m_handle, nullptr))
+    {}
+
+    task& operator=(task&& other) noexcept {
+        if(this != &other) {
+            M_destroy();
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+
+        return *this;
+    }
+
+    ~task()
+    { M_destroy(); }
+
+public:
+    // Task holds a coroutine. It stays held after co_await, until
+    // task is destroyed
+    bool valid() const noexcept
+    { return static_cast<bool>(m_handle); }
+
+    // Starts task. Result is returned, once it is done.
+    // Prereq: valid(), task was not awaited yet
+    auto operator co_await() && noexcept {
+        struct awaiter {
+            handle_type handle;
+
+            bool await_ready() const noexcept
+            { return false; }
+
+            handle_type await_suspend(std::coroutine_handle<> awaiting) noexcept {
+                handle.promise().set_continuation(awaiting);
+                return handle;
+            }
+
+            T await_resume()
+            { return handle.promise().result(); }
+        };
+
+        return awaiter{m_handle};
+    }
+
+// Impl funcs
+private:
+    void M_destroy() {
+        if(m_handle)
+            m_handle.destroy();
+        m_handle = nullptr;
+    }
+
+}; // class task
+
+
+namespace detail {
+
+// Coroutine, which owns its frame, and destroys it on completion.
+// Body has to catch exceptions: escaped one terminates program
+struct detached_task {
+    struct promise_type: public pooled_frame {
+        detached_task get_return_object() const noexcept
+        { return {}; }
+
+        std::suspend_never initial_suspend() const noexcept
+        { return {}; }
+
+        std::suspend_never final_suspend() const noexcept
+        { return {}; }
+
+        void return_void() const noexcept {}
+
+        void unhandled_exception() const noexcept
+        { std::terminate(); }
+    };
+
+}; // struct detached_task
+
+} // namespace detail
+
+} // namespace io_service
+
+#endif // ASIO_TASK_HPP
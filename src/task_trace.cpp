@@ -0,0 +1,165 @@
+#include "task_trace.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio> // std::snprintf
+#include <limits>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+namespace io_service {
+
+namespace {
+
+const char* const default_task_name = "task";
+
+void write_json_string(std::ostream& os, const char* str) {
+    os << '"';
+    for(; *str != '\0'; ++str) {
+        const char ch = *str;
+        if(ch == '"' || ch == '\\') {
+            os << '\\' << ch;
+        } else if(static_cast<unsigned char>(ch) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", ch);
+            os << escaped;
+        } else {
+            os << ch;
+        }
+    }
+    os << '"';
+}
+
+// Writes events one by one, separated by commas.
+// Timestamps are microseconds since first event
+class chrome_trace_writer {
+private:
+    std::ostream& m_os;
+    std::int64_t m_base_ns;
+    bool m_is_first;
+
+public:
+    chrome_trace_writer(std::ostream& os, std::int64_t base_ns)
+        : m_os(os)
+        , m_base_ns(base_ns)
+        , m_is_first(true)
+    {}
+
+public:
+    void thread_name(std::size_t tid, const std::string& name) {
+        M_begin();
+        m_os << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << tid
+            << ",\"args\":{\"name\":\"" << name << "\"}}";
+    }
+
+    // Instant event. Label of task goes to args
+    void post(const char* label, std::size_t tid, std::int64_t time_ns) {
+        M_begin();
+        m_os << "{\"ph\":\"i\",\"s\":\"t\",\"name\":\"post\"";
+        if(label) {
+            m_os << ",\"args\":{\"task\":";
+            write_json_string(m_os, label);
+            m_os << '}';
+        }
+        M_write_place(tid, time_ns);
+        m_os << '}';
+    }
+
+    // Slice begin ("B") or end ("E"). Name is set on begin only
+    void slice(char phase, const char* name, std::size_t tid, std::int64_t time_ns) {
+        M_begin();
+        m_os << "{\"ph\":\"" << phase << '"';
+        if(name) {
+            m_os << ",\"name\":";
+            write_json_string(m_os, name);
+        }
+        M_write_place(tid, time_ns);
+        m_os << '}';
+    }
+
+    // Flow arrow from post ("s") to start ("f") of task
+    void flow(char phase, std::uint64_t id, std::size_t tid, std::int64_t time_ns) {
+        M_begin();
+        m_os << "{\"ph\":\"" << phase << "\",\"name\":\"" << default_task_name
+            << "\",\"cat\":\"io_service\",\"id\":\"0x" << std::hex << id << std::dec << '"';
+        if(phase == 'f')
+            m_os << ",\"bp\":\"e\"";
+        M_write_place(tid, time_ns);
+        m_os << '}';
+    }
+
+// Impl funcs
+private:
+    void M_begin() {
+        if(!m_is_first)
+            m_os << ",\n";
+        m_is_first = false;
+    }
+
+    void M_write_place(std::size_t tid, std::int64_t time_ns) {
+        const std::int64_t since_base = time_ns - m_base_ns;
+        char ts[32];
+        std::snprintf(ts, sizeof(ts), "%lld.%03lld",
+            static_cast<long long>(since_base / 1000),
+            static_cast<long long>(since_base % 1000));
+        m_os << ",\"ts\":" << ts << ",\"pid\":1,\"tid\":" << tid;
+    }
+
+}; // class chrome_trace_writer
+
+} // namespace
+
+void write_chrome_trace(std::ostream& os, const service_trace& trace) {
+    // Labels are known at post. Slices are named after them
+    std::unordered_map<std::uint64_t, const char*> labels;
+    std::int64_t base_ns = std::numeric_limits<std::int64_t>::max();
+    for(const thread_trace& thread : trace.threads)
+        for(const trace_event& event : thread.events) {
+            base_ns = std::min(base_ns, event.time_ns);
+            if(event.type == trace_event_type::post && event.task_id != 0 && event.label)
+                labels.emplace(event.task_id, event.label);
+        }
+
+    os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    chrome_trace_writer out(os, base_ns);
+
+    for(const thread_trace& thread : trace.threads) {
+        // Threads outside of pool share tid 0
+        const std::size_t tid = thread.is_worker ? thread.index + 1 : 0;
+        out.thread_name(tid,
+            thread.is_worker ? "worker " + std::to_string(thread.index) : "external");
+
+        // Ends of tasks, whose start was overwritten, are dropped
+        std::size_t depth = 0;
+        for(const trace_event& event : thread.events) {
+            switch(event.type) {
+            case trace_event_type::post:
+                out.post(event.label, tid, event.time_ns);
+                if(event.task_id != 0)
+                    out.flow('s', event.task_id, tid, event.time_ns);
+                break;
+            case trace_event_type::start: {
+                const auto label = labels.find(event.task_id);
+                out.slice('B',
+                    label != labels.end() ? label->second : default_task_name,
+                    tid, event.time_ns);
+                if(event.task_id != 0)
+                    out.flow('f', event.task_id, tid, event.time_ns);
+                ++depth;
+                break;
+            }
+            case trace_event_type::end:
+                if(depth == 0)
+                    break;
+                out.slice('E', nullptr, tid, event.time_ns);
+                --depth;
+                break;
+            }
+        }
+    }
+
+    os << "\n]}\n";
+}
+
+} // namespace io_service
@@ -0,0 +1,175 @@
+#ifndef ASIO_TASK_TRACE_HPP
+#define ASIO_TASK_TRACE_HPP
+
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+namespace io_service {
+
+// Name of task in trace. Pointer is kept as is, so it has to outlive
+// exported traces: string literal, or other static storage
+struct task_label {
+    const char* name;
+
+public:
+    constexpr explicit task_label(const char* in_name)
+        : name(in_name)
+    {}
+
+}; // struct task_label
+
+
+enum class trace_event_type : std::uint8_t {
+    post,   // task is queued
+    start,  // worker took task
+    end     // task returned or threw
+};
+
+
+struct trace_event {
+    trace_event_type type;
+    // Of steady_clock
+    std::int64_t time_ns;
+    // Links post of task to its start and end. Zero for tasks,
+    // which are not stamped (post_bulk(), timers and I/O)
+    std::uint64_t task_id;
+    // Set on post events of labeled tasks only
+    const char* label;
+
+}; // struct trace_event
+
+
+// Events recorded by single worker slot, or by threads outside of pool
+struct thread_trace {
+    std::size_t index;
+    bool is_worker;
+    // Oldest first
+    std::vector<trace_event> events;
+
+}; // struct thread_trace
+
+
+// Snapshot of io_service, taken by io_service::trace()
+struct service_trace {
+    std::vector<thread_trace> threads;
+
+}; // struct service_trace
+
+// Chrome trace-event JSON, loadable by Perfetto and chrome://tracing.
+// Tasks are slices named by label, linked to their post by flow arrows
+void write_chrome_trace(std::ostream& os, const service_trace& trace);
+
+namespace detail {
+
+// Ring of last events. Writers never wait: oldest events are
+// overwritten, and readers skip events, which are being written
+class trace_ring {
+private:
+    // Per-entry sequence lock. Seq is index of event plus one,
+    // zero for entry never written, or busy while entry is written
+    static constexpr std::uint64_t busy =
+        std::numeric_limits<std::uint64_t>::max();
+
+    struct entry {
+        std::atomic<std::uint64_t> seq;
+        std::atomic<std::int64_t> time_ns;
+        std::atomic<std::uint64_t> task_id;
+        std::atomic<const char*> label;
+        std::atomic<trace_event_type> type;
+    };
+
+    std::unique_ptr<entry[]> m_entries;
+    std::size_t m_mask;
+    std::atomic<std::uint64_t> m_head;
+
+public:
+    // Capacity is rounded up to power of two
+    explicit trace_ring(std::size_t capacity)
+        : m_entries()
+        , m_mask(std::bit_ceil(capacity < 2 ? std::size_t(2) : capacity) - 1)
+        , m_head(0)
+    {
+        // Value-initialized: seq of each entry is zero
+        m_entries = std::make_unique<entry[]>(m_mask + 1);
+    }
+
+public:
+    void record(const trace_event& event)
+    { M_write<false>(m_head.fetch_add(1, std::memory_order_relaxed), event); }
+
+    // Without locked instruction
+    // Prereq: calling thread is the only writer
+    void record_owned(const trace_event& event) {
+        const std::uint64_t index = m_head.load(std::memory_order_relaxed);
+        m_head.store(index + 1, std::memory_order_relaxed);
+        M_write<true>(index, event);
+    }
+
+    // Appends events, which are still in ring, oldest first
+    void snapshot(std::vector<trace_event>& out) const {
+        const std::uint64_t head = m_head.load(std::memory_order_acquire);
+        const std::uint64_t capacity = m_mask + 1;
+        const std::uint64_t first = head > capacity ? head - capacity : 0;
+
+        for(std::uint64_t index = first; index < head; ++index) {
+            const entry& slot = m_entries[index & m_mask];
+            const std::uint64_t seq = slot.seq.load(std::memory_order_acquire);
+            if(seq != index + 1)
+                continue; /*overwritten, or not written yet*/
+
+            trace_event event{
+                slot.type.load(std::memory_order_relaxed),
+                slot.time_ns.load(std::memory_order_relaxed),
+                slot.task_id.load(std::memory_order_relaxed),
+                slot.label.load(std::memory_order_relaxed)};
+
+            // Entry was rewritten meanwhile
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(slot.seq.load(std::memory_order_relaxed) != seq)
+                continue;
+
+            out.push_back(event);
+        }
+    }
+
+// Impl funcs
+private:
+    template<bool IsOwned>
+    void M_write(std::uint64_t index, const trace_event& event) {
+        entry& slot = m_entries[index & m_mask];
+
+        if constexpr (IsOwned) {
+            slot.seq.store(busy, std::memory_order_relaxed);
+        } else {
+            // Writer, lapped by this one, is still within entry.
+            // Event is dropped, so that entry is not torn
+            std::uint64_t seq = slot.seq.load(std::memory_order_relaxed);
+            if(seq == busy
+                || !slot.seq.compare_exchange_strong(
+                    seq, busy, std::memory_order_relaxed)
+            )
+                return;
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+
+        slot.type.store(event.type, std::memory_order_relaxed);
+        slot.time_ns.store(event.time_ns, std::memory_order_relaxed);
+        slot.task_id.store(event.task_id, std::memory_order_relaxed);
+        slot.label.store(event.label, std::memory_order_relaxed);
+
+        slot.seq.store(index + 1, std::memory_order_release);
+    }
+
+}; // class trace_ring
+
+} // namespace detail
+
+} // namespace io_service
+
+#endif // ASIO_TASK_TRACE_HPP
@@ -4,12 +4,18 @@
 #include <memory>
 
 #include "interrupt_flag.hpp"
+#include "worker_slot.hpp"
 
 namespace io_service {
 
-// RAII manager of thread_local resources
+// RAII manager of thread_local resources.
+// Restores ones of enclosing run(), if run() is nested in a task
 class thread_data_mngr {
     std::unique_ptr<interrupt_handle>& m_int_hndl_ref;
+    detail::worker_slot*& m_slot_ref;
+
+    std::unique_ptr<interrupt_handle> m_outer_hndl;
+    detail::worker_slot* m_outer_slot;
 
 private:
     thread_data_mngr() = delete; /*explicit*/
@@ -21,19 +27,33 @@ private:
     thread_data_mngr& operator=(const thread_data_mngr&& other) = delete;
 
 public:
+    // acquired_slot might be nullptr, if io_service ran out of slots.
+    // Thread works without local queue then
     thread_data_mngr(
         std::unique_ptr<interrupt_handle>& int_hndl,
-        std::unique_ptr<interrupt_handle> allocated_handle
+        std::unique_ptr<interrupt_handle> allocated_handle,
+        detail::worker_slot*& slot,
+        detail::worker_slot* acquired_slot
     )
         : m_int_hndl_ref(int_hndl)
+        , m_slot_ref(slot)
+        , m_outer_hndl(std::move(int_hndl))
+        , m_outer_slot(slot)
     {
-        m_int_hndl_ref = std::move(allocated_handle);   
+        m_int_hndl_ref = std::move(allocated_handle);
+        m_slot_ref = acquired_slot;
     }
 
 
     ~thread_data_mngr() {
+        // Slot is released before handle,
+        // so that it is free once manager's wait_all() returns
+        if(m_slot_ref)
+            m_slot_ref->release();
+        m_slot_ref = m_outer_slot;
+
         // TODO: decide if unique_ptr.reset() is better or not
-        m_int_hndl_ref = std::unique_ptr<interrupt_handle>();
+        m_int_hndl_ref = std::move(m_outer_hndl);
     }
 
 }; // class thread_data_mngr
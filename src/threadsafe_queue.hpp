@@ -8,7 +8,11 @@
 #include "lock_guard.hpp"
 #include "unique_lock.hpp"
 #include "false_func.hpp"
+#include "node_pool.hpp"
 
+#include <atomic>
+#include <chrono>
+#include <cstddef>
 #include <memory> 
 #include <mutex> // std::scoped_lock
 
@@ -17,18 +21,29 @@ namespace io_service {
 template<typename T>
 class threadsafe_queue {
 private:
+    struct node;
+    // Nodes are recycled through node_pool
+    typedef std::unique_ptr<node, node_pool_deleter<node>> node_ptr;
+
     struct node {
         T data;
-        std::unique_ptr<node> next_node;
+        node_ptr next_node;
     };
 
 private:
-    std::unique_ptr<node> m_head;
+    node_ptr m_head;
     node* m_tail;
 
     concurrency::mutex m_head_mutex;
     concurrency::mutex m_tail_mutex;
     concurrency::condition_variable m_data_cv;
+    // Threads blocked in wait_and_pop
+    std::atomic<int> m_waiters;
+    // Waiter is notified, but has not looked into queue yet.
+    // Pushes meanwhile do not wake others. Woken one passes wake up on
+    std::atomic<bool> m_waking;
+    // Number of elements. Readable without lock
+    std::atomic<std::size_t> m_size;
     
 private:
     // TODO: Consider adding copying, depending on T
@@ -37,8 +52,11 @@ private:
 
 public:
     threadsafe_queue()
-        : m_head(std::make_unique<node>()) /*dummy node*/
+        : m_head(S_make_node()) /*dummy node*/
         , m_tail(m_head.get())
+        , m_waiters(0)
+        , m_waking(false)
+        , m_size(0)
     {}
 
     // TODO: Find out if [other] should have appropriate state
@@ -47,13 +65,19 @@ public:
         : threadsafe_queue()
     { swap(other); }
 
+    ~threadsafe_queue() {
+        // Unlink nodes one by one.
+        // Chain of unique_ptr would be destroyed recursively
+        while(m_head)
+            m_head = std::move(m_head->next_node);
+    }
+
 public:
     void push(T in_data) {
         using namespace concurrency;
 
         /* new dummy node */
-        std::unique_ptr<node> new_node_ptr =
-            std::make_unique<node>();
+        node_ptr new_node_ptr = S_make_node();
         node* new_tail = new_node_ptr.get();
 
         {
@@ -61,10 +85,46 @@ public:
             m_tail->data = std::move(in_data);
             m_tail->next_node = std::move(new_node_ptr);
             m_tail = new_tail;
+            ++m_size;
         }   
 
-        // TODO: is it fine to notify outside of any lock?
-        m_data_cv.notify_one();
+        M_notify_one();
+    }
+
+    // Links chain of elements, constructed from [first, last),
+    // under single lock. Wakes no more waiters than elements pushed.
+    // Returns number of elements pushed
+    template<typename InputIt>
+    std::size_t push_bulk(InputIt first, InputIt last) {
+        using namespace concurrency;
+
+        if(first == last)
+            return 0;
+
+        // Goes to current dummy tail
+        T first_data(*first);
+        ++first;
+
+        // Rest of elements + new dummy node at the end
+        node_ptr chain_head = S_make_node();
+        node* chain_tail = chain_head.get();
+        std::size_t num_pushed = 1;
+        for(; first != last; ++first, ++num_pushed) {
+            chain_tail->data = T(*first);
+            chain_tail->next_node = S_make_node();
+            chain_tail = chain_tail->next_node.get();
+        }
+
+        {
+            lock_guard<mutex> lk(m_tail_mutex);
+            m_tail->data = std::move(first_data);
+            m_tail->next_node = std::move(chain_head);
+            m_tail = chain_tail;
+            m_size += num_pushed;
+        }
+
+        M_notify_waiters(num_pushed);
+        return num_pushed;
     }
 
 public:
@@ -81,18 +141,73 @@ public:
 
     template<typename Predicate = false_func>
     bool wait_and_pop(T& out_data, Predicate pred = Predicate()) {
+        return wait_and_pop_until(
+            out_data, std::chrono::steady_clock::time_point::max(), pred);
+    }
+
+    // Same as wait_and_pop, but gives up at deadline
+    template<typename Clock, typename Duration, typename Predicate = false_func>
+    bool wait_and_pop_until(
+        T& out_data,
+        const std::chrono::time_point<Clock, Duration>& deadline,
+        Predicate pred = Predicate()
+    ) {
         using namespace concurrency;
 
-        unique_lock<mutex> lk(M_wait_for_data(pred));
+        unique_lock<mutex> lk(M_wait_for_data(deadline, pred));
 
         // if predicate is true, no data was fetched
-        if(pred())
+        if(pred() || m_head.get() == M_get_tail())
             return false;
 
         M_do_pop_head(out_data);
+        M_pass_wake_on();
         return true;
     }
 
+    // Pops up to max_elems into out under single lock.
+    // Returns number of elements popped
+    template<typename OutputIt>
+    std::size_t try_pop_n(OutputIt out, std::size_t max_elems) {
+        using namespace concurrency;
+
+        lock_guard<mutex> lk(m_head_mutex);
+        return M_do_pop_head_n(out, max_elems);
+    }
+
+    // Blocks until there is at least one element, then pops up to max_elems.
+    // Returns 0, if predicate has disrupted waiting
+    // Prereq: max_elems > 0
+    template<typename OutputIt, typename Predicate = false_func>
+    std::size_t wait_and_pop_n(
+        OutputIt out, std::size_t max_elems, Predicate pred = Predicate()
+    ) {
+        return wait_and_pop_n_until(
+            out, max_elems, std::chrono::steady_clock::time_point::max(), pred);
+    }
+
+    // Same as wait_and_pop_n, but gives up at deadline
+    template<
+        typename OutputIt, typename Clock, typename Duration,
+        typename Predicate = false_func>
+    std::size_t wait_and_pop_n_until(
+        OutputIt out, std::size_t max_elems,
+        const std::chrono::time_point<Clock, Duration>& deadline,
+        Predicate pred = Predicate()
+    ) {
+        using namespace concurrency;
+
+        unique_lock<mutex> lk(M_wait_for_data(deadline, pred));
+
+        // if predicate is true, no data was fetched
+        if(pred() || m_head.get() == M_get_tail())
+            return 0;
+
+        const std::size_t num_popped = M_do_pop_head_n(out, max_elems);
+        M_pass_wake_on();
+        return num_popped;
+    }
+
 public:
     bool empty() {
         using namespace concurrency;
@@ -100,6 +215,10 @@ public:
         return m_head.get() == M_get_tail();
     }
 
+    // Hint only. Might be outdated by the time it is used
+    std::size_t size() const
+    { return m_size.load(std::memory_order_relaxed); }
+
     // External signal to unblock threads waiting for data
     void signal()
     { 
@@ -108,6 +227,33 @@ public:
         m_data_cv.notify_all();
     }
 
+    // Drops queued elements
+    void clear() {
+        threadsafe_queue sink;
+        swap(sink);
+    }
+
+    // Same as clear, but calls on_dropped(const T&) for each element,
+    // outside of lock
+    template<typename Func>
+    void clear(Func on_dropped) {
+        threadsafe_queue sink;
+        swap(sink);
+
+        T data;
+        while(sink.try_pop(data))
+            on_dropped(static_cast<const T&>(data));
+    }
+
+    // Wake up to num_waiters, so that they re-evaluate their predicate
+    void wake(std::size_t num_waiters = 1)
+    {
+        using namespace concurrency;
+        lock_guard<mutex> lk(m_head_mutex);
+        for(std::size_t i = 0; i < num_waiters; ++i)
+            m_data_cv.notify_one();
+    }
+
 public:
     void swap(threadsafe_queue& other) {
         using std::swap;
@@ -118,6 +264,7 @@ public:
         
         swap(m_head, other.m_head);
         swap(m_tail, other.m_tail);
+        m_size = other.m_size.exchange(m_size);
     }
 
     friend
@@ -133,28 +280,121 @@ private:
     }
 
     // Blocking wait for data
-    // which can be awaken by true predicate and external signal()
-    template<typename Predicate = false_func>
+    // which can be awaken by true predicate, external signal() and deadline.
+    // time_point::max() waits without deadline
+    template<typename Clock, typename Duration, typename Predicate>
     concurrency::unique_lock<concurrency::mutex>
-    M_wait_for_data(Predicate pred = Predicate()) {
+    M_wait_for_data(
+        const std::chrono::time_point<Clock, Duration>& deadline,
+        Predicate& pred
+    ) {
         using namespace concurrency;
         unique_lock<mutex> lk(m_head_mutex);
+        ++m_waiters;
         // If both queue not empty AND pred is true
         // Then no data will be fetched
-        m_data_cv.wait(lk,
+        auto is_ready =
             [this, &pred] () { 
+                // Next push may wake another waiter.
+                // Pairs with fence in M_notify_one()
+                m_waking = false;
+                std::atomic_thread_fence(std::memory_order_seq_cst);
                 return (m_head.get() != M_get_tail())
                     || pred();
-            });
+            };
+
+        if(deadline == std::chrono::time_point<Clock, Duration>::max())
+            m_data_cv.wait(lk, is_ready);
+        else
+            m_data_cv.wait_until(lk, deadline, is_ready);
+        --m_waiters;
         return lk;
     }
 
+    // Wakes single waiter, unless there is none, or one is being woken.
+    // Does not touch head_mutex, if nobody waits
+    void M_notify_one() {
+        using namespace concurrency;
+
+        // Either waiter sees pushed data, or push sees the waiter
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(m_waiters.load(std::memory_order_relaxed) == 0)
+            return;
+
+        if(m_waking.exchange(true))
+            return; /*woken waiter will take data, or pass wake up on*/
+
+        // Under lock, so that waiter, which is about to block, is not missed
+        lock_guard<mutex> lk(m_head_mutex);
+        m_data_cv.notify_one();
+    }
+
+    // Wakes no more waiters than num_elems
+    void M_notify_waiters(std::size_t num_elems) {
+        using namespace concurrency;
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::size_t num_waiters = m_waiters.load(std::memory_order_relaxed);
+        if(num_waiters == 0)
+            return;
+
+        if(num_waiters > num_elems)
+            num_waiters = num_elems;
+
+        m_waking = true;
+        lock_guard<mutex> lk(m_head_mutex);
+        for(std::size_t i = 0; i < num_waiters; ++i)
+            m_data_cv.notify_one();
+    }
+
+    // Woken waiter leaves rest of data to next one
+    // Prereq: head_mutex - locked
+    void M_pass_wake_on() {
+        if(m_head.get() == M_get_tail()
+            || m_waiters.load(std::memory_order_relaxed) == 0
+        )
+            return;
+
+        if(!m_waking.exchange(true))
+            m_data_cv.notify_one();
+    }
+
     // Prereq: head_mutex - locked
     void
     M_do_pop_head(T& out_data) {
         out_data = std::move(m_head->data);
-        std::unique_ptr<node> old_head = std::move(m_head);
+        node_ptr old_head = std::move(m_head);
         m_head = std::move(old_head->next_node);
+        --m_size;
+    }
+
+    // Prereq: head_mutex - locked
+    template<typename OutputIt>
+    std::size_t
+    M_do_pop_head_n(OutputIt out, std::size_t max_elems) {
+        // Elements pushed after this point are left for next time
+        node* const tail = M_get_tail();
+
+        std::size_t num_popped = 0;
+        for(; num_popped < max_elems && m_head.get() != tail; ++num_popped) {
+            *out = std::move(m_head->data);
+            ++out;
+            node_ptr old_head = std::move(m_head);
+            m_head = std::move(old_head->next_node);
+        }
+
+        m_size -= num_popped;
+        return num_popped;
+    }
+
+    static node_ptr S_make_node() {
+        void* mem = node_pool<node>::allocate();
+        try {
+            return node_ptr(::new (mem) node());
+        } catch(...) {
+            node_pool<node>::deallocate(mem);
+            throw;
+        }
     }
 
 }; // class threadsafe_queue
@@ -0,0 +1,291 @@
+#ifndef ASIO_TIMER_QUEUE_HPP
+#define ASIO_TIMER_QUEUE_HPP
+
+#include "invocable.hpp"
+#include "timer_wheel.hpp"
+
+#include "mutex.hpp"
+#include "lock_guard.hpp"
+#include "function.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace io_service {
+
+typedef std::chrono::steady_clock timer_clock;
+
+namespace detail {
+
+enum class timer_status {
+    pending,    // waits in timer_queue (periodic - until cancelled)
+    fired,      // one-shot task was handed out
+    cancelled
+};
+
+// Shared by timer_queue, handle and task of periodic timer
+struct timer_state: timer_wheel_node {
+    // One-shot timer
+    invocable task;
+    // Periodic timer. Called on every expiry
+    func::function<void()> callback;
+    timer_clock::duration period; /*zero for one-shot*/
+
+    timer_clock::time_point deadline;
+    std::atomic<timer_status> status;
+
+    // Keeps state alive, while it is linked into wheel
+    std::shared_ptr<timer_state> keep_alive;
+
+public:
+    timer_state()
+        : task()
+        , callback()
+        , period(timer_clock::duration::zero())
+        , deadline()
+        , status(timer_status::pending)
+        , keep_alive()
+    {}
+
+    bool is_periodic() const
+    { return period != timer_clock::duration::zero(); }
+
+    // Only one of cancel / expiry of one-shot timer succeeds
+    bool try_set_status(timer_status new_status) {
+        timer_status expected = timer_status::pending;
+        return status.compare_exchange_strong(expected, new_status);
+    }
+
+}; // struct timer_state
+
+
+// Timers of io_service, kept in timer_wheel.
+// Deadlines are rounded up to resolution, so timers never fire early
+class timer_queue {
+public:
+    typedef std::shared_ptr<timer_state> state_ptr;
+
+private:
+    timer_wheel m_wheel;
+    const timer_clock::time_point m_start;
+    const timer_clock::duration m_resolution;
+
+    concurrency::mutex m_mutex;
+
+    // Readable without lock. time_point::max() if there are no timers
+    std::atomic<timer_clock::rep> m_next_deadline;
+
+private:
+    timer_queue(const timer_queue& other) = delete;
+    timer_queue& operator=(const timer_queue& other) = delete;
+
+public:
+    explicit timer_queue(timer_clock::duration resolution)
+        : m_wheel()
+        , m_start(timer_clock::now())
+        , m_resolution(
+            resolution > timer_clock::duration::zero()
+                ? resolution : timer_clock::duration(1))
+        , m_next_deadline(S_no_deadline())
+    {}
+
+    ~timer_queue()
+    { clear(); }
+
+public:
+    // Returns true if timer became the earliest one
+    bool schedule(state_ptr state) {
+        using namespace concurrency;
+
+        const timer_clock::time_point deadline = state->deadline;
+        timer_state* raw_state = state.get();
+        raw_state->keep_alive = std::move(state);
+
+        lock_guard<mutex> lk(m_mutex);
+        m_wheel.insert(raw_state, M_to_tick(deadline));
+        return M_update_next_deadline();
+    }
+
+    // Removes timer from wheel. Status is not changed
+    void remove(timer_state& state) {
+        using namespace concurrency;
+
+        state_ptr sink;
+        {
+            lock_guard<mutex> lk(m_mutex);
+            if(!m_wheel.remove(&state))
+                return;
+
+            sink = std::move(state.keep_alive);
+            M_update_next_deadline();
+        }
+        // state might be destroyed outside of lock
+    }
+
+    // Calls on_expired(state_ptr&&) for timers, which are due at now.
+    // One-shot timers are marked fired, cancelled ones are skipped.
+    // Returns number of on_expired calls
+    template<typename Func>
+    std::size_t expire(timer_clock::time_point now, Func&& on_expired) {
+        using namespace concurrency;
+
+        std::vector<state_ptr> expired;
+        {
+            lock_guard<mutex> lk(m_mutex);
+            m_wheel.advance(M_to_tick_floor(now),
+                [&expired] (timer_wheel::node_type* node) {
+                    timer_state* state = static_cast<timer_state*>(node);
+                    expired.push_back(std::move(state->keep_alive));
+                });
+            M_update_next_deadline();
+        }
+
+        std::size_t num_fired = 0;
+        for(state_ptr& state : expired) {
+            const bool is_active = state->is_periodic()
+                ? state->status == timer_status::pending
+                : state->try_set_status(timer_status::fired);
+
+            if(!is_active)
+                continue;
+
+            on_expired(std::move(state));
+            ++num_fired;
+        }
+
+        return num_fired;
+    }
+
+    // Drops all timers. Pending ones are marked cancelled
+    void clear() {
+        using namespace concurrency;
+
+        std::vector<state_ptr> sink;
+        {
+            lock_guard<mutex> lk(m_mutex);
+            m_wheel.clear(
+                [&sink] (timer_wheel::node_type* node) {
+                    timer_state* state = static_cast<timer_state*>(node);
+                    state->try_set_status(timer_status::cancelled);
+                    sink.push_back(std::move(state->keep_alive));
+                });
+            M_update_next_deadline();
+        }
+        // states might be destroyed outside of lock
+    }
+
+public:
+    // Earliest time, at which expire() might have something to do.
+    // time_point::max() if there are no timers
+    timer_clock::time_point next_deadline() const {
+        return timer_clock::time_point(
+            timer_clock::duration(m_next_deadline.load()));
+    }
+
+    // Cheap check, no clock is read if there are no timers
+    bool has_timers() const
+    { return m_next_deadline.load() != S_no_deadline(); }
+
+    std::size_t size() {
+        using namespace concurrency;
+        lock_guard<mutex> lk(m_mutex);
+        return m_wheel.size();
+    }
+
+// Impl funcs
+private:
+    // Prereq: m_mutex - locked
+    // Returns true if next deadline became earlier
+    bool M_update_next_deadline() {
+        const std::uint64_t event_tick = m_wheel.next_event_tick();
+        const timer_clock::rep next_deadline =
+            event_tick == timer_wheel::no_event
+                ? S_no_deadline()
+                : (m_start + m_resolution * event_tick).time_since_epoch().count();
+
+        return m_next_deadline.exchange(next_deadline) > next_deadline;
+    }
+
+    // Rounds up, so that tick is not reached before deadline
+    std::uint64_t M_to_tick(timer_clock::time_point deadline) const {
+        if(deadline <= m_start)
+            return 0;
+
+        if(deadline == timer_clock::time_point::max())
+            return timer_wheel::no_event - 1;
+
+        const timer_clock::duration since_start = deadline - m_start;
+        std::uint64_t tick = since_start / m_resolution;
+        if(since_start % m_resolution != timer_clock::duration::zero())
+            ++tick;
+        return tick;
+    }
+
+    std::uint64_t M_to_tick_floor(timer_clock::time_point now) const {
+        if(now <= m_start)
+            return 0;
+
+        return (now - m_start) / m_resolution;
+    }
+
+    static timer_clock::rep S_no_deadline()
+    { return timer_clock::time_point::max().time_since_epoch().count(); }
+
+}; // class timer_queue
+
+} // namespace detail
+
+
+// Refers to timer, posted by post_at() / post_after() / post_every().
+// Does not keep io_service alive
+class timer_handle {
+private:
+    std::shared_ptr<detail::timer_state> m_state;
+    std::weak_ptr<detail::timer_queue> m_queue;
+
+public:
+    timer_handle()
+        : m_state()
+        , m_queue()
+    {}
+
+    timer_handle(
+        std::shared_ptr<detail::timer_state> state,
+        std::weak_ptr<detail::timer_queue> queue
+    )
+        : m_state(std::move(state))
+        , m_queue(std::move(queue))
+    {}
+
+public:
+    // Timer will not fire anymore. Task of periodic timer, which is
+    // already running, is not interrupted.
+    // Returns false if timer has fired or was cancelled before
+    bool cancel() {
+        if(!m_state || !m_state->try_set_status(detail::timer_status::cancelled))
+            return false;
+
+        // Free wheel slot right away
+        if(std::shared_ptr<detail::timer_queue> queue = m_queue.lock())
+            queue->remove(*m_state);
+
+        return true;
+    }
+
+    // True if timer is still to fire
+    bool pending() const {
+        return m_state
+            && m_state->status == detail::timer_status::pending;
+    }
+
+    bool valid() const
+    { return m_state != nullptr; }
+
+}; // class timer_handle
+
+} // namespace io_service
+
+#endif // ASIO_TIMER_QUEUE_HPP
@@ -0,0 +1,275 @@
+#ifndef ASIO_TIMER_WHEEL_HPP
+#define ASIO_TIMER_WHEEL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace io_service {
+
+namespace detail {
+
+// Intrusive node of timer_wheel.
+// Owner embeds it, wheel only links it into its lists
+struct timer_wheel_node {
+    timer_wheel_node* prev;
+    timer_wheel_node* next;
+    std::uint64_t expiry; /*tick*/
+    std::size_t bucket;
+
+    timer_wheel_node()
+        : prev(nullptr)
+        , next(nullptr)
+        , expiry(0)
+        , bucket(0)
+    {}
+
+    bool is_linked() const
+    { return prev != nullptr; }
+
+}; // struct timer_wheel_node
+
+} // namespace detail
+
+
+// Hierarchical timing wheel. Time is measured in abstract ticks.
+// Slot of level k holds nodes, which expire within the same
+// block of 64^(k+1) ticks as current tick. When level k slot is reached,
+// its nodes are cascaded to lower levels.
+// Insert and remove are O(1). Advance is O(expired + cascaded),
+// ticks without events are skipped. Not thread-safe
+class timer_wheel {
+public:
+    typedef detail::timer_wheel_node node_type;
+
+    static constexpr unsigned slot_bits = 6;
+    static constexpr std::size_t num_slots = std::size_t(1) << slot_bits;
+    static constexpr std::size_t num_levels = 4;
+
+    static constexpr std::uint64_t no_event =
+        std::numeric_limits<std::uint64_t>::max();
+
+private:
+    // Nodes beyond last level. Looked at once per revolution of last level
+    static constexpr std::size_t overflow_bucket = num_levels * num_slots;
+    // Nodes, which are due at current tick
+    static constexpr std::size_t due_bucket = overflow_bucket + 1;
+    static constexpr std::size_t num_buckets = due_bucket + 1;
+
+    static constexpr unsigned wheel_bits = slot_bits * num_levels;
+
+private:
+    // Sentinels of circular lists
+    node_type m_buckets[num_buckets];
+    // Bit per non-empty slot of level
+    std::uint64_t m_occupied[num_levels];
+
+    std::uint64_t m_current;
+    std::size_t m_size;
+
+private:
+    // Sentinels point to themselves
+    timer_wheel(const timer_wheel& other) = delete;
+    timer_wheel& operator=(const timer_wheel& other) = delete;
+
+public:
+    explicit timer_wheel(std::uint64_t start_tick = 0)
+        : m_current(start_tick)
+        , m_size(0)
+    {
+        for(std::size_t i = 0; i < num_buckets; ++i) {
+            m_buckets[i].prev = &m_buckets[i];
+            m_buckets[i].next = &m_buckets[i];
+            m_buckets[i].bucket = i;
+        }
+
+        for(std::size_t i = 0; i < num_levels; ++i)
+            m_occupied[i] = 0;
+    }
+
+public:
+    // Node expiring at or before current tick is due at next advance()
+    // Prereq: node is not linked
+    void insert(node_type* node, std::uint64_t expiry) {
+        node->expiry = expiry;
+        M_place(node);
+        ++m_size;
+    }
+
+    // Returns false if node is not in wheel
+    bool remove(node_type* node) {
+        if(!node->is_linked())
+            return false;
+
+        M_unlink(node);
+        --m_size;
+        return true;
+    }
+
+    // Moves current tick to now_tick. on_expired(node_type*) is called
+    // for every expired node, after node is removed from wheel
+    template<typename Func>
+    std::size_t advance(std::uint64_t now_tick, Func&& on_expired) {
+        std::size_t num_expired = M_drain_due(on_expired);
+
+        for(;;) {
+            const std::uint64_t event_tick = next_event_tick();
+            if(event_tick == no_event || event_tick > now_tick)
+                break;
+
+            m_current = event_tick;
+            M_process_tick(event_tick);
+            num_expired += M_drain_due(on_expired);
+        }
+
+        if(m_current < now_tick)
+            m_current = now_tick;
+
+        return num_expired;
+    }
+
+public:
+    // Tick, at which something has to be done: either expiry or cascade.
+    // No earlier tick needs advance(). no_event if wheel is empty
+    std::uint64_t next_event_tick() const {
+        if(!M_is_bucket_empty(due_bucket))
+            return m_current;
+
+        for(std::size_t level = 0; level < num_levels; ++level) {
+            const unsigned shift = slot_bits * level;
+            const std::size_t cur_slot = (m_current >> shift) & (num_slots - 1);
+            if(cur_slot == num_slots - 1)
+                continue; /*nothing above current slot*/
+
+            const std::uint64_t ahead =
+                m_occupied[level] & (~std::uint64_t(0) << (cur_slot + 1));
+            if(ahead == 0)
+                continue;
+
+            const std::uint64_t block_base =
+                (m_current >> (shift + slot_bits)) << (shift + slot_bits);
+            return block_base
+                | (std::uint64_t(__builtin_ctzll(ahead)) << shift);
+        }
+
+        if(!M_is_bucket_empty(overflow_bucket))
+            return ((m_current >> wheel_bits) + 1) << wheel_bits;
+
+        return no_event;
+    }
+
+    std::uint64_t current_tick() const
+    { return m_current; }
+
+    std::size_t size() const
+    { return m_size; }
+
+    bool empty() const
+    { return m_size == 0; }
+
+    // Unlinks all nodes. on_removed(node_type*) is called for each of them
+    template<typename Func>
+    void clear(Func&& on_removed) {
+        for(std::size_t i = 0; i < num_buckets; ++i)
+            while(!M_is_bucket_empty(i)) {
+                node_type* node = m_buckets[i].next;
+                M_unlink(node);
+                --m_size;
+                on_removed(node);
+            }
+    }
+
+// Impl funcs
+private:
+    void M_place(node_type* node) {
+        const std::uint64_t expiry = node->expiry;
+        if(expiry <= m_current) {
+            M_link(node, due_bucket);
+            return;
+        }
+
+        // Lowest level, whose block contains both current tick and expiry
+        for(std::size_t level = 0; level < num_levels; ++level) {
+            const unsigned shift = slot_bits * level;
+            if((expiry >> (shift + slot_bits)) != (m_current >> (shift + slot_bits)))
+                continue;
+
+            const std::size_t slot = (expiry >> shift) & (num_slots - 1);
+            M_link(node, level * num_slots + slot);
+            m_occupied[level] |= std::uint64_t(1) << slot;
+            return;
+        }
+
+        M_link(node, overflow_bucket);
+    }
+
+    // Cascades slots reached by tick, top to bottom
+    void M_process_tick(std::uint64_t tick) {
+        if((tick & ((std::uint64_t(1) << wheel_bits) - 1)) == 0)
+            M_cascade(overflow_bucket);
+
+        for(std::size_t level = num_levels; level-- > 0; ) {
+            const unsigned shift = slot_bits * level;
+            if(level != 0 && (tick & ((std::uint64_t(1) << shift) - 1)) != 0)
+                continue;
+
+            const std::size_t slot = (tick >> shift) & (num_slots - 1);
+            if(m_occupied[level] & (std::uint64_t(1) << slot))
+                M_cascade(level * num_slots + slot);
+        }
+    }
+
+    // Places nodes of bucket anew, relative to current tick
+    void M_cascade(std::size_t bucket) {
+        node_type& head = m_buckets[bucket];
+        while(head.next != &head) {
+            node_type* node = head.next;
+            M_unlink(node);
+            M_place(node);
+        }
+    }
+
+    template<typename Func>
+    std::size_t M_drain_due(Func& on_expired) {
+        std::size_t num_expired = 0;
+        node_type& head = m_buckets[due_bucket];
+        while(head.next != &head) {
+            node_type* node = head.next;
+            M_unlink(node);
+            --m_size;
+            ++num_expired;
+            on_expired(node);
+        }
+
+        return num_expired;
+    }
+
+    void M_link(node_type* node, std::size_t bucket) {
+        node_type& head = m_buckets[bucket];
+        node->bucket = bucket;
+        node->prev = head.prev;
+        node->next = &head;
+        head.prev->next = node;
+        head.prev = node;
+    }
+
+    void M_unlink(node_type* node) {
+        const std::size_t bucket = node->bucket;
+        node->prev->next = node->next;
+        node->next->prev = node->prev;
+        node->prev = nullptr;
+        node->next = nullptr;
+
+        if(bucket < overflow_bucket && M_is_bucket_empty(bucket))
+            m_occupied[bucket / num_slots] &=
+                ~(std::uint64_t(1) << (bucket % num_slots));
+    }
+
+    bool M_is_bucket_empty(std::size_t bucket) const
+    { return m_buckets[bucket].next == &m_buckets[bucket]; }
+
+}; // class timer_wheel
+
+} // namespace io_service
+
+#endif // ASIO_TIMER_WHEEL_HPP
@@ -0,0 +1,595 @@
+#include "uring_proactor.hpp"
+
+#include "lock_guard.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace io_service {
+
+using detail::last_error;
+
+// Completion of poll on eventfd. Operations are told apart by address
+static const std::uint64_t event_tag = 1;
+// Completions of cancel requests are not looked at
+static const std::uint64_t ignored_tag = 0;
+
+// Size of registered files table
+static const unsigned num_file_slots = 256;
+
+// Linux does not transfer more at once anyway
+static const std::size_t max_transfer_size = 0x7ffff000;
+
+// Destructor gives up on operations, which are not cancelled by then
+static const long cancel_timeout_ms = 1000;
+
+static int uring_setup(unsigned entries, io_uring_params* params)
+{ return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params)); }
+
+static int uring_enter(
+    int fd, unsigned to_submit, unsigned min_complete, unsigned flags,
+    const void* arg, std::size_t arg_size
+) {
+    return static_cast<int>(::syscall(__NR_io_uring_enter,
+        fd, to_submit, min_complete, flags, arg, arg_size));
+}
+
+static int uring_register(int fd, unsigned opcode, const void* arg, unsigned num_args)
+{ return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, num_args)); }
+
+// Waits for completions up to timeout_ms. Negative for no timeout
+static int uring_submit_and_wait(
+    int fd, unsigned to_submit, unsigned min_complete, long timeout_ms
+) {
+    if(timeout_ms < 0)
+        return uring_enter(fd, to_submit, min_complete,
+            IORING_ENTER_GETEVENTS, nullptr, 0);
+
+    __kernel_timespec ts = {};
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+
+    io_uring_getevents_arg arg = {};
+    arg.ts = reinterpret_cast<std::uintptr_t>(&ts);
+    return uring_enter(fd, to_submit, min_complete,
+        IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+template<typename T>
+static T* ring_field(void* ring, std::uint32_t offset)
+{ return reinterpret_cast<T*>(static_cast<char*>(ring) + offset); }
+
+bool uring_proactor::is_supported() {
+    static const bool is_supported = [] () {
+        io_uring_params params = {};
+        const int fd = uring_setup(4, &params);
+        if(fd == -1)
+            return false; /*ENOSYS, or filtered out by seccomp*/
+
+        ::close(fd);
+        // Timed waits and no dropped completions
+        const unsigned required = IORING_FEAT_EXT_ARG | IORING_FEAT_NODROP;
+        return (params.features & required) == required;
+    }();
+
+    return is_supported;
+}
+
+uring_proactor::uring_proactor(unsigned num_entries)
+    : io_backend()
+    , m_ring_fd(-1)
+    , m_sq_ring(MAP_FAILED)
+    , m_sq_ring_size(0)
+    , m_sq_head(nullptr)
+    , m_sq_tail(nullptr)
+    , m_sq_array(nullptr)
+    , m_sq_mask(0)
+    , m_sq_entries(0)
+    , m_sqes(static_cast<io_uring_sqe*>(MAP_FAILED))
+    , m_sqes_size(0)
+    , m_cq_ring(MAP_FAILED)
+    , m_cq_ring_size(0)
+    , m_cq_head(nullptr)
+    , m_cq_tail(nullptr)
+    , m_cq_mask(0)
+    , m_cqes(nullptr)
+    , m_sq_local_tail(0)
+    , m_is_event_armed(false)
+    , m_num_in_flight(0)
+    , m_descriptors()
+    , m_has_fixed_files(false)
+    , m_free_file_slots()
+    , m_retired_file_slots()
+    , m_buffers()
+{
+    io_uring_params params = {};
+    m_ring_fd = uring_setup(num_entries, &params);
+    if(m_ring_fd == -1)
+        throw std::system_error(last_error(), "io_uring_setup");
+
+    if(!(params.features & IORING_FEAT_EXT_ARG)) {
+        ::close(m_ring_fd);
+        throw std::system_error(
+            std::make_error_code(std::errc::function_not_supported),
+            "io_uring_setup");
+    }
+
+    m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool is_single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if(is_single_mmap)
+        m_sq_ring_size = m_cq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+
+    m_sq_ring = ::mmap(nullptr, m_sq_ring_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQ_RING);
+    if(m_sq_ring != MAP_FAILED) {
+        m_cq_ring = is_single_mmap
+            ? m_sq_ring
+            : ::mmap(nullptr, m_cq_ring_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_CQ_RING);
+    }
+    if(m_cq_ring != MAP_FAILED) {
+        m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        m_sqes = static_cast<io_uring_sqe*>(
+            ::mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQES));
+    }
+    if(m_sqes == MAP_FAILED) {
+        std::error_code ec = last_error();
+        M_unmap();
+        ::close(m_ring_fd);
+        throw std::system_error(ec, "mmap");
+    }
+
+    m_sq_head = ring_field<unsigned>(m_sq_ring, params.sq_off.head);
+    m_sq_tail = ring_field<unsigned>(m_sq_ring, params.sq_off.tail);
+    m_sq_array = ring_field<unsigned>(m_sq_ring, params.sq_off.array);
+    m_sq_mask = *ring_field<unsigned>(m_sq_ring, params.sq_off.ring_mask);
+    m_sq_entries = *ring_field<unsigned>(m_sq_ring, params.sq_off.ring_entries);
+    m_sq_local_tail = *m_sq_tail;
+
+    m_cq_head = ring_field<unsigned>(m_cq_ring, params.cq_off.head);
+    m_cq_tail = ring_field<unsigned>(m_cq_ring, params.cq_off.tail);
+    m_cq_mask = *ring_field<unsigned>(m_cq_ring, params.cq_off.ring_mask);
+    m_cqes = ring_field<io_uring_cqe>(m_cq_ring, params.cq_off.cqes);
+
+    // Sparse table. Descriptors use plain fds, if it is refused
+    std::vector<int> slots(num_file_slots, -1);
+    m_has_fixed_files =
+        uring_register(m_ring_fd, IORING_REGISTER_FILES,
+            slots.data(), num_file_slots) == 0;
+    if(m_has_fixed_files)
+        for(unsigned i = num_file_slots; i-- > 0; )
+            m_free_file_slots.push_back(static_cast<int>(i));
+}
+
+uring_proactor::~uring_proactor() {
+    using namespace concurrency;
+
+    // Waiting operations are dropped, as io_service drops tasks on stop
+    std::vector<invocable> sink;
+    std::vector<std::shared_ptr<detail::descriptor_state>> descriptors;
+    {
+        lock_guard<mutex> lk(m_registry_mutex);
+        descriptors = m_descriptors;
+    }
+    for(std::shared_ptr<detail::descriptor_state>& state : descriptors)
+        deregister_descriptor(descriptor_handle(state), sink);
+    sink.clear();
+
+    if(m_num_in_flight != 0 || m_is_event_armed) {
+        // Operations were cancelled by deregistration
+        if(m_is_event_armed)
+            M_submit_cancel(event_tag);
+
+        // Handlers of cancelled operations are not called
+        while(m_num_in_flight != 0 || m_is_event_armed) {
+            const unsigned to_submit =
+                __atomic_load_n(m_sq_tail, __ATOMIC_ACQUIRE)
+                - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+            const bool is_timed_out =
+                uring_submit_and_wait(m_ring_fd, to_submit, 1, cancel_timeout_ms) == -1
+                && errno == ETIME;
+
+            M_harvest(sink);
+            sink.clear();
+            if(is_timed_out)
+                break; /*not cancellable. Leaked rather than waited for*/
+        }
+    }
+
+    M_unmap();
+    ::close(m_ring_fd);
+}
+
+descriptor_handle uring_proactor::register_descriptor(int fd) {
+    using namespace concurrency;
+
+    const int flags = ::fcntl(fd, F_GETFL);
+    if(flags == -1
+        || (flags & O_NONBLOCK && ::fcntl(fd, F_SETFL, flags & ~O_NONBLOCK) == -1)
+    )
+        throw std::system_error(last_error(), "fcntl");
+
+    struct stat fd_stat;
+    const bool is_stat = ::fstat(fd, &fd_stat) == 0;
+
+    std::shared_ptr<detail::descriptor_state> state =
+        std::make_shared<detail::descriptor_state>(
+            fd, is_stat && S_ISSOCK(fd_stat.st_mode));
+    state->is_pollable = !is_stat || !S_ISREG(fd_stat.st_mode);
+
+    lock_guard<mutex> lk(m_registry_mutex);
+    if(!m_free_file_slots.empty()
+        && M_update_file_slot(m_free_file_slots.back(), fd)
+    ) {
+        state->fixed_index = m_free_file_slots.back();
+        m_free_file_slots.pop_back();
+    }
+
+    m_descriptors.push_back(state);
+    ++m_num_descriptors;
+    return descriptor_handle(std::move(state));
+}
+
+void uring_proactor::deregister_descriptor(
+    const descriptor_handle& handle, std::vector<invocable>& out
+) {
+    using namespace concurrency;
+
+    detail::descriptor_state* state = handle.state();
+    if(!state)
+        return;
+
+    {
+        lock_guard<mutex> lk(state->mutex);
+        if(!state->is_registered)
+            return;
+
+        state->is_registered = false;
+
+        // First operation of stream is in flight. It completes with
+        // operation_canceled, once cancel request reaches it
+        const std::error_code ec =
+            std::make_error_code(std::errc::operation_canceled);
+        for(std::deque<detail::io_op_ptr>* ops :
+                {&state->read_ops, &state->write_ops}
+        ) {
+            for(std::size_t i = 1; i < ops->size(); ++i)
+                out.push_back((*ops)[i]->complete(ec, 0));
+            if(ops->size() > 1)
+                ops->erase(ops->begin() + 1, ops->end());
+        }
+
+        // One by one: cancel of all operations on fd needs Linux 5.19
+        for(std::deque<detail::io_op_ptr>* ops :
+                {&state->read_ops, &state->write_ops}
+        ) {
+            if(!ops->empty())
+                M_submit_cancel(reinterpret_cast<std::uintptr_t>(ops->front().get()));
+        }
+        for(detail::io_op* op : state->positional_ops)
+            M_submit_cancel(reinterpret_cast<std::uintptr_t>(op));
+    }
+
+    {
+        lock_guard<mutex> lk(m_registry_mutex);
+        for(std::size_t i = 0; i < m_descriptors.size(); ++i) {
+            if(m_descriptors[i].get() != state)
+                continue;
+
+            m_descriptors[i] = std::move(m_descriptors.back());
+            m_descriptors.pop_back();
+            --m_num_descriptors;
+            break;
+        }
+
+        if(state->fixed_index >= 0) {
+            M_update_file_slot(state->fixed_index, -1);
+            m_retired_file_slots.push_back(state->fixed_index);
+        }
+    }
+
+    interrupt();
+}
+
+invocable uring_proactor::start_op(
+    const descriptor_handle& handle, detail::io_op_ptr op
+) {
+    using namespace concurrency;
+
+    detail::descriptor_state* state = handle.state();
+    if(!state)
+        return op->complete(std::make_error_code(std::errc::bad_file_descriptor), 0);
+
+    {
+        lock_guard<mutex> lk(state->mutex);
+        if(!state->is_registered)
+            return op->complete(std::make_error_code(std::errc::bad_file_descriptor), 0);
+
+        op->descriptor = handle.shared_state();
+        if(op->is_positional()) {
+            // Owned by ring until completion
+            state->positional_ops.push_back(op.get());
+            M_submit_op(*state, *op.release());
+        } else {
+            std::deque<detail::io_op_ptr>& ops = state->ops_of(*op);
+            ops.push_back(std::move(op));
+            // Otherwise, submitted on completion of previous one
+            if(ops.size() == 1)
+                M_submit_op(*state, *ops.front());
+        }
+    }
+
+    // Owner might be blocked, waiting for earlier completions
+    interrupt();
+    return invocable();
+}
+
+bool uring_proactor::register_buffers(const std::vector<iovec>& buffers) {
+    using namespace concurrency;
+
+    lock_guard<mutex> lk(m_registry_mutex);
+    if(!m_buffers.empty()) {
+        uring_register(m_ring_fd, IORING_UNREGISTER_BUFFERS, nullptr, 0);
+        m_buffers.clear();
+    }
+
+    if(buffers.empty())
+        return true;
+
+    if(uring_register(m_ring_fd, IORING_REGISTER_BUFFERS,
+            buffers.data(), static_cast<unsigned>(buffers.size())) != 0)
+        return false; /*e.g. over RLIMIT_MEMLOCK*/
+
+    m_buffers = buffers;
+    return true;
+}
+
+bool uring_proactor::has_pending_submissions() const {
+    return __atomic_load_n(m_sq_tail, __ATOMIC_ACQUIRE)
+        != __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+}
+
+std::size_t uring_proactor::M_wait_and_perform(
+    int timeout_ms, std::vector<invocable>& out
+) {
+    using namespace concurrency;
+
+    // Armed only before blocking. interrupt() is a no-op otherwise
+    if(timeout_ms != 0 && !m_is_event_armed)
+        M_arm_event_poll();
+
+    std::vector<int> retired;
+    {
+        lock_guard<mutex> lk(m_registry_mutex);
+        retired.swap(m_retired_file_slots);
+    }
+
+    const unsigned tail = __atomic_load_n(m_sq_tail, __ATOMIC_ACQUIRE);
+    const unsigned to_submit = tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    const bool has_completions =
+        __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE) != *m_cq_head;
+
+    // Single syscall submits the whole batch and waits
+    if(timeout_ms != 0 && !has_completions)
+        uring_submit_and_wait(m_ring_fd, to_submit, 1, timeout_ms);
+    else if(to_submit != 0)
+        uring_enter(m_ring_fd, to_submit, 0, 0, nullptr, 0);
+    /*errors (EINTR, ETIME, EBUSY) leave entries for next turn*/
+
+    if(!retired.empty()) {
+        // Entries, which might refer to retired slots, are taken by kernel.
+        // Otherwise, slots wait for next turn
+        const bool is_submitted =
+            static_cast<int>(__atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE) - tail) >= 0;
+
+        lock_guard<mutex> lk(m_registry_mutex);
+        std::vector<int>& dest =
+            is_submitted ? m_free_file_slots : m_retired_file_slots;
+        dest.insert(dest.end(), retired.begin(), retired.end());
+    }
+
+    return M_harvest(out);
+}
+
+void uring_proactor::M_submit_op(detail::descriptor_state& state, detail::io_op& op) {
+    using namespace concurrency;
+
+    int buffer_index = -1;
+    {
+        lock_guard<mutex> lk(m_registry_mutex);
+        buffer_index = M_find_buffer(op.data, op.size);
+    }
+
+    lock_guard<mutex> lk(m_sq_mutex);
+    io_uring_sqe* sqe = M_get_sqe();
+
+    const bool is_read = op.type == detail::io_op::read;
+    if(!is_read && state.is_socket && !op.is_positional()) {
+        sqe->opcode = IORING_OP_SEND;
+        sqe->msg_flags = MSG_NOSIGNAL;
+    } else if(buffer_index >= 0) {
+        sqe->opcode = is_read ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+        sqe->buf_index = static_cast<std::uint16_t>(buffer_index);
+    } else {
+        sqe->opcode = is_read ? IORING_OP_READ : IORING_OP_WRITE;
+    }
+
+    if(state.fixed_index >= 0) {
+        sqe->fd = state.fixed_index;
+        sqe->flags |= IOSQE_FIXED_FILE;
+    } else {
+        sqe->fd = state.fd;
+    }
+
+    sqe->addr = reinterpret_cast<std::uintptr_t>(op.data);
+    sqe->len = static_cast<std::uint32_t>(std::min(op.size, max_transfer_size));
+    // -1 stands for current position
+    sqe->off = op.is_positional()
+        ? static_cast<std::uint64_t>(op.offset) : ~std::uint64_t(0);
+    sqe->user_data = reinterpret_cast<std::uintptr_t>(&op);
+
+    M_commit_sqe();
+    ++m_num_in_flight;
+}
+
+void uring_proactor::M_submit_cancel(std::uint64_t user_data) {
+    using namespace concurrency;
+
+    lock_guard<mutex> lk(m_sq_mutex);
+    io_uring_sqe* sqe = M_get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = user_data;
+    sqe->user_data = ignored_tag;
+    M_commit_sqe();
+}
+
+void uring_proactor::M_arm_event_poll() {
+    using namespace concurrency;
+
+    lock_guard<mutex> lk(m_sq_mutex);
+    io_uring_sqe* sqe = M_get_sqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = M_event_fd();
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = event_tag;
+    M_commit_sqe();
+
+    m_is_event_armed = true;
+}
+
+io_uring_sqe* uring_proactor::M_get_sqe() {
+    for(;;) {
+        const unsigned head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+        const unsigned num_queued = m_sq_local_tail - head;
+        if(num_queued < m_sq_entries)
+            break;
+
+        // Ring is full. Submit from here, rather than wait for owner
+        if(uring_enter(m_ring_fd, num_queued, 0, 0, nullptr, 0) <= 0)
+            std::this_thread::yield(); /*completion ring is overflown*/
+    }
+
+    const unsigned index = m_sq_local_tail & m_sq_mask;
+    io_uring_sqe* sqe = &m_sqes[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    m_sq_array[index] = index;
+    return sqe;
+}
+
+void uring_proactor::M_commit_sqe() {
+    ++m_sq_local_tail;
+    // Entry is filled before kernel can see it
+    __atomic_store_n(m_sq_tail, m_sq_local_tail, __ATOMIC_RELEASE);
+}
+
+std::size_t uring_proactor::M_harvest(std::vector<invocable>& out) {
+    const std::size_t out_size = out.size();
+
+    unsigned head = *m_cq_head;
+    const unsigned tail = __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE);
+    for(; head != tail; ++head) {
+        const io_uring_cqe& cqe = m_cqes[head & m_cq_mask];
+        const std::uint64_t user_data = cqe.user_data;
+        const int result = cqe.res;
+        // Entry is free for kernel, once it is read
+        __atomic_store_n(m_cq_head, head + 1, __ATOMIC_RELEASE);
+
+        M_complete(user_data, result, out);
+    }
+
+    return out.size() - out_size;
+}
+
+void uring_proactor::M_complete(
+    std::uint64_t user_data, int result, std::vector<invocable>& out
+) {
+    using namespace concurrency;
+
+    if(user_data == ignored_tag)
+        return;
+
+    if(user_data == event_tag) {
+        m_is_event_armed = false;
+        M_drain_event_fd();
+        return;
+    }
+
+    detail::io_op* raw_op = reinterpret_cast<detail::io_op*>(user_data);
+    --m_num_in_flight;
+
+    // Destroyed outside of descriptor lock
+    std::shared_ptr<detail::descriptor_state> state = std::move(raw_op->descriptor);
+    detail::io_op_ptr op;
+    bool is_registered = false;
+    {
+        lock_guard<mutex> lk(state->mutex);
+        if(raw_op->is_positional()) {
+            op.reset(raw_op);
+            std::vector<detail::io_op*>& ops = state->positional_ops;
+            ops.erase(std::find(ops.begin(), ops.end(), raw_op));
+        } else {
+            std::deque<detail::io_op_ptr>& ops = state->ops_of(*raw_op);
+            op = std::move(ops.front());
+            ops.pop_front();
+            if(!ops.empty())
+                M_submit_op(*state, *ops.front());
+        }
+        is_registered = state->is_registered;
+    }
+
+    // Operations of deregistered descriptor fail either by cancel,
+    // or by emptied file slot
+    std::error_code ec;
+    if(result < 0)
+        ec = is_registered
+            ? std::error_code(-result, std::system_category())
+            : std::make_error_code(std::errc::operation_canceled);
+
+    out.push_back(
+        op->complete(ec, result < 0 ? 0 : static_cast<std::size_t>(result)));
+}
+
+int uring_proactor::M_find_buffer(const void* data, std::size_t size) const {
+    const char* begin = static_cast<const char*>(data);
+    for(std::size_t i = 0; i < m_buffers.size(); ++i) {
+        const char* buffer = static_cast<const char*>(m_buffers[i].iov_base);
+        if(begin >= buffer
+            && begin + size <= buffer + m_buffers[i].iov_len)
+            return static_cast<int>(i);
+    }
+
+    return -1;
+}
+
+bool uring_proactor::M_update_file_slot(int slot, int fd) {
+    io_uring_files_update update = {};
+    update.offset = static_cast<std::uint32_t>(slot);
+    update.fds = reinterpret_cast<std::uintptr_t>(&fd);
+    return uring_register(m_ring_fd, IORING_REGISTER_FILES_UPDATE, &update, 1) == 1;
+}
+
+void uring_proactor::M_unmap() {
+    if(m_sqes != MAP_FAILED)
+        ::munmap(m_sqes, m_sqes_size);
+    if(m_cq_ring != MAP_FAILED && m_cq_ring != m_sq_ring)
+        ::munmap(m_cq_ring, m_cq_ring_size);
+    if(m_sq_ring != MAP_FAILED)
+        ::munmap(m_sq_ring, m_sq_ring_size);
+}
+
+} // namespace io_service
@@ -0,0 +1,136 @@
+#ifndef ASIO_URING_PROACTOR_HPP
+#define ASIO_URING_PROACTOR_HPP
+
+#include "io_backend.hpp"
+
+#include "mutex.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <system_error>
+#include <vector>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace io_service {
+
+// Completion-based I/O on top of io_uring. Talks to kernel through
+// raw syscalls, without liburing.
+// Operations are queued into submission ring by initiating threads,
+// and submitted in batches by owner, which also harvests completions.
+// Descriptors take slots of registered files table, while there are free
+// ones. Operations on data within registered buffers use fixed buffers.
+// Stream operations of each direction are kept one at a time in flight,
+// so that they complete in order
+class uring_proactor: public io_backend {
+private:
+    int m_ring_fd;
+
+    // Submission ring, shared with kernel
+    void* m_sq_ring;
+    std::size_t m_sq_ring_size;
+    unsigned* m_sq_head;
+    unsigned* m_sq_tail;
+    unsigned* m_sq_array;
+    unsigned m_sq_mask;
+    unsigned m_sq_entries;
+    io_uring_sqe* m_sqes;
+    std::size_t m_sqes_size;
+
+    // Completion ring. Might share mapping with submission ring
+    void* m_cq_ring;
+    std::size_t m_cq_ring_size;
+    unsigned* m_cq_head;
+    unsigned* m_cq_tail;
+    unsigned m_cq_mask;
+    io_uring_cqe* m_cqes;
+
+    // Fills submission ring. Kernel takes entries on io_uring_enter()
+    concurrency::mutex m_sq_mutex;
+    unsigned m_sq_local_tail;
+
+    // Poll of eventfd is in flight. Owner only
+    bool m_is_event_armed;
+    // Operations, whose completions are not harvested yet
+    std::atomic<std::size_t> m_num_in_flight;
+
+    concurrency::mutex m_registry_mutex;
+    std::vector<std::shared_ptr<detail::descriptor_state>> m_descriptors;
+    bool m_has_fixed_files;
+    std::vector<int> m_free_file_slots;
+    // Slots of deregistered descriptors. Reused after owner submits
+    // everything, which might still refer to them
+    std::vector<int> m_retired_file_slots;
+    std::vector<iovec> m_buffers;
+
+public:
+    // Throws std::system_error, if ring can not be set up
+    explicit uring_proactor(unsigned num_entries = 256);
+
+    // Cancels operations in flight and waits for their completions
+    ~uring_proactor();
+
+public:
+    // io_uring is usable in this process: syscalls are not filtered out,
+    // and kernel has features, which proactor needs
+    static bool is_supported();
+
+    io_backend_type type() const override
+    { return io_backend_type::io_uring; }
+
+    // Switches fd to blocking mode: kernel waits for readiness itself.
+    // Throws std::system_error
+    descriptor_handle register_descriptor(int fd) override;
+
+    // Operations in flight are cancelled asynchronously
+    void deregister_descriptor(
+        const descriptor_handle& handle, std::vector<invocable>& out) override;
+
+    // Operation is queued for submission. Never completes right away,
+    // except for unregistered descriptor
+    invocable start_op(
+        const descriptor_handle& handle, detail::io_op_ptr op) override;
+
+    bool register_buffers(const std::vector<iovec>& buffers) override;
+
+    bool has_pending_submissions() const override;
+
+// Impl funcs
+protected:
+    // Submits queued operations, waits for completions up to timeout_ms,
+    // and harvests them
+    std::size_t M_wait_and_perform(
+        int timeout_ms, std::vector<invocable>& out) override;
+
+private:
+    // Prereq: state.mutex - locked
+    void M_submit_op(detail::descriptor_state& state, detail::io_op& op);
+    // Cancels operation, submitted with user_data. Supported since Linux 5.5
+    void M_submit_cancel(std::uint64_t user_data);
+    void M_arm_event_poll();
+
+    // Returns free entry of submission ring. Submits queued ones,
+    // if ring is full. M_commit_sqe() makes it visible to kernel
+    // Prereq: m_sq_mutex - locked
+    io_uring_sqe* M_get_sqe();
+    void M_commit_sqe();
+
+    std::size_t M_harvest(std::vector<invocable>& out);
+    void M_complete(std::uint64_t user_data, int result, std::vector<invocable>& out);
+
+    // Index of registered buffer, which holds [data, data + size). -1 if none
+    // Prereq: m_registry_mutex - locked
+    int M_find_buffer(const void* data, std::size_t size) const;
+
+    // Returns false, if kernel refused update
+    bool M_update_file_slot(int slot, int fd);
+    void M_unmap();
+
+}; // class uring_proactor
+
+} // namespace io_service
+
+#endif // ASIO_URING_PROACTOR_HPP
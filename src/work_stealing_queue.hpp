@@ -0,0 +1,125 @@
+#ifndef ASIO_WORK_STEALING_QUEUE_HPP
+#define ASIO_WORK_STEALING_QUEUE_HPP
+
+#include "helgrind_annotations.hpp"
+
+#include "mutex.hpp"
+#include "lock_guard.hpp"
+
+#include <atomic>
+#include <deque>
+
+namespace io_service {
+
+// Worker-local task queue.
+// Owner pushes and pops, idle peers steal.
+// Both ends keep FIFO order, so that task reposting itself
+// can not starve the ones queued before it
+template<typename T>
+class work_stealing_queue {
+private:
+    std::deque<T> m_queue;
+    // Readable without lock. Lets thieves skip empty queues
+    std::atomic<std::size_t> m_size;
+
+    mutable concurrency::mutex m_mutex;
+
+private:
+    work_stealing_queue(const work_stealing_queue& other) = delete;
+    work_stealing_queue& operator=(const work_stealing_queue& other) = delete;
+
+public:
+    work_stealing_queue()
+        : m_queue()
+        , m_size(0)
+    {}
+
+public:
+    void push(T in_data) {
+        using namespace concurrency;
+        lock_guard<mutex> lk(m_mutex);
+        m_queue.push_back(std::move(in_data));
+        ++m_size;
+    }
+
+    // Pushes elements, constructed from [first, last), under single lock.
+    // Returns number of elements pushed
+    template<typename InputIt>
+    std::size_t push_bulk(InputIt first, InputIt last) {
+        using namespace concurrency;
+        lock_guard<mutex> lk(m_mutex);
+        std::size_t num_pushed = 0;
+        for(; first != last; ++first, ++num_pushed) {
+            m_queue.emplace_back(*first);
+            ++m_size;
+        }
+        return num_pushed;
+    }
+
+    // Used by owner
+    bool try_pop(T& out_data)
+    { return M_try_pop_front(out_data); }
+
+    // Used by other workers
+    bool try_steal(T& out_data)
+    { return M_try_pop_front(out_data); }
+
+public:
+    // Hint only. Might be outdated by the time it is used
+    bool empty() const
+    { return m_size == 0; }
+
+    std::size_t size() const
+    { return m_size; }
+
+    void clear() {
+        using namespace concurrency;
+        std::deque<T> sink;
+        {
+            lock_guard<mutex> lk(m_mutex);
+            m_queue.swap(sink);
+            m_size = 0;
+        }
+        // sink is destroyed outside of lock
+    }
+
+    // Same as clear, but calls on_dropped(const T&) for each element,
+    // outside of lock
+    template<typename Func>
+    void clear(Func on_dropped) {
+        using namespace concurrency;
+        std::deque<T> sink;
+        {
+            lock_guard<mutex> lk(m_mutex);
+            m_queue.swap(sink);
+            m_size = 0;
+        }
+
+        for(const T& data : sink)
+            on_dropped(data);
+    }
+
+// Impl funcs
+private:
+    bool M_try_pop_front(T& out_data) {
+        using namespace concurrency;
+
+        // Do not touch the mutex of empty queue
+        if(empty())
+            return false;
+
+        lock_guard<mutex> lk(m_mutex);
+        if(m_queue.empty())
+            return false;
+
+        out_data = std::move(m_queue.front());
+        m_queue.pop_front();
+        --m_size;
+        return true;
+    }
+
+}; // class work_stealing_queue
+
+} // namespace io_service
+
+#endif // ASIO_WORK_STEALING_QUEUE_HPP
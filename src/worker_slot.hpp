@@ -0,0 +1,72 @@
+#ifndef ASIO_WORKER_SLOT_HPP
+#define ASIO_WORKER_SLOT_HPP
+
+#include "invocable.hpp"
+#include "service_stats.hpp"
+#include "task_trace.hpp"
+#include "work_stealing_queue.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace io_service {
+
+namespace detail {
+
+// Per-worker state, owned by io_service and leased by threads in run().
+// Aligned to cache line, so that workers do not share lines
+struct alignas(64) worker_slot {
+    typedef work_stealing_queue<invocable> local_queue_type;
+
+    local_queue_type local_queue;
+    std::atomic<bool> in_use;
+    std::size_t index;
+    // NUMA node of thread, which leased slot. Read by thieves
+    std::atomic<std::size_t> node;
+
+    // Batch fetched from global queue, before it is moved to local_queue
+    std::vector<invocable> fetch_buffer;
+
+    // Counts fetches. Used to look into global queue from time to time
+    unsigned fetch_tick;
+
+    // Read by stats() of io_service. Kept apart from queue
+    worker_counters counters;
+    // Null, unless service_options::latency_histograms is set
+    std::unique_ptr<task_latency> latency;
+    // Null, unless tracing is enabled
+    std::unique_ptr<trace_ring> trace;
+
+public:
+    worker_slot()
+        : local_queue()
+        , in_use(false)
+        , index(0)
+        , node(0)
+        , fetch_buffer()
+        , fetch_tick(0)
+        , counters()
+        , latency()
+        , trace()
+    {}
+
+public:
+    bool try_acquire() {
+        bool expected = false;
+        return in_use.compare_exchange_strong(expected, true);
+    }
+
+    // Queued tasks stay in local_queue.
+    // They are still stealable, and are inherited by next owner
+    void release()
+    { in_use = false; }
+
+}; // struct worker_slot
+
+} // namespace detail
+
+} // namespace io_service
+
+#endif // ASIO_WORKER_SLOT_HPP
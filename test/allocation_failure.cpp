@@ -0,0 +1,131 @@
+#include "allocation_failure.hpp"
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+
+namespace io_service {
+
+namespace {
+
+thread_local bool is_allocation_failing = false;
+thread_local std::size_t num_allocations = 0;
+
+} // namespace
+
+allocation_failure::allocation_failure()
+    : m_was_failing(std::exchange(is_allocation_failing, true))
+{}
+
+allocation_failure::~allocation_failure()
+{ is_allocation_failing = m_was_failing; }
+
+bool allocation_failure::is_failing()
+{ return is_allocation_failing; }
+
+allocation_counter::allocation_counter()
+    : m_start(num_allocations)
+{}
+
+std::size_t allocation_counter::count() const
+{ return num_allocations - m_start; }
+
+} // namespace io_service
+
+
+// Defined out of line of tests, so that pairs of malloc / free
+// are not inlined into callers. Whole family is replaced, since
+// sanitizers provide their own of each
+void* operator new(std::size_t size) {
+    ++io_service::num_allocations;
+    if(io_service::allocation_failure::is_failing())
+        throw std::bad_alloc();
+
+    if(void* ptr = std::malloc(size == 0 ? 1 : size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{ return ::operator new(size); }
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return ::operator new(size);
+    } catch(const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept
+{ return ::operator new(size, tag); }
+
+void operator delete(void* ptr) noexcept
+{ std::free(ptr); }
+
+void operator delete[](void* ptr) noexcept
+{ std::free(ptr); }
+
+void operator delete(void* ptr, std::size_t) noexcept
+{ std::free(ptr); }
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{ std::free(ptr); }
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{ std::free(ptr); }
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{ std::free(ptr); }
+
+void* operator new(std::size_t size, std::align_val_t align) {
+    ++io_service::num_allocations;
+    if(io_service::allocation_failure::is_failing())
+        throw std::bad_alloc();
+
+    // Size of aligned_alloc is multiple of alignment
+    const std::size_t alignment = static_cast<std::size_t>(align);
+    const std::size_t rounded_size =
+        ((size == 0 ? 1 : size) + alignment - 1) / alignment * alignment;
+    if(void* ptr = std::aligned_alloc(alignment, rounded_size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t align)
+{ return ::operator new(size, align); }
+
+void* operator new(
+    std::size_t size, std::align_val_t align, const std::nothrow_t&
+) noexcept {
+    try {
+        return ::operator new(size, align);
+    } catch(const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void* operator new[](
+    std::size_t size, std::align_val_t align, const std::nothrow_t& tag
+) noexcept
+{ return ::operator new(size, align, tag); }
+
+void operator delete(void* ptr, std::align_val_t) noexcept
+{ std::free(ptr); }
+
+void operator delete[](void* ptr, std::align_val_t) noexcept
+{ std::free(ptr); }
+
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept
+{ std::free(ptr); }
+
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept
+{ std::free(ptr); }
+
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept
+{ std::free(ptr); }
+
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept
+{ std::free(ptr); }
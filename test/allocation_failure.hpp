@@ -0,0 +1,41 @@
+#ifndef ASIO_TEST_ALLOCATION_FAILURE_HPP
+#define ASIO_TEST_ALLOCATION_FAILURE_HPP
+
+#include <cstddef>
+
+namespace io_service {
+
+// While alive, operator new of calling thread throws std::bad_alloc.
+// operator new of test binary is replaced in allocation_failure.cpp
+class allocation_failure {
+private:
+    bool m_was_failing;
+
+private:
+    allocation_failure(const allocation_failure& other) = delete;
+    allocation_failure& operator=(const allocation_failure& other) = delete;
+
+public:
+    allocation_failure();
+    ~allocation_failure();
+
+    static bool is_failing();
+
+}; // class allocation_failure
+
+// Counts calls of operator new (aligned ones included) by calling thread,
+// since counter was constructed
+class allocation_counter {
+private:
+    std::size_t m_start;
+
+public:
+    allocation_counter();
+
+    std::size_t count() const;
+
+}; // class allocation_counter
+
+} // namespace io_service
+
+#endif // ASIO_TEST_ALLOCATION_FAILURE_HPP
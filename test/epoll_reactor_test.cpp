@@ -0,0 +1,293 @@
+#include <catch2/catch_all.hpp>
+#include <atomic>
+#include <cstring>
+#include <future>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "io_service.hpp"
+
+#include "jthread.hpp"
+
+
+namespace io_service {
+
+namespace {
+
+void run_worker(io_service* serv_ptr) {
+    try {
+        serv_ptr->run();
+    } catch(const service_stopped_error&) {}
+}
+
+struct io_result {
+    std::error_code ec;
+    std::size_t bytes;
+};
+
+// Completion handler, which fulfils promise
+struct promise_handler {
+    std::shared_ptr<std::promise<io_result>> prom;
+
+    void operator()(std::error_code ec, std::size_t bytes)
+    { prom->set_value(io_result{ec, bytes}); }
+};
+
+std::future<io_result> make_handler(promise_handler& handler) {
+    handler.prom = std::make_shared<std::promise<io_result>>();
+    return handler.prom->get_future();
+}
+
+} // namespace
+
+TEST_CASE("epoll_reactor: pipe", "[io_service][reactor]") {
+    int fds[2];
+    REQUIRE(::pipe(fds) == 0);
+
+    io_service serv;
+    descriptor_handle read_end = serv.register_descriptor(fds[0]);
+    descriptor_handle write_end = serv.register_descriptor(fds[1]);
+
+    std::vector<concurrency::jthread> threads;
+    for(int i = 0; i < 2; ++i)
+        threads.emplace_back(run_worker, &serv);
+
+    SECTION("read completes, once data arrives") {
+        char buf[16] = {};
+        promise_handler handler;
+        std::future<io_result> fut = make_handler(handler);
+        serv.async_read_some(read_end, buf, sizeof(buf), handler);
+
+        // Queued until data is written
+        REQUIRE(fut.wait_for(std::chrono::milliseconds(20))
+            == std::future_status::timeout);
+
+        promise_handler write_handler;
+        std::future<io_result> write_fut = make_handler(write_handler);
+        serv.async_write_some(write_end, "hello", 5, write_handler);
+        REQUIRE(write_fut.get().bytes == 5);
+
+        io_result res = fut.get();
+        REQUIRE(!res.ec);
+        REQUIRE(res.bytes == 5);
+        REQUIRE(std::string(buf, 5) == "hello");
+    }
+
+    SECTION("end of file") {
+        serv.deregister_descriptor(write_end);
+        ::close(fds[1]);
+        fds[1] = -1;
+
+        char buf[16];
+        promise_handler handler;
+        std::future<io_result> fut = make_handler(handler);
+        serv.async_read_some(read_end, buf, sizeof(buf), handler);
+
+        io_result res = fut.get();
+        REQUIRE(!res.ec);
+        REQUIRE(res.bytes == 0);
+    }
+
+    SECTION("deregister cancels pending read") {
+        char buf[16];
+        promise_handler handler;
+        std::future<io_result> fut = make_handler(handler);
+        serv.async_read_some(read_end, buf, sizeof(buf), handler);
+        serv.deregister_descriptor(read_end);
+
+        REQUIRE(fut.get().ec == std::errc::operation_canceled);
+
+        promise_handler after_handler;
+        std::future<io_result> after_fut = make_handler(after_handler);
+        serv.async_read_some(read_end, buf, sizeof(buf), after_handler);
+        REQUIRE(after_fut.get().ec == std::errc::bad_file_descriptor);
+    }
+
+    serv.stop();
+    ::close(fds[0]);
+    if(fds[1] != -1)
+        ::close(fds[1]);
+}
+
+TEST_CASE("epoll_reactor: socketpair echo", "[io_service][reactor]") {
+    const int num_messages = 200;
+    const int num_threads = 4;
+
+    int fds[2];
+    REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+    io_service serv;
+    descriptor_handle client = serv.register_descriptor(fds[0]);
+    descriptor_handle server = serv.register_descriptor(fds[1]);
+
+    std::vector<concurrency::jthread> threads;
+    for(int i = 0; i < num_threads; ++i)
+        threads.emplace_back(run_worker, &serv);
+
+    // Server echoes everything back, chaining reads from handlers
+    char server_buf[64];
+    std::function<void(std::error_code, std::size_t)> on_server_read =
+        [&] (std::error_code ec, std::size_t bytes) {
+            if(ec || bytes == 0)
+                return;
+
+            // Writes of socketpair with free space are not partial
+            serv.async_write_some(server, server_buf, bytes,
+                [&] (std::error_code, std::size_t) {
+                    serv.async_read_some(
+                        server, server_buf, sizeof(server_buf), on_server_read);
+                });
+        };
+    serv.async_read_some(server, server_buf, sizeof(server_buf), on_server_read);
+
+    for(int i = 0; i < num_messages; ++i) {
+        const std::string msg = "message " + std::to_string(i);
+
+        promise_handler write_handler;
+        std::future<io_result> write_fut = make_handler(write_handler);
+        serv.async_write_some(client, msg.data(), msg.size(), write_handler);
+        REQUIRE(write_fut.get().bytes == msg.size());
+
+        std::string echoed;
+        while(echoed.size() < msg.size()) {
+            char buf[64];
+            promise_handler read_handler;
+            std::future<io_result> read_fut = make_handler(read_handler);
+            serv.async_read_some(client, buf, sizeof(buf), read_handler);
+
+            io_result res = read_fut.get();
+            REQUIRE(!res.ec);
+            echoed.append(buf, res.bytes);
+        }
+
+        REQUIRE(echoed == msg);
+    }
+
+    serv.deregister_descriptor(server);
+    serv.deregister_descriptor(client);
+    serv.stop();
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+TEST_CASE("epoll_reactor: regular file", "[io_service][reactor]") {
+    char path[] = "/tmp/io_service_epoll_XXXXXX";
+    int fd = ::mkstemp(path);
+    REQUIRE(fd != -1);
+    ::unlink(path);
+
+    io_service serv;
+    REQUIRE(serv.backend_type() == io_backend_type::epoll);
+    // Not pollable. Done right away, instead of waiting for readiness
+    descriptor_handle handle = serv.register_descriptor(fd);
+    concurrency::jthread worker(run_worker, &serv);
+
+    promise_handler handler;
+    std::future<io_result> fut = make_handler(handler);
+    serv.async_write_at(handle, 100, "tail", 4, handler);
+    REQUIRE(fut.get().bytes == 4);
+
+    char buf[8] = {};
+    fut = make_handler(handler);
+    serv.async_read_at(handle, 100, buf, sizeof(buf), handler);
+    io_result res = fut.get();
+    REQUIRE(!res.ec);
+    REQUIRE(res.bytes == 4);
+    REQUIRE(std::string(buf, 4) == "tail");
+
+    // Registered buffers are io_uring only
+    REQUIRE(!serv.register_buffers({iovec{buf, sizeof(buf)}}));
+
+    serv.deregister_descriptor(handle);
+    serv.stop();
+    ::close(fd);
+}
+
+TEST_CASE("epoll_reactor: poll without workers", "[io_service][reactor][run]") {
+    int fds[2];
+    REQUIRE(::pipe(fds) == 0);
+
+    io_service serv;
+    descriptor_handle read_end = serv.register_descriptor(fds[0]);
+
+    std::atomic<std::size_t> bytes_read(0);
+    char buf[8] = {};
+    serv.async_read_some(read_end, buf, sizeof(buf),
+        [&bytes_read] (std::error_code ec, std::size_t bytes) {
+            if(!ec)
+                bytes_read = bytes;
+        });
+
+    // Nothing to read. poll() does not wait for it
+    REQUIRE(serv.poll() == 0);
+
+    REQUIRE(::write(fds[1], "ping", 4) == 4);
+    REQUIRE(serv.poll() == 1);
+    REQUIRE(bytes_read == 4);
+
+    serv.deregister_descriptor(read_end);
+    serv.stop();
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+TEST_CASE("epoll_reactor: unix domain socket", "[io_service][reactor]") {
+    const std::string path =
+        "/tmp/io_service_test_" + std::to_string(::getpid()) + ".sock";
+    ::unlink(path.c_str());
+
+    sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    int listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    REQUIRE(listen_fd != -1);
+    REQUIRE(::bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+    REQUIRE(::listen(listen_fd, 1) == 0);
+
+    int client_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    REQUIRE(::connect(client_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+    int server_fd = ::accept(listen_fd, nullptr, nullptr);
+    REQUIRE(server_fd != -1);
+
+    io_service serv;
+    descriptor_handle server = serv.register_descriptor(server_fd);
+
+    // Single worker, which blocks in epoll_wait
+    concurrency::jthread worker(run_worker, &serv);
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    char buf[16] = {};
+    promise_handler handler;
+    std::future<io_result> fut = make_handler(handler);
+    serv.async_read_some(server, buf, sizeof(buf), handler);
+
+    REQUIRE(::write(client_fd, "ping", 4) == 4);
+    io_result res = fut.get();
+    REQUIRE(res.bytes == 4);
+    REQUIRE(std::string(buf, 4) == "ping");
+
+    // Worker in epoll_wait is interrupted by post
+    std::promise<void> posted;
+    serv.post([&posted] () { posted.set_value(); });
+    REQUIRE(posted.get_future().wait_for(std::chrono::seconds(5))
+        == std::future_status::ready);
+
+    // ...and by stop()
+    serv.stop();
+    serv.deregister_descriptor(server);
+
+    ::close(server_fd);
+    ::close(client_fd);
+    ::close(listen_fd);
+    ::unlink(path.c_str());
+}
+
+} // namespace io_service
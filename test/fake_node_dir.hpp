@@ -0,0 +1,38 @@
+#ifndef ASIO_TEST_FAKE_NODE_DIR_HPP
+#define ASIO_TEST_FAKE_NODE_DIR_HPP
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+
+#include <unistd.h> // getpid
+
+namespace io_service {
+
+// Directory laid out as /sys/devices/system/node. Removed on destruction
+struct fake_node_dir {
+    std::filesystem::path root;
+
+    explicit fake_node_dir(const std::string& name)
+        : root(std::filesystem::temp_directory_path()
+            / (name + "-" + std::to_string(getpid())))
+    {
+        std::filesystem::remove_all(root);
+        std::filesystem::create_directories(root);
+    }
+
+    ~fake_node_dir() {
+        std::error_code ec;
+        std::filesystem::remove_all(root, ec);
+    }
+
+    void add_node(const std::string& dir_name, const std::string& cpulist) {
+        std::filesystem::create_directories(root / dir_name);
+        std::ofstream(root / dir_name / "cpulist") << cpulist << '\n';
+    }
+};
+
+} // namespace io_service
+
+#endif // ASIO_TEST_FAKE_NODE_DIR_HPP
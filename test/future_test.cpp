@@ -0,0 +1,220 @@
+#include <catch2/catch_all.hpp>
+
+#include <atomic>
+#include <future> // std::future_error
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "io_service.hpp"
+#include "future.hpp"
+
+#include "jthread.hpp"
+
+
+namespace io_service {
+
+namespace {
+
+void run_worker(io_service* serv) {
+    try {
+        serv->run();
+    } catch(const service_stopped_error&) {}
+}
+
+// Sum of [first, last), split in halves down to grain.
+// Workers never wait for halves: sum is joined by continuation
+future<long> parallel_sum(io_service& serv, long first, long last) {
+    const long grain = 1000;
+    if(last - first <= grain)
+        return serv.post_async(
+            [first, last] () {
+                long sum = 0;
+                for(long i = first; i < last; ++i)
+                    sum += i;
+                return sum;
+            });
+
+    const long middle = first + (last - first) / 2;
+    std::vector<future<long>> halves;
+    halves.push_back(parallel_sum(serv, first, middle));
+    halves.push_back(parallel_sum(serv, middle, last));
+    return when_all(std::move(halves)).then(
+        [] (std::vector<long> sums) { return sums[0] + sums[1]; });
+}
+
+} // namespace
+
+TEST_CASE("future: promise sets value", "[future]") {
+    io_service serv;
+
+    promise<int> prom(serv);
+    future<int> fut = prom.get_future();
+    REQUIRE_THROWS_AS(prom.get_future(), std::future_error);
+    REQUIRE(fut.valid());
+    REQUIRE_FALSE(fut.is_ready());
+
+    prom.set_value(42);
+    REQUIRE_THROWS_AS(prom.set_value(1), std::future_error);
+    REQUIRE(fut.is_ready());
+    REQUIRE(fut.get() == 42);
+    REQUIRE_FALSE(fut.valid());
+
+    SECTION("exception") {
+        promise<void> prom_void(serv);
+        future<void> fut_void = prom_void.get_future();
+        prom_void.set_exception(std::make_exception_ptr(std::runtime_error("fail")));
+        REQUIRE_THROWS_AS(fut_void.get(), std::runtime_error);
+    }
+
+    SECTION("broken promise") {
+        future<std::string> fut_str;
+        {
+            promise<std::string> prom_str(serv);
+            fut_str = prom_str.get_future();
+        }
+        REQUIRE_THROWS_AS(fut_str.get(), std::future_error);
+    }
+
+    SECTION("get waits for other thread") {
+        promise<int> prom_int(serv);
+        future<int> fut_int = prom_int.get_future();
+        concurrency::jthread producer(
+            [&prom_int] () {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                prom_int.set_value(7);
+            });
+        REQUIRE(fut_int.get() == 7);
+    }
+}
+
+TEST_CASE("future: then", "[future]") {
+    io_service serv;
+
+    SECTION("runs inline, if result is ready") {
+        promise<int> prom(serv);
+        future<int> fut = prom.get_future();
+        prom.set_value(20);
+
+        bool is_run = false;
+        future<int> next = fut.then(
+            [&is_run] (int value) { is_run = true; return value + 1; });
+        REQUIRE(is_run);
+        REQUIRE_FALSE(fut.valid());
+        REQUIRE(next.get() == 21);
+    }
+
+    SECTION("is posted, once result is set") {
+        promise<int> prom(serv);
+        future<void> next = prom.get_future().then([] (int) {});
+
+        prom.set_value(1);
+        REQUIRE_FALSE(next.is_ready());
+        REQUIRE(serv.run_one() == 1);
+        REQUIRE(next.is_ready());
+        next.get();
+    }
+
+    SECTION("exception skips continuation") {
+        promise<int> prom(serv);
+        bool is_run = false;
+        future<int> next = prom.get_future()
+            .then([] (int) -> int { throw std::runtime_error("fail"); })
+            .then([&is_run] (int value) { is_run = true; return value; });
+
+        prom.set_value(1);
+        serv.poll();
+        REQUIRE_FALSE(is_run);
+        REQUIRE_THROWS_AS(next.get(), std::runtime_error);
+    }
+
+    SECTION("continuation dropped by stop breaks promise") {
+        promise<int> prom(serv);
+        future<int> next = prom.get_future().then([] (int value) { return value; });
+
+        serv.stop();
+        prom.set_value(1);
+        REQUIRE_THROWS_AS(next.get(), std::future_error);
+    }
+}
+
+TEST_CASE("io_service: post_async", "[io_service][future]") {
+    const int num_threads = 4;
+
+    io_service serv;
+    std::vector<concurrency::jthread> threads;
+    for(int i = 0; i < num_threads; ++i)
+        threads.emplace_back(run_worker, &serv);
+
+    SECTION("chain of continuations") {
+        future<std::string> fut =
+            serv.post_async([] (int value) { return value * 2; }, 21)
+                .then([] (int value) { return std::to_string(value); })
+                .then([] (std::string str) { return str + "!"; });
+        REQUIRE(fut.get() == "42!");
+
+        future<int> from_worker =
+            serv.post_async(
+                [&serv] () { return serv.dispatch_async([] () { return 5; }); })
+                .get();
+        REQUIRE(from_worker.is_ready());
+        REQUIRE(from_worker.get() == 5);
+    }
+
+    SECTION("when_all") {
+        std::vector<future<int>> futs;
+        for(int i = 0; i < 100; ++i)
+            futs.push_back(serv.post_async([i] () { return i; }));
+
+        std::vector<int> values = when_all(std::move(futs)).get();
+        REQUIRE(values.size() == 100);
+        for(int i = 0; i < 100; ++i)
+            REQUIRE(values[i] == i);
+
+        std::vector<future<void>> failing;
+        failing.push_back(serv.post_async([] () {}));
+        failing.push_back(serv.post_async([] () { throw std::runtime_error("fail"); }));
+        REQUIRE_THROWS_AS(when_all(std::move(failing)).get(), std::runtime_error);
+
+        REQUIRE(when_all(std::vector<future<int>>()).get().empty());
+    }
+
+    SECTION("when_any") {
+        promise<int> never(serv);
+        std::vector<future<int>> futs;
+        futs.push_back(never.get_future());
+        futs.push_back(serv.post_async([] () { return 7; }));
+
+        when_any_result<int> first = when_any(std::move(futs)).get();
+        REQUIRE(first.index == 1);
+        REQUIRE(first.value == 7);
+
+        REQUIRE_THROWS_AS(when_any(std::vector<future<int>>()), std::invalid_argument);
+        never.set_value(0);
+    }
+
+    SECTION("fan-out / fan-in without blocking workers") {
+        const long num = 1000000;
+        REQUIRE(parallel_sum(serv, 0, num).get() == num * (num - 1) / 2);
+    }
+
+    SECTION("producers race continuations") {
+        const int num_rounds = 10000;
+        std::atomic<int> num_done(0);
+        for(int i = 0; i < num_rounds; ++i) {
+            promise<int> prom(serv);
+            future<int> fut = prom.get_future();
+            serv.post([prom = std::move(prom), i] () mutable { prom.set_value(i); });
+            fut.then([&num_done] (int) { ++num_done; });
+        }
+
+        while(num_done < num_rounds)
+            std::this_thread::yield();
+    }
+
+    serv.stop();
+}
+
+} // namespace io_service
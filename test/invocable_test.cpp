@@ -3,6 +3,10 @@
 
 #include "invocable.hpp"
 
+#include <array>
+#include <memory>
+#include <stdexcept>
+
 namespace io_service {
 
 TEST_CASE("invocable cstr & call") {
@@ -85,4 +89,133 @@ TEST_CASE("make_invocable") {
     }
 }
 
+TEST_CASE("invocable of plain callable", "[invocable]") {
+    int result = 0;
+    auto func = [&result] (int a, int b) {
+        result = a + b;
+    };
+
+    invocable inv(func, 40, 2);
+    REQUIRE(inv.is_inline());
+
+    inv();
+    REQUIRE(result == 42);
+    REQUIRE(inv.empty());
+
+    // Exception leaves call, invocable is still erased
+    invocable throwing_inv(
+        [] () { throw std::runtime_error("task failed"); });
+    REQUIRE_THROWS_AS(throwing_inv(), std::runtime_error);
+    REQUIRE(throwing_inv.empty());
+}
+
+TEST_CASE("invocable with move-only args", "[invocable]") {
+    std::unique_ptr<int> buffer = std::make_unique<int>(42);
+    std::packaged_task<int(std::unique_ptr<int>)> task(
+        [] (std::unique_ptr<int> buf) -> int { return *buf; });
+    std::future<int> fut = task.get_future();
+
+    invocable inv(std::move(task), std::move(buffer));
+    REQUIRE(buffer == nullptr);
+
+    invocable moved_inv(std::move(inv));
+    moved_inv();
+    REQUIRE(fut.get() == 42);
+}
+
+TEST_CASE("invocable inline storage", "[invocable]") {
+    const int var1 = 12;
+    const int var2 = 30;
+
+    SECTION("small callable is stored inline") {
+        int* ptr1 = nullptr;
+        int* ptr2 = nullptr;
+        std::packaged_task<int()> task(
+            [ptr1, ptr2, var1, var2] () -> int {
+                return (ptr1 == ptr2) ? var1 + var2 : 0;
+            });
+        std::future<int> fut = task.get_future();
+
+        invocable inv(std::move(task));
+        REQUIRE(inv.is_inline());
+        REQUIRE(inv.footprint() == sizeof(invocable));
+
+        invocable moved_inv(std::move(inv));
+        REQUIRE(inv.empty());
+        REQUIRE(moved_inv.is_inline());
+
+        moved_inv();
+        REQUIRE(moved_inv.empty());
+        REQUIRE(fut.get() == var1 + var2);
+    }
+
+    SECTION("large args are stored on heap") {
+        typedef std::array<char, invocable::inline_size + 1> big_arg;
+        big_arg arg;
+        arg.fill(1);
+
+        std::packaged_task<int(big_arg)> task(
+            [] (big_arg in_arg) -> int {
+                int sum = 0;
+                for(char val : in_arg)
+                    sum += val;
+                return sum;
+            });
+        std::future<int> fut = task.get_future();
+
+        invocable inv(std::move(task), arg);
+        REQUIRE(!inv.is_inline());
+        REQUIRE(!inv.empty());
+        REQUIRE(inv.footprint() > sizeof(invocable) + sizeof(big_arg));
+        REQUIRE(inv.footprint()
+            == invocable::footprint_of<std::packaged_task<int(big_arg)>, big_arg>());
+
+        invocable moved_inv;
+        moved_inv = std::move(inv);
+        REQUIRE(inv.empty());
+
+        moved_inv();
+        REQUIRE(fut.get() == int(arg.size()));
+    }
+
+    SECTION("swap of inline and heap invocables") {
+        std::shared_ptr<int> counter = std::make_shared<int>(var1);
+        typedef std::array<char, invocable::inline_size + 1> big_arg;
+
+        std::packaged_task<int(std::shared_ptr<int>)> small_task(
+            [] (std::shared_ptr<int> ptr) -> int { return *ptr; });
+        std::packaged_task<int(big_arg)> big_task(
+            [var2] (big_arg) -> int { return var2; });
+        std::future<int> small_fut = small_task.get_future();
+        std::future<int> big_fut = big_task.get_future();
+
+        invocable small_inv(std::move(small_task), counter);
+        invocable big_inv(std::move(big_task), big_arg());
+        REQUIRE(counter.use_count() == 2);
+
+        swap(small_inv, big_inv);
+        REQUIRE(!small_inv.is_inline());
+        REQUIRE(big_inv.is_inline());
+        REQUIRE(counter.use_count() == 2);
+
+        small_inv();
+        big_inv();
+        REQUIRE(small_fut.get() == var1);
+        REQUIRE(big_fut.get() == var2);
+        // bound args are released after call
+        REQUIRE(counter.use_count() == 1);
+    }
+
+    SECTION("destruction without call releases args") {
+        std::shared_ptr<int> counter = std::make_shared<int>(var1);
+        std::packaged_task<void(std::shared_ptr<int>)> task(
+            [] (std::shared_ptr<int>) {});
+        {
+            invocable inv(std::move(task), counter);
+            REQUIRE(counter.use_count() == 2);
+        }
+        REQUIRE(counter.use_count() == 1);
+    }
+}
+
 } // namespace io_service
@@ -1,19 +1,33 @@
 #include "helgrind_annotations.hpp"
 #include <catch2/catch_all.hpp>
 
+#include <algorithm>
+#include <array>
+#include <functional>
 #include <future>
 #include <iostream> // std::cerr
 
 #include <list>
+#include <memory>
+#include <new> // std::bad_alloc
+#include <optional>
+#include <sstream>
 #include <stdexcept>
+#include <string>
 #include <thread>
 #include <chrono>
 
+#include <pthread.h>
+#include <sched.h> // cpu_set_t
+
 #include "io_service.hpp"
 
 #include "jthread.hpp"
 #include "shared_ptr.hpp"
 
+#include "allocation_failure.hpp"
+#include "fake_node_dir.hpp"
+
 
 namespace io_service {
 
@@ -296,6 +310,1115 @@ TEST_CASE("io_service: dispatch into own and foreign task pool", "[io_service][d
     }
 }
 
+TEST_CASE("io_service: post from inside the pool", "[io_service][local_queue]") {
+    const int num_threads = 8;
+    const int num_tasks = 50;
+    const int num_subtasks = 20;
+
+    io_service serv;
+    std::atomic<int> subtasks_done(0);
+
+    for(int i = 0; i < num_tasks; ++i)
+        serv.post(
+            [&serv, &subtasks_done, num_subtasks] () {
+                // Goes to local queue of worker
+                for(int sub_idx = 0; sub_idx < num_subtasks; ++sub_idx)
+                    serv.post([&subtasks_done] () { ++subtasks_done; });
+            });
+
+    std::vector<concurrency::jthread> threads;
+    for(int i = 0; i < num_threads; ++i)
+        threads.emplace_back(worker_func, &serv);
+
+    while(subtasks_done < num_tasks * num_subtasks)
+        std::this_thread::yield();
+
+    serv.stop();
+    REQUIRE(subtasks_done == num_tasks * num_subtasks);
+}
+
+TEST_CASE("io_service: local task is stolen by idle worker", "[io_service][local_queue]") {
+    const int num_threads = 2;
+    const int answer = 42;
+
+    io_service serv;
+    std::vector<concurrency::jthread> threads;
+    for(int i = 0; i < num_threads; ++i)
+        threads.emplace_back(worker_func, &serv);
+
+    // Outer task blocks on its own local task,
+    // so only the other worker can run it
+    std::future<int> outer_fut = serv.post_waitable(
+        [&serv, answer] () -> int {
+            std::future<int> inner_fut =
+                serv.post_waitable([answer] () -> int { return answer; });
+            return inner_fut.get();
+        });
+
+    REQUIRE(outer_fut.get() == answer);
+    serv.stop();
+}
+
+TEST_CASE("io_service: exception escaped from task", "[io_service][exception]") {
+    const int num_threads = 2;
+    const int num_tasks = 10;
+
+    std::atomic<int> tasks_done(0);
+    auto throwing_task =
+        [] () { throw std::runtime_error("task failed"); };
+    auto counting_task =
+        [&tasks_done] () { ++tasks_done; };
+
+    SECTION("discard") {
+        io_service serv;
+        for(int i = 0; i < num_tasks; ++i) {
+            serv.post(throwing_task);
+            serv.post(counting_task);
+        }
+
+        std::vector<concurrency::jthread> threads;
+        for(int i = 0; i < num_threads; ++i)
+            threads.emplace_back(worker_func, &serv);
+
+        while(tasks_done < num_tasks)
+            std::this_thread::yield();
+        serv.stop();
+    }
+
+    SECTION("handler") {
+        std::atomic<int> exceptions_handled(0);
+
+        service_options options;
+        options.on_task_exception = exception_policy::handler;
+        options.exception_handler =
+            [&exceptions_handled] (std::exception_ptr ex_ptr) {
+                try {
+                    std::rethrow_exception(ex_ptr);
+                } catch(const std::runtime_error& e) {
+                    ++exceptions_handled;
+                }
+            };
+
+        io_service serv(options);
+        std::vector<concurrency::jthread> threads;
+        for(int i = 0; i < num_threads; ++i)
+            threads.emplace_back(worker_func, &serv);
+
+        for(int i = 0; i < num_tasks; ++i) {
+            serv.post(throwing_task);
+            serv.post(counting_task);
+        }
+
+        while(tasks_done < num_tasks || exceptions_handled < num_tasks)
+            std::this_thread::yield();
+        serv.stop();
+        REQUIRE(exceptions_handled == num_tasks);
+    }
+
+    SECTION("rethrow from run()") {
+        service_options options;
+        options.on_task_exception = exception_policy::rethrow;
+
+        io_service serv(options);
+        serv.post(counting_task);
+        serv.post(throwing_task);
+
+        // Single thread executes tasks in order
+        REQUIRE_THROWS_AS(serv.run(), std::runtime_error);
+        REQUIRE(tasks_done == 1);
+        serv.stop();
+    }
+}
+
+namespace {
+
+// Counts copies made of it on the way to worker
+struct copy_counter {
+    std::shared_ptr<std::atomic<int>> copies;
+
+    copy_counter()
+        : copies(std::make_shared<std::atomic<int>>(0))
+    {}
+
+    copy_counter(const copy_counter& other)
+        : copies(other.copies)
+    { ++*copies; }
+
+    copy_counter(copy_counter&& other) noexcept = default;
+    copy_counter& operator=(const copy_counter& other) = delete;
+};
+
+} // namespace
+
+TEST_CASE("io_service: forwarding of args", "[io_service][forwarding]") {
+    io_service serv;
+    std::atomic<int> tasks_done(0);
+
+    SECTION("move-only args") {
+        std::unique_ptr<int> buffer = std::make_unique<int>(42);
+        std::unique_ptr<int> waitable_buffer = std::make_unique<int>(24);
+
+        serv.post(
+            [&tasks_done] (std::unique_ptr<int> buf) {
+                if(*buf == 42)
+                    ++tasks_done;
+            },
+            std::move(buffer));
+
+        std::future<int> fut = serv.post_waitable(
+            [] (std::unique_ptr<int> buf) -> int { return *buf; },
+            std::move(waitable_buffer));
+
+        // Move-only callable
+        std::unique_ptr<int> captured = std::make_unique<int>(1);
+        serv.post(
+            [&tasks_done, captured = std::move(captured)] () {
+                tasks_done += *captured;
+            });
+
+        serv.run_pending_task();
+        serv.run_pending_task();
+        serv.run_pending_task();
+
+        REQUIRE(tasks_done == 2);
+        REQUIRE(fut.get() == 24);
+    }
+
+    SECTION("rvalues are not copied") {
+        copy_counter counter;
+        std::shared_ptr<std::atomic<int>> copies = counter.copies;
+
+        serv.post([] (copy_counter) {}, std::move(counter));
+        serv.post_waitable([] (copy_counter) {}, copy_counter());
+        serv.run_pending_task();
+        serv.run_pending_task();
+
+        REQUIRE(*copies == 0);
+    }
+
+    SECTION("lvalues are copied once") {
+        copy_counter counter;
+
+        serv.post([] (const copy_counter&) {}, counter);
+        serv.run_pending_task();
+
+        REQUIRE(*counter.copies == 1);
+    }
+
+    serv.stop();
+}
+
+TEST_CASE("io_service: bulk post", "[io_service][bulk]") {
+    const int num_threads = 4;
+    const int num_tasks = 1000;
+
+    io_service serv;
+    std::atomic<int> tasks_done(0);
+
+    std::vector<concurrency::jthread> threads;
+    for(int i = 0; i < num_threads; ++i)
+        threads.emplace_back(worker_func, &serv);
+
+    SECTION("fire-and-forget") {
+        std::vector<std::function<void()>> tasks(
+            num_tasks, [&tasks_done] () { ++tasks_done; });
+
+        serv.post_bulk(tasks);
+
+        while(tasks_done < num_tasks)
+            std::this_thread::yield();
+    }
+
+    SECTION("waitable") {
+        std::vector<std::function<int()>> tasks;
+        for(int i = 0; i < num_tasks; ++i)
+            tasks.push_back([i] () -> int { return i; });
+
+        std::vector<std::future<int>> futs =
+            serv.post_bulk_waitable(
+                std::make_move_iterator(tasks.begin()),
+                std::make_move_iterator(tasks.end()));
+
+        REQUIRE(futs.size() == num_tasks);
+        for(int i = 0; i < num_tasks; ++i)
+            REQUIRE(futs[i].get() == i);
+    }
+
+    SECTION("from inside the pool") {
+        serv.post(
+            [&serv, &tasks_done, num_tasks] () {
+                std::vector<std::function<void()>> tasks(
+                    num_tasks, [&tasks_done] () { ++tasks_done; });
+                serv.post_bulk(tasks.begin(), tasks.end());
+            });
+
+        while(tasks_done < num_tasks)
+            std::this_thread::yield();
+    }
+
+    serv.stop();
+}
+
+TEST_CASE("io_service: batched fetch keeps tasks stealable", "[io_service][batch]") {
+    const int num_threads = 4;
+
+    service_options options;
+    options.fetch_batch_size = num_threads;
+    io_service serv(options);
+
+    // Each task waits until all of them started.
+    // Worker, which fetched whole batch, can not run them alone
+    std::atomic<int> tasks_started(0);
+    for(int i = 0; i < num_threads; ++i)
+        serv.post(
+            [&tasks_started, num_threads] () {
+                ++tasks_started;
+                while(tasks_started < num_threads)
+                    std::this_thread::yield();
+            });
+
+    std::vector<concurrency::jthread> threads;
+    for(int i = 0; i < num_threads; ++i)
+        threads.emplace_back(worker_func, &serv);
+
+    while(tasks_started < num_threads)
+        std::this_thread::yield();
+
+    serv.stop();
+    REQUIRE(tasks_started == num_threads);
+}
+
+TEST_CASE("io_service: batch survives failed push to local queue", "[io_service][batch]") {
+    const int num_tasks = 16;
+
+    service_options options;
+    options.fetch_batch_size = num_tasks;
+    io_service serv(options);
+
+    std::atomic<int> tasks_done(0);
+    std::optional<allocation_failure> failure;
+    serv.post(
+        [&] () {
+            {
+                // Posted from outside, so that they go to global queue
+                concurrency::jthread poster(
+                    [&serv, &tasks_done] () {
+                        for(int i = 0; i < num_tasks; ++i)
+                            serv.post([&tasks_done] () { ++tasks_done; });
+                    });
+            }
+
+            // Local queue has to grow for the batch
+            failure.emplace();
+        });
+
+    REQUIRE_THROWS_AS(serv.poll(), std::bad_alloc);
+    failure.reset();
+
+    REQUIRE(serv.poll() == num_tasks);
+    REQUIRE(tasks_done == num_tasks);
+}
+
+TEST_CASE("io_service: idle strategy", "[io_service][idle]") {
+    const int num_threads = 4;
+    const int num_bursts = 20;
+    const int burst_size = 50;
+
+    service_options options;
+
+    SECTION("block right away") {
+        options.idle = idle_strategy::block();
+    }
+
+    SECTION("spin, then block") {
+        options.idle.spin_iterations = 1000;
+        options.idle.yield_iterations = 100;
+        options.idle.max_spinning_workers = 1;
+    }
+
+    SECTION("all workers spin for long") {
+        // stop() must not wait for spinning to end
+        options.idle.spin_iterations = 1u << 30;
+        options.idle.yield_iterations = 1u << 30;
+        options.idle.max_spinning_workers = num_threads;
+    }
+
+    io_service serv(options);
+    std::atomic<int> tasks_done(0);
+
+    std::vector<concurrency::jthread> threads;
+    for(int i = 0; i < num_threads; ++i)
+        threads.emplace_back(worker_func, &serv);
+
+    // Pauses let workers run out of tasks between bursts
+    for(int burst = 0; burst < num_bursts; ++burst) {
+        for(int i = 0; i < burst_size; ++i)
+            serv.post([&tasks_done] () { ++tasks_done; });
+
+        while(tasks_done < (burst + 1) * burst_size)
+            std::this_thread::yield();
+
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+
+    serv.stop();
+    REQUIRE(tasks_done == num_bursts * burst_size);
+}
+
+TEST_CASE("io_service: run and poll family", "[io_service][run]") {
+    using namespace std::chrono_literals;
+
+    io_service serv;
+    std::atomic<int> tasks_done(0);
+    auto count = [&tasks_done] () { ++tasks_done; };
+
+    SECTION("poll runs ready tasks only") {
+        REQUIRE(serv.poll() == 0);
+
+        serv.post(count);
+        serv.post(count);
+        // Posted by task, run by the same poll
+        serv.post([&serv, count] () { serv.post(count); });
+
+        REQUIRE(serv.poll() == 4);
+        REQUIRE(tasks_done == 3);
+        REQUIRE(serv.poll() == 0);
+    }
+
+    SECTION("poll_one and run_one run single task") {
+        for(int i = 0; i < 3; ++i)
+            serv.post(count);
+
+        REQUIRE(serv.poll_one() == 1);
+        REQUIRE(serv.run_one() == 1);
+        REQUIRE(tasks_done == 2);
+        REQUIRE(serv.poll() == 1);
+        REQUIRE(serv.poll_one() == 0);
+    }
+
+    SECTION("run_one waits for task") {
+        concurrency::jthread poster(
+            [&serv, count] () {
+                std::this_thread::sleep_for(5ms);
+                serv.post(count);
+            });
+
+        REQUIRE(serv.run_one() == 1);
+        REQUIRE(tasks_done == 1);
+    }
+
+    SECTION("run_for returns at deadline") {
+        const timer_clock::time_point started = timer_clock::now();
+        REQUIRE(serv.run_for(20ms) == 0);
+        REQUIRE(timer_clock::now() - started >= 20ms);
+
+        serv.post_after(5ms, count);
+        REQUIRE(serv.run_until(timer_clock::now() + 30ms) == 1);
+        REQUIRE(tasks_done == 1);
+    }
+
+    SECTION("poll runs due timers") {
+        serv.post_after(1ms, count);
+        std::this_thread::sleep_for(5ms);
+
+        REQUIRE(serv.poll() == 1);
+        REQUIRE(tasks_done == 1);
+    }
+
+    SECTION("nested poll of other service") {
+        io_service other;
+        other.post(count);
+
+        bool is_inline = false;
+        serv.post(
+            [&] () {
+                other.poll();
+                // Still within pool of serv
+                serv.dispatch([&is_inline] () { is_inline = true; });
+            });
+
+        REQUIRE(serv.poll() == 1);
+        REQUIRE(tasks_done == 1);
+        REQUIRE(is_inline);
+    }
+
+    SECTION("stop ends run") {
+        concurrency::jthread stopper(
+            [&serv] () {
+                std::this_thread::sleep_for(5ms);
+                serv.stop();
+            });
+
+        REQUIRE(serv.run() == 0);
+        REQUIRE_THROWS_AS(serv.poll(), service_stopped_error);
+    }
+
+    serv.stop();
+}
+
+TEST_CASE("io_service: task priorities", "[io_service][priority]") {
+    using namespace std::chrono_literals;
+
+    service_options options;
+
+    SECTION("strict order for single worker") {
+        options.priority_aging = timer_clock::duration::zero();
+        io_service serv(options);
+
+        std::vector<char> order;
+        std::atomic<int> tasks_done(0);
+        auto record =
+            [&order, &tasks_done] (char level) {
+                order.push_back(level);
+                ++tasks_done;
+            };
+
+        // Queued before worker starts. Single worker needs no lock
+        for(int i = 0; i < 2; ++i) {
+            serv.post(task_priority::low, record, 'L');
+            serv.post(record, 'N');
+            serv.post(task_priority::high, record, 'H');
+        }
+
+        concurrency::jthread worker(worker_func, &serv);
+        while(tasks_done < 6)
+            std::this_thread::yield();
+        serv.stop();
+
+        REQUIRE_THAT(order, Catch::Matchers::RangeEquals(
+            std::vector<char>{'H', 'H', 'N', 'N', 'L', 'L'}));
+    }
+
+    SECTION("aging lets low task through constant high load") {
+        options.priority_aging = 5ms;
+        io_service serv(options);
+
+        std::atomic<bool> is_low_done(false);
+        serv.post(task_priority::low, [&is_low_done] () { is_low_done = true; });
+
+        // Each high task posts next one, so high lane never runs dry
+        std::function<void()> high_task =
+            [&serv, &is_low_done, &high_task] () {
+                if(!is_low_done)
+                    serv.post(task_priority::high, high_task);
+            };
+        serv.post(task_priority::high, high_task);
+
+        concurrency::jthread worker(worker_func, &serv);
+        while(!is_low_done)
+            std::this_thread::yield();
+        serv.stop();
+    }
+
+    SECTION("queueing delay per level") {
+        const int num_tasks = 100;
+        io_service serv(options);
+
+        std::vector<concurrency::jthread> threads;
+        for(int i = 0; i < 2; ++i)
+            threads.emplace_back(worker_func, &serv);
+
+        std::atomic<int> tasks_done(0);
+        auto count = [&tasks_done] () { ++tasks_done; };
+        for(int i = 0; i < num_tasks; ++i) {
+            serv.post(task_priority::high, count);
+            serv.post(task_priority::normal, count);
+            serv.post(task_priority::low, count);
+            // Normal level as well
+            serv.post(count);
+        }
+
+        while(tasks_done < 4 * num_tasks)
+            std::this_thread::yield();
+        serv.stop();
+
+        const service_stats snapshot = serv.stats();
+        for(task_priority level :
+            {task_priority::high, task_priority::normal, task_priority::low}
+        ) {
+            const queue_delay_stats& stats = snapshot.queue_delay(level);
+            REQUIRE(stats.num_tasks
+                == (level == task_priority::normal ? 2 : 1) * num_tasks);
+            REQUIRE(stats.max_delay >= stats.mean_delay());
+        }
+    }
+
+    SECTION("normal level is post()") {
+        io_service serv(options);
+        serv.post(task_priority::normal, [] () {});
+        serv.post([] () {});
+
+        // Both inline, without wrapper
+        REQUIRE(serv.stats().queued_bytes == 2 * sizeof(invocable));
+        REQUIRE(serv.poll() == 2);
+        // Not timed, until lanes are used
+        REQUIRE(serv.stats().queue_delay(task_priority::normal).num_tasks == 0);
+
+        serv.post(task_priority::low, [] () {});
+        serv.post(task_priority::normal, [] () {});
+        serv.post([] () {});
+        REQUIRE(serv.poll() == 3);
+        REQUIRE(serv.stats().queue_delay(task_priority::normal).num_tasks == 2);
+    }
+}
+
+TEST_CASE("io_service: stats", "[io_service][stats]") {
+    const int num_threads = 2;
+    const int num_tasks = 100;
+
+    io_service serv;
+    std::atomic<int> tasks_done(0);
+    auto count = [&tasks_done] () { ++tasks_done; };
+
+    SECTION("queued tasks") {
+        // Fits bounded global queue of any capacity
+        const int num_queued = 32;
+
+        // Heap allocated callable counts as well
+        std::array<char, 256> large{};
+        serv.post([large, count] () mutable { count(); });
+        for(int i = 1; i < num_queued; ++i)
+            serv.post(count);
+
+        const service_stats stats = serv.stats();
+        REQUIRE(stats.tasks_posted == num_queued);
+        REQUIRE(stats.tasks_executed == 0);
+        REQUIRE(stats.queue_depth() == num_queued);
+        REQUIRE(stats.queued_bytes >= num_queued * sizeof(invocable) + sizeof(large));
+
+        // Dropped by stop
+        serv.stop();
+        REQUIRE(serv.stats().queued_bytes == 0);
+
+        serv.restart();
+        serv.post(count);
+        REQUIRE(serv.stats().queued_bytes == sizeof(invocable));
+        REQUIRE(serv.poll() == 1);
+        REQUIRE(serv.stats().queued_bytes == 0);
+    }
+
+    SECTION("executed tasks") {
+        std::vector<concurrency::jthread> threads;
+        for(int i = 0; i < num_threads; ++i)
+            threads.emplace_back(worker_func, &serv);
+
+        auto num_active =
+            [&serv] () {
+                const std::vector<worker_stats> workers = serv.stats().workers;
+                return std::count_if(workers.begin(), workers.end(),
+                    [] (const worker_stats& worker) { return worker.is_active; });
+            };
+        while(num_active() < num_threads)
+            std::this_thread::yield();
+
+        for(int i = 0; i < num_tasks; ++i)
+            serv.post(
+                [&serv, count] () {
+                    // Inline, within pool
+                    serv.dispatch(count);
+                });
+        while(tasks_done < num_tasks)
+            std::this_thread::yield();
+
+        const service_stats stats = serv.stats();
+        REQUIRE(stats.tasks_posted == num_tasks);
+        REQUIRE(stats.tasks_dispatched == num_tasks);
+        REQUIRE(stats.tasks_executed == num_tasks);
+        REQUIRE(stats.queue_depth() == 0);
+        REQUIRE(stats.queued_bytes == 0);
+        REQUIRE(stats.workers.size() == num_threads);
+
+        std::uint64_t executed_by_workers = 0;
+        for(const worker_stats& worker : stats.workers) {
+            REQUIRE(worker.is_active);
+            executed_by_workers += worker.tasks_executed;
+        }
+        REQUIRE(executed_by_workers == num_tasks);
+        REQUIRE(stats.busy_time + stats.idle_time > std::chrono::nanoseconds::zero());
+
+        serv.stop();
+        REQUIRE_FALSE(serv.stats().workers[0].is_active);
+    }
+
+    SECTION("dump") {
+        serv.post(count);
+        serv.poll();
+
+        std::ostringstream prometheus;
+        write_prometheus(prometheus, serv.stats());
+        REQUIRE_THAT(prometheus.str(),
+            Catch::Matchers::ContainsSubstring("io_service_tasks_executed_total 1\n")
+            && Catch::Matchers::ContainsSubstring(
+                "io_service_queue_delay_tasks_total{priority=\"high\"} 0\n")
+            && Catch::Matchers::ContainsSubstring(
+                "io_service_worker_tasks_executed_total{worker=\"0\"} 1\n"));
+
+        std::ostringstream json;
+        write_json(json, serv.stats());
+        REQUIRE_THAT(json.str(),
+            Catch::Matchers::StartsWith("{\"tasks_posted\":1,")
+            && Catch::Matchers::ContainsSubstring("\"workers\":[{\"index\":0,"));
+    }
+
+    serv.stop();
+}
+
+TEST_CASE("io_service: latency histograms", "[io_service][stats]") {
+    using namespace std::chrono_literals;
+    const int num_tasks = 20;
+
+    SECTION("disabled by default") {
+        io_service serv;
+        serv.post([] () {});
+        serv.poll();
+
+        const service_stats stats = serv.stats();
+        REQUIRE(stats.queue_delay_histogram.count() == 0);
+        REQUIRE(stats.run_time_histogram.count() == 0);
+    }
+
+    SECTION("queueing delay and run time") {
+        service_options options;
+        options.latency_histograms = true;
+        io_service serv(options);
+
+        // Queued for at least 5ms, then run for at least 1ms each
+        for(int i = 0; i < num_tasks; ++i)
+            serv.post([] () { std::this_thread::sleep_for(1ms); });
+        serv.post(task_priority::high, [] () {});
+        std::this_thread::sleep_for(5ms);
+
+        serv.post_bulk(std::vector<std::function<void()>>(2, [] () {}));
+        REQUIRE(serv.poll() == num_tasks + 3);
+
+        const service_stats stats = serv.stats();
+        const latency_histogram& queue_delay = stats.queue_delay_histogram;
+        const latency_histogram& run_time = stats.run_time_histogram;
+
+        // Tasks of post_bulk() are not stamped
+        REQUIRE(queue_delay.count() == num_tasks + 1);
+        REQUIRE(queue_delay.percentile(0) >= 5ms);
+        REQUIRE(queue_delay.percentile(99) <= queue_delay.max());
+
+        REQUIRE(run_time.count() == num_tasks + 3);
+        REQUIRE(run_time.percentile(90) >= 1ms);
+        REQUIRE(run_time.total() >= num_tasks * 1ms);
+
+        std::ostringstream prometheus;
+        write_prometheus(prometheus, stats);
+        REQUIRE_THAT(prometheus.str(),
+            Catch::Matchers::ContainsSubstring(
+                "# TYPE io_service_task_queue_delay_seconds summary\n")
+            && Catch::Matchers::ContainsSubstring(
+                "io_service_task_run_seconds_count 23\n"));
+
+        std::ostringstream json;
+        write_json(json, stats);
+        REQUIRE_THAT(json.str(),
+            Catch::Matchers::ContainsSubstring(
+                "\"queue_delay_histogram\":{\"count\":21,"));
+    }
+
+    SECTION("merged over workers") {
+        service_options options;
+        options.latency_histograms = true;
+        io_service serv(options);
+        std::atomic<int> tasks_done(0);
+
+        std::vector<concurrency::jthread> threads;
+        for(int i = 0; i < 2; ++i)
+            threads.emplace_back(worker_func, &serv);
+
+        for(int i = 0; i < num_tasks; ++i)
+            serv.post([&tasks_done] () { ++tasks_done; });
+        while(tasks_done < num_tasks)
+            std::this_thread::yield();
+
+        // Recorded after task returned
+        std::uint64_t num_recorded = 0;
+        while(num_recorded < num_tasks) {
+            std::this_thread::yield();
+            num_recorded = serv.stats().run_time_histogram.count();
+        }
+        REQUIRE(num_recorded == num_tasks);
+        REQUIRE(serv.stats().queue_delay_histogram.count() == num_tasks);
+
+        serv.stop();
+    }
+}
+
+TEST_CASE("io_service: tracing", "[io_service][trace]") {
+    SECTION("disabled by default") {
+        io_service serv;
+        serv.post(task_label("task"), [] () {});
+        serv.poll();
+
+        REQUIRE(serv.trace().threads.empty());
+    }
+
+    SECTION("post, start and end of tasks") {
+        service_options options;
+        options.trace_buffer_size = 64;
+        io_service serv(options);
+
+        serv.post(task_label("first"), [] () {});
+        std::future<int> fut =
+            serv.post_waitable(task_label("second"), [] () { return 2; });
+        serv.post([] () {});
+        serv.post(task_priority::high, [] () {});
+        // Not stamped, so not posted in trace
+        serv.post_bulk(std::vector<std::function<void()>>(1, [] () {}));
+        REQUIRE(serv.poll() == 5);
+        REQUIRE(fut.get() == 2);
+
+        const service_trace trace = serv.trace();
+        REQUIRE(trace.threads.size() == 2);
+
+        const thread_trace& external = trace.threads[0];
+        REQUIRE_FALSE(external.is_worker);
+        REQUIRE(external.events.size() == 4);
+        for(const trace_event& event : external.events) {
+            REQUIRE(event.type == trace_event_type::post);
+            REQUIRE(event.task_id != 0);
+        }
+        REQUIRE(std::string(external.events[0].label) == "first");
+        REQUIRE(std::string(external.events[1].label) == "second");
+        REQUIRE(external.events[2].label == nullptr);
+
+        // Ids are unique, even if clock did not move between posts
+        for(std::size_t i = 1; i < external.events.size(); ++i)
+            REQUIRE(external.events[i].task_id > external.events[i - 1].task_id);
+
+        // High priority task goes first
+        const thread_trace& worker = trace.threads[1];
+        REQUIRE(worker.is_worker);
+        REQUIRE(worker.events.size() == 10);
+        REQUIRE(worker.events[0].type == trace_event_type::start);
+        REQUIRE(worker.events[0].task_id == external.events[3].task_id);
+        REQUIRE(worker.events[1].type == trace_event_type::end);
+        REQUIRE(worker.events[2].task_id == external.events[0].task_id);
+        REQUIRE(worker.events[2].time_ns >= external.events[0].time_ns);
+
+        std::ostringstream json;
+        write_chrome_trace(json, trace);
+        REQUIRE_THAT(json.str(),
+            Catch::Matchers::ContainsSubstring("{\"ph\":\"B\",\"name\":\"first\"")
+            && Catch::Matchers::ContainsSubstring("{\"ph\":\"B\",\"name\":\"second\"")
+            && Catch::Matchers::ContainsSubstring("\"args\":{\"name\":\"worker 0\"}"));
+    }
+
+    SECTION("ring keeps last events") {
+        service_options options;
+        options.trace_buffer_size = 8;
+        io_service serv(options);
+
+        for(int i = 0; i < 20; ++i)
+            serv.post([] () {});
+        serv.poll();
+
+        const service_trace trace = serv.trace();
+        REQUIRE(trace.threads[0].events.size() == 8);
+        REQUIRE(trace.threads[1].events.size() == 8);
+    }
+}
+
+TEST_CASE("io_service: owned pool", "[io_service][pool]") {
+    const int num_threads = 3;
+    const int num_tasks = 100;
+
+    io_service serv;
+    std::atomic<int> tasks_done(0);
+
+    SECTION("runs tasks until stop") {
+        serv.start(num_threads);
+        REQUIRE_THROWS_AS(serv.start(1), std::logic_error);
+
+        for(int i = 0; i < num_tasks; ++i)
+            serv.post([&tasks_done] () { ++tasks_done; });
+        while(tasks_done < num_tasks)
+            std::this_thread::yield();
+
+        // Joins threads. Pool can be started again after restart
+        serv.stop();
+        serv.restart();
+        serv.start(1);
+        REQUIRE(serv.post_waitable([] () { return 1; }).get() == 1);
+    }
+
+    SECTION("thread attributes") {
+        pool_options options = pool_options::one_cpu_per_worker(num_threads);
+        options.name_prefix = "test_pool-";
+        options.stack_size = 4 << 20;
+        serv.start(num_threads, options);
+
+        std::future<std::string> name =
+            serv.post_waitable(
+                [] () {
+                    char buf[16] = {};
+                    pthread_getname_np(pthread_self(), buf, sizeof(buf));
+                    return std::string(buf);
+                });
+        REQUIRE_THAT(name.get(), Catch::Matchers::StartsWith("test_pool-"));
+
+        std::future<int> num_cpus =
+            serv.post_waitable(
+                [] () {
+                    cpu_set_t cpu_set;
+                    CPU_ZERO(&cpu_set);
+                    pthread_getaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+                    return CPU_COUNT(&cpu_set);
+                });
+        REQUIRE(num_cpus.get() == 1);
+
+        std::future<std::size_t> stack_size =
+            serv.post_waitable(
+                [] () {
+                    pthread_attr_t attr;
+                    std::size_t size = 0;
+                    pthread_getattr_np(pthread_self(), &attr);
+                    pthread_attr_getstacksize(&attr, &size);
+                    pthread_attr_destroy(&attr);
+                    return size;
+                });
+        REQUIRE(stack_size.get() >= options.stack_size);
+    }
+
+    SECTION("invalid cpu") {
+        pool_options options;
+        options.cpu_sets = {{CPU_SETSIZE}};
+        REQUIRE_THROWS_AS(serv.start(1, options), std::invalid_argument);
+    }
+
+    SECTION("failed start leaves no pool") {
+        std::atomic<int> tasks_done(0);
+        serv.post([&tasks_done] () { ++tasks_done; });
+
+        // First thread is started, second one fails
+        pool_options options;
+        options.cpu_sets = {{detail::allowed_cpus().front()}, {CPU_SETSIZE}};
+        REQUIRE_THROWS_AS(serv.start(2, options), std::invalid_argument);
+        REQUIRE(tasks_done == 0);
+
+        REQUIRE_NOTHROW(serv.start(1));
+        while(tasks_done == 0)
+            std::this_thread::yield();
+    }
+
+    serv.stop();
+}
+
+TEST_CASE("io_service: numa shards", "[io_service][numa]") {
+    const int num_tasks = 1000;
+
+    // Two nodes: first CPU process may use, and the rest
+    const std::vector<unsigned> cpus = detail::allowed_cpus();
+    REQUIRE_FALSE(cpus.empty());
+
+    fake_node_dir dir("io_service_numa");
+    dir.add_node("node0", std::to_string(cpus[0]));
+    dir.add_node("node1", std::to_string(cpus[0] + 1) + "-1023");
+
+    service_options options;
+    options.numa_topology_path = dir.root.string();
+    io_service serv(options);
+    std::atomic<int> tasks_done(0);
+
+    SECTION("tasks of each node are run") {
+        std::vector<concurrency::jthread> threads;
+        for(int i = 0; i < 3; ++i)
+            threads.emplace_back(worker_func, &serv);
+
+        for(int i = 0; i < num_tasks; ++i)
+            serv.post([&tasks_done] () { ++tasks_done; });
+        while(tasks_done < num_tasks)
+            std::this_thread::yield();
+
+        REQUIRE(serv.stats().global_queue_depth == 0);
+        serv.stop();
+    }
+
+    SECTION("idle worker of other node steals") {
+        // Otherwise, every thread is on first node
+        if(cpus.size() < 2)
+            SKIP("Single CPU is available");
+
+        // Worker waits on shard of second node, poster pushes to first one
+        pool_options pool;
+        pool.cpu_sets = {{cpus[1]}};
+        serv.start(1, pool);
+
+        cpu_set_t saved;
+        pthread_getaffinity_np(pthread_self(), sizeof(saved), &saved);
+        cpu_set_t first_cpu;
+        CPU_ZERO(&first_cpu);
+        CPU_SET(cpus[0], &first_cpu);
+        pthread_setaffinity_np(pthread_self(), sizeof(first_cpu), &first_cpu);
+
+        for(int i = 0; i < num_tasks; ++i)
+            serv.post([&tasks_done] () { ++tasks_done; });
+        pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+
+        while(tasks_done < num_tasks)
+            std::this_thread::yield();
+        serv.stop();
+    }
+}
+
+TEST_CASE("io_service: timers", "[io_service][timer]") {
+    using namespace std::chrono_literals;
+    const int num_threads = 4;
+
+    io_service serv;
+
+    std::vector<concurrency::jthread> threads;
+    for(int i = 0; i < num_threads; ++i)
+        threads.emplace_back(worker_func, &serv);
+
+    SECTION("fires not earlier than deadline") {
+        std::promise<timer_clock::time_point> fired;
+        const timer_clock::time_point posted = timer_clock::now();
+
+        timer_handle handle = serv.post_after(20ms,
+            [&fired] () { fired.set_value(timer_clock::now()); });
+
+        // Workers are idle. Deadline ends their wait
+        REQUIRE(fired.get_future().get() - posted >= 20ms);
+        REQUIRE_FALSE(handle.pending());
+        REQUIRE_FALSE(handle.cancel());
+    }
+
+    SECTION("ordered by deadline") {
+        const int num_timers = 5;
+        std::vector<int> order;
+        concurrency::mutex order_mutex;
+        std::atomic<int> num_fired(0);
+
+        const timer_clock::time_point now = timer_clock::now();
+        for(int i = num_timers; i > 0; --i)
+            serv.post_at(now + i * 10ms,
+                [&, i] () {
+                    concurrency::lock_guard<concurrency::mutex> lk(order_mutex);
+                    order.push_back(i);
+                    ++num_fired;
+                });
+
+        while(num_fired < num_timers)
+            std::this_thread::yield();
+
+        REQUIRE_THAT(order, Catch::Matchers::RangeEquals(std::vector<int>{1, 2, 3, 4, 5}));
+    }
+
+    SECTION("cancelled timer does not fire") {
+        std::atomic<bool> is_fired(false);
+        timer_handle handle = serv.post_after(20ms,
+            [&is_fired] () { is_fired = true; });
+
+        REQUIRE(handle.pending());
+        REQUIRE(handle.cancel());
+        REQUIRE_FALSE(handle.cancel());
+        REQUIRE_FALSE(handle.pending());
+
+        // Later timer fires, earlier one does not
+        std::promise<void> later;
+        serv.post_after(40ms, [&later] () { later.set_value(); });
+        later.get_future().get();
+        REQUIRE_FALSE(is_fired);
+    }
+
+    SECTION("huge delay does not wrap") {
+        std::atomic<bool> is_fired(false);
+        timer_handle handle = serv.post_after(std::chrono::hours::max(),
+            [&is_fired] () { is_fired = true; });
+
+        std::promise<void> later;
+        serv.post_after(20ms, [&later] () { later.set_value(); });
+        later.get_future().get();
+        REQUIRE_FALSE(is_fired);
+        REQUIRE(handle.cancel());
+    }
+
+    SECTION("periodic") {
+        std::atomic<int> num_runs(0);
+        timer_handle handle = serv.post_every(1ms,
+            [&num_runs] (int step) { num_runs += step; }, 1);
+
+        while(num_runs < 5)
+            std::this_thread::yield();
+
+        REQUIRE(handle.cancel());
+        // Run in progress may finish, no more after it
+        std::this_thread::sleep_for(5ms);
+        const int runs_after_cancel = num_runs;
+        std::this_thread::sleep_for(10ms);
+        REQUIRE(num_runs == runs_after_cancel);
+    }
+
+    SECTION("many timers, half cancelled") {
+        const int num_timers = 10000;
+        std::atomic<int> num_fired(0);
+
+        std::vector<timer_handle> handles;
+        for(int i = 0; i < num_timers; ++i)
+            handles.push_back(serv.post_after(
+                std::chrono::microseconds(i * 3),
+                [&num_fired] () { ++num_fired; }));
+
+        int num_cancelled = 0;
+        for(int i = 0; i < num_timers; i += 2)
+            if(handles[i].cancel())
+                ++num_cancelled;
+
+        while(num_fired < num_timers - num_cancelled)
+            std::this_thread::yield();
+
+        std::this_thread::sleep_for(5ms);
+        REQUIRE(num_fired == num_timers - num_cancelled);
+    }
+
+    serv.stop();
+}
+
+TEST_CASE("io_service: earlier deadline wakes single worker", "[io_service][timer]") {
+    using namespace std::chrono_literals;
+    const int num_threads = 8;
+
+    io_service serv;
+
+    std::vector<concurrency::jthread> threads;
+    for(int i = 0; i < num_threads; ++i)
+        threads.emplace_back(worker_func, &serv);
+
+    timer_handle later = serv.post_after(1h, [] () {});
+    // Let workers block
+    std::this_thread::sleep_for(50ms);
+    const std::uint64_t wakeups_before = serv.stats().wakeups;
+
+    std::promise<void> fired;
+    serv.post_after(10ms, [&fired] () { fired.set_value(); });
+    fired.get_future().get();
+    std::this_thread::sleep_for(20ms);
+
+    // New keeper, its deadline and task it posts. Not whole pool
+    const std::uint64_t wakeups = serv.stats().wakeups - wakeups_before;
+    UNSCOPED_INFO("wakeups: " << wakeups);
+    REQUIRE(wakeups < num_threads);
+
+    REQUIRE(later.cancel());
+    serv.stop();
+}
+
+TEST_CASE("io_service: timers are dropped on stop", "[io_service][timer]") {
+    using namespace std::chrono_literals;
+
+    io_service serv;
+    timer_handle handle = serv.post_after(1h, [] () {});
+    REQUIRE(handle.pending());
+
+    serv.stop();
+    REQUIRE_FALSE(handle.pending());
+    REQUIRE_FALSE(handle.cancel());
+}
+
 TEST_CASE("io_service: restart empty service") {
     io_service serv;
 
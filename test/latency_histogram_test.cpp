@@ -0,0 +1,106 @@
+#include <catch2/catch_all.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "latency_histogram.hpp"
+#include "service_stats.hpp" // latency_recorder
+
+#include "jthread.hpp"
+
+
+namespace io_service {
+
+TEST_CASE("latency_histogram: buckets", "[latency_histogram]") {
+    typedef latency_histogram histogram;
+
+    SECTION("small values are exact") {
+        for(std::uint64_t ns = 0; ns < 2 * histogram::sub_bucket_count; ++ns) {
+            REQUIRE(histogram::bucket_index(ns) == ns);
+            REQUIRE(histogram::bucket_upper_bound(ns) == ns);
+        }
+    }
+
+    SECTION("value is within its bucket") {
+        const std::uint64_t max_ns =
+            (std::uint64_t(1) << (histogram::max_exponent + 1)) - 1;
+        for(std::uint64_t ns = 1; ns <= max_ns; ns = ns * 3 + 1) {
+            const std::size_t index = histogram::bucket_index(ns);
+            REQUIRE(index < histogram::bucket_count);
+            REQUIRE(histogram::bucket_upper_bound(index) >= ns);
+            if(index > 0)
+                REQUIRE(histogram::bucket_upper_bound(index - 1) < ns);
+        }
+    }
+
+    SECTION("relative error is bounded") {
+        for(std::uint64_t ns = 1000; ns < 1000000000; ns = ns * 7 / 5) {
+            const std::uint64_t upper =
+                histogram::bucket_upper_bound(histogram::bucket_index(ns));
+            REQUIRE(upper - ns <= ns / histogram::sub_bucket_count);
+        }
+    }
+
+    SECTION("long durations fall into last bucket") {
+        REQUIRE(histogram::bucket_index(UINT64_MAX) == histogram::bucket_count - 1);
+    }
+}
+
+TEST_CASE("latency_histogram: percentiles", "[latency_histogram]") {
+    using namespace std::chrono_literals;
+    latency_histogram histogram;
+
+    REQUIRE(histogram.percentile(99) == 0ns);
+    REQUIRE(histogram.mean() == 0ns);
+
+    // 1us .. 1000us
+    for(int i = 1; i <= 1000; ++i)
+        histogram.record(std::chrono::microseconds(i));
+
+    REQUIRE(histogram.count() == 1000);
+    REQUIRE(histogram.max() == 1000us);
+    REQUIRE(histogram.percentile(100) == 1000us);
+
+    const std::chrono::nanoseconds p50 = histogram.percentile(50);
+    REQUIRE(p50 >= 500us);
+    REQUIRE(p50 <= 500us + 500us / latency_histogram::sub_bucket_count);
+
+    const std::chrono::nanoseconds p99 = histogram.percentile(99);
+    REQUIRE(p99 >= 990us);
+    REQUIRE(p99 <= 1000us);
+
+    SECTION("merge") {
+        latency_histogram other;
+        other.record(10ms);
+        histogram.merge(other);
+
+        REQUIRE(histogram.count() == 1001);
+        REQUIRE(histogram.max() == 10ms);
+        REQUIRE(histogram.percentile(100) == 10ms);
+        REQUIRE(histogram.percentile(50) == p50);
+    }
+}
+
+TEST_CASE("latency_recorder: concurrent writers", "[latency_histogram]") {
+    const int num_threads = 4;
+    const int num_records = 10000;
+
+    detail::latency_recorder recorder;
+    {
+        std::vector<concurrency::jthread> threads;
+        for(int i = 0; i < num_threads; ++i)
+            threads.emplace_back(
+                [&recorder, i] () {
+                    for(int j = 0; j < num_records; ++j)
+                        recorder.record(std::chrono::nanoseconds(i * 1000 + j % 100));
+                });
+    }
+
+    latency_histogram histogram;
+    recorder.merge_into(histogram);
+    REQUIRE(histogram.count() == num_threads * num_records);
+    REQUIRE(histogram.max() == std::chrono::nanoseconds((num_threads - 1) * 1000 + 99));
+}
+
+} // namespace io_service
@@ -0,0 +1,172 @@
+#include <catch2/catch_all.hpp>
+#include <atomic>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "invocable.hpp"
+#include "mpmc_bounded_queue.hpp"
+
+#include "jthread.hpp"
+
+
+namespace io_service {
+
+TEST_CASE("mpmc_bounded_queue: creation", "[mpmc_bounded_queue]") {
+    const int test_val = 123;
+    mpmc_bounded_queue<int> iqueue(10);
+    // rounded up to power of 2
+    REQUIRE(iqueue.capacity() == 16);
+    REQUIRE(iqueue.empty());
+
+    iqueue.push(test_val);
+    REQUIRE(!iqueue.empty());
+
+    int get_data;
+    iqueue.wait_and_pop(get_data);
+
+    REQUIRE(get_data == test_val);
+    REQUIRE(iqueue.try_pop(get_data) == false);
+}
+
+TEST_CASE("mpmc_bounded_queue: full queue", "[mpmc_bounded_queue]") {
+    mpmc_bounded_queue<int> iqueue(4);
+
+    for(int i = 0; i < 4; ++i) {
+        int val = i;
+        REQUIRE(iqueue.try_push(val));
+    }
+
+    int extra_val = 4;
+    REQUIRE(iqueue.try_push(extra_val) == false);
+
+    // Slots are reused on next lap
+    int out_val;
+    for(int lap = 0; lap < 3; ++lap) {
+        for(int i = 0; i < 4; ++i) {
+            REQUIRE(iqueue.try_pop(out_val));
+            REQUIRE(out_val == i);
+        }
+
+        for(int i = 0; i < 4; ++i) {
+            int val = i;
+            REQUIRE(iqueue.try_push(val));
+        }
+    }
+
+    iqueue.clear();
+    REQUIRE(iqueue.try_pop(out_val) == false);
+}
+
+TEST_CASE("mpmc_bounded_queue: wait interrupted by predicate", "[mpmc_bounded_queue]") {
+    mpmc_bounded_queue<int> iqueue;
+    std::atomic<bool> is_stopped(false);
+
+    std::future<bool> fut = std::async(std::launch::async,
+        [&] () {
+            int out_val;
+            return iqueue.wait_and_pop(out_val,
+                [&is_stopped] () { return is_stopped.load(); });
+        });
+
+    is_stopped = true;
+    iqueue.signal();
+
+    REQUIRE(fut.get() == false);
+}
+
+TEST_CASE("mpmc_bounded_queue: multiple producers and consumers", "[mpmc_bounded_queue]") {
+    const int num_items = 4096;
+    const int pushers_num = 8;
+    const int poppers_num = 8;
+
+    // Small capacity, so that producers hit full queue
+    mpmc_bounded_queue<invocable> queue(64);
+    std::atomic<int> tasks_done(0);
+    std::atomic<long> sum_done(0);
+
+    auto add_task =
+        [&sum_done] (int val) {
+            sum_done += val;
+        };
+
+    {
+        using namespace concurrency;
+        std::vector<jthread> pushers;
+        std::vector<jthread> poppers;
+
+        for(int i = 0; i < pushers_num; ++i)
+            pushers.push_back(jthread(
+                [&, i] () {
+                    for(int val = i; val < num_items; val += pushers_num) {
+                        std::packaged_task<void(int)> task(add_task);
+                        queue.push(invocable(std::move(task), val));
+                    }
+                }));
+
+        for(int i = 0; i < poppers_num; ++i)
+            poppers.push_back(jthread(
+                [&] () {
+                    auto is_done =
+                        [&tasks_done] () { return tasks_done >= num_items; };
+
+                    invocable task;
+                    while(queue.wait_and_pop(task, is_done)) {
+                        task();
+                        if(++tasks_done == num_items)
+                            queue.signal();
+                    }
+                }));
+    }
+
+    REQUIRE(tasks_done == num_items);
+    REQUIRE(sum_done == (long(num_items) * (num_items - 1)) / 2);
+}
+
+TEST_CASE("mpmc_bounded_queue: wakes blocked consumers", "[mpmc_bounded_queue]") {
+    const int num_elems = 2000;
+    const int num_consumers = 4;
+
+    mpmc_bounded_queue<int> queue;
+    std::atomic<int> num_popped(0);
+
+    auto all_popped =
+        [&num_popped, num_elems] () { return num_popped >= num_elems; };
+
+    // Blocking consumers, and one polling, which takes data
+    // from under the nose of woken ones
+    auto consumer_thread =
+        [&] () {
+            int out_val;
+            while(queue.wait_and_pop(out_val, all_popped))
+                if(++num_popped == num_elems)
+                    queue.signal();
+        };
+
+    auto polling_thread =
+        [&] () {
+            int out_val;
+            while(!all_popped())
+                if(queue.try_pop(out_val) && ++num_popped == num_elems)
+                    queue.signal();
+        };
+
+    {
+        using namespace concurrency;
+        std::vector<jthread> consumers;
+        for(int i = 0; i < num_consumers; ++i)
+            consumers.emplace_back(consumer_thread);
+        consumers.emplace_back(polling_thread);
+
+        // Pauses let consumers block between pushes
+        for(int i = 0; i < num_elems; ++i) {
+            queue.push(i);
+            if(i % 16 == 0)
+                std::this_thread::yield();
+        }
+    }
+
+    REQUIRE(num_popped == num_elems);
+}
+
+} // namespace io_service
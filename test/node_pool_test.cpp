@@ -0,0 +1,134 @@
+#include <catch2/catch_all.hpp>
+#include <vector>
+
+#include "node_pool.hpp"
+#include "threadsafe_queue.hpp"
+
+#include "allocation_failure.hpp"
+
+#include "jthread.hpp"
+
+
+namespace io_service {
+
+namespace {
+
+// Separate node types, so that tests do not share pools
+template<int Tag>
+struct test_node {
+    long data[4];
+};
+
+} // namespace
+
+TEST_CASE("node_pool: block is reused", "[node_pool]") {
+    typedef node_pool<test_node<0>> pool_type;
+
+    void* first = pool_type::allocate();
+    pool_type::deallocate(first);
+    REQUIRE(pool_type::thread_cached() == 1);
+
+    void* second = pool_type::allocate();
+    REQUIRE(second == first);
+    REQUIRE(pool_type::thread_cached() == 0);
+
+    pool_type::deallocate(second);
+}
+
+TEST_CASE("node_pool: retained memory is capped", "[node_pool]") {
+    typedef node_pool<test_node<1>> pool_type;
+    const std::size_t burst_size =
+        pool_type::thread_cache_max + pool_type::central_max * 2;
+
+    std::vector<void*> blocks;
+    for(std::size_t i = 0; i < burst_size; ++i)
+        blocks.push_back(pool_type::allocate());
+
+    for(void* block : blocks)
+        pool_type::deallocate(block);
+
+    REQUIRE(pool_type::thread_cached() <= pool_type::thread_cache_max);
+    REQUIRE(pool_type::central_cached() <= pool_type::central_max);
+}
+
+TEST_CASE("node_pool: thread cache is flushed on thread exit", "[node_pool]") {
+    typedef node_pool<test_node<2>> pool_type;
+    const std::size_t num_blocks = 16;
+
+    {
+        concurrency::jthread tr(
+            [num_blocks] () {
+                std::vector<void*> blocks;
+                for(std::size_t i = 0; i < num_blocks; ++i)
+                    blocks.push_back(pool_type::allocate());
+
+                for(void* block : blocks)
+                    pool_type::deallocate(block);
+            });
+    }
+
+    REQUIRE(pool_type::central_cached() == num_blocks);
+
+    // Taken by this thread in batch
+    void* block = pool_type::allocate();
+    REQUIRE(pool_type::central_cached() == 0);
+    REQUIRE(pool_type::thread_cached() == num_blocks - 1);
+    pool_type::deallocate(block);
+}
+
+TEST_CASE("node_pool: blocks outlive thread cache", "[node_pool]") {
+    typedef node_pool<test_node<3>> pool_type;
+
+    // Constructed before cache, so destroyed after it
+    struct late_owner {
+        void* block = nullptr;
+
+        ~late_owner() {
+            pool_type::deallocate(block);
+            // Goes to the heap as well
+            pool_type::deallocate(pool_type::allocate());
+        }
+    };
+
+    {
+        concurrency::jthread tr(
+            [] () {
+                static thread_local late_owner owner;
+                owner.block = pool_type::allocate();
+            });
+    }
+
+    // Neither of blocks was cached
+    REQUIRE(pool_type::central_cached() == 0);
+}
+
+TEST_CASE("node_pool: queue nodes are recycled", "[node_pool][threadsafe_queue]") {
+    const int num_items = 1000;
+    threadsafe_queue<int> queue;
+
+    // Warm up thread cache
+    for(int i = 0; i < num_items; ++i)
+        queue.push(i);
+
+    int out_val;
+    while(queue.try_pop(out_val))
+        ;
+
+    // Steady state push/pop is served from freed nodes
+    std::size_t num_allocations = 0;
+    int num_popped = 0;
+    {
+        allocation_counter counter;
+        for(int i = 0; i < num_items; ++i) {
+            queue.push(i);
+            if(queue.try_pop(out_val) && out_val == i)
+                ++num_popped;
+        }
+        num_allocations = counter.count();
+    }
+
+    REQUIRE(num_popped == num_items);
+    REQUIRE(num_allocations == 0);
+}
+
+} // namespace io_service
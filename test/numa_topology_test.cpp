@@ -0,0 +1,62 @@
+#include <catch2/catch_all.hpp>
+
+#include <string>
+#include <vector>
+
+#include "numa_topology.hpp"
+
+#include "fake_node_dir.hpp"
+
+
+namespace io_service {
+
+TEST_CASE("parse_cpu_list", "[numa_topology]") {
+    using detail::parse_cpu_list;
+    typedef std::vector<unsigned> cpus;
+
+    REQUIRE(parse_cpu_list("0\n") == cpus{0});
+    REQUIRE(parse_cpu_list("0-3,8,10-11") == cpus{0, 1, 2, 3, 8, 10, 11});
+    REQUIRE(parse_cpu_list("4,0-1") == cpus{0, 1, 4});
+    REQUIRE(parse_cpu_list("\n").empty());
+
+    // Broken lists
+    REQUIRE(parse_cpu_list("3-1").empty());
+    REQUIRE(parse_cpu_list("0,").empty());
+    REQUIRE(parse_cpu_list("0-").empty());
+    REQUIRE(parse_cpu_list("a").empty());
+}
+
+TEST_CASE("numa_topology: read from directory", "[numa_topology]") {
+    fake_node_dir dir("io_service_numa_test");
+    dir.add_node("node0", "0-1");
+    dir.add_node("node2", "2,4-5");
+    // Memory only, and not a node
+    dir.add_node("node1", "");
+    dir.add_node("nodes", "6");
+
+    detail::numa_topology topology(dir.root.string());
+    REQUIRE(topology.nodes_num() == 2);
+    REQUIRE(topology.node_id(0) == 0);
+    REQUIRE(topology.node_id(1) == 2);
+    REQUIRE(topology.cpus(1) == std::vector<unsigned>{2, 4, 5});
+
+    REQUIRE(topology.node_of_cpu(1) == 0);
+    REQUIRE(topology.node_of_cpu(4) == 1);
+    // Not listed
+    REQUIRE(topology.node_of_cpu(3) == 0);
+    REQUIRE(topology.node_of_cpu(1000) == 0);
+
+    REQUIRE(topology.current_node() < topology.nodes_num());
+    REQUIRE(topology.thread_node() < topology.nodes_num());
+}
+
+TEST_CASE("numa_topology: single node fallback", "[numa_topology]") {
+    detail::numa_topology topology("/nonexistent/io_service/node");
+    REQUIRE(topology.nodes_num() == 1);
+    REQUIRE(topology.current_node() == 0);
+    REQUIRE(topology.thread_node() == 0);
+
+    REQUIRE(detail::numa_topology::system().nodes_num() >= 1);
+}
+
+} // namespace io_service
@@ -0,0 +1,218 @@
+#include <catch2/catch_all.hpp>
+#include <atomic>
+#include <future>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "io_service.hpp"
+#include "strand.hpp"
+
+#include "jthread.hpp"
+
+
+namespace io_service {
+
+namespace {
+
+void run_worker(io_service* serv_ptr) {
+    try {
+        serv_ptr->run();
+    } catch(const service_stopped_error&) {}
+}
+
+} // namespace
+
+TEST_CASE("strand: handlers do not overlap and keep order", "[strand]") {
+    const int num_producers = 4;
+    const int num_handlers = 5000;
+
+    io_service serv;
+    strand str(serv);
+
+    std::vector<concurrency::jthread> workers;
+    for(int i = 0; i < 4; ++i)
+        workers.emplace_back(run_worker, &serv);
+
+    // Not guarded: strand serializes access
+    std::vector<int> last_seen(num_producers, -1);
+    bool is_ordered = true;
+    std::atomic<bool> is_inside(false);
+    std::atomic<bool> is_overlapped(false);
+    std::atomic<int> num_done(0);
+    std::promise<void> all_done;
+
+    auto handler =
+        [&] (int producer, int seq) {
+            if(is_inside.exchange(true))
+                is_overlapped = true;
+
+            if(last_seen[producer] + 1 != seq)
+                is_ordered = false;
+            last_seen[producer] = seq;
+
+            is_inside = false;
+            if(++num_done == num_producers * num_handlers)
+                all_done.set_value();
+        };
+
+    {
+        std::vector<concurrency::jthread> producers;
+        for(int p = 0; p < num_producers; ++p)
+            producers.emplace_back(
+                [&str, &handler, p] () {
+                    for(int i = 0; i < num_handlers; ++i)
+                        str.post(handler, p, i);
+                });
+    }
+
+    REQUIRE(all_done.get_future().wait_for(std::chrono::seconds(30))
+        == std::future_status::ready);
+    REQUIRE(!is_overlapped);
+    REQUIRE(is_ordered);
+
+    serv.stop();
+}
+
+TEST_CASE("strand: producers race finished turns", "[strand][tsan]") {
+    const int num_producers = 4;
+    const int num_handlers = 5000;
+
+    io_service serv;
+    strand str(serv);
+
+    std::vector<concurrency::jthread> workers;
+    for(int i = 0; i < 4; ++i)
+        workers.emplace_back(run_worker, &serv);
+
+    std::atomic<int> num_done(0);
+    {
+        std::vector<concurrency::jthread> producers;
+        for(int p = 0; p < num_producers; ++p)
+            producers.emplace_back(
+                [&str, &num_done] () {
+                    for(int i = 0; i < num_handlers; ++i) {
+                        str.post([&num_done] () { ++num_done; });
+                        // Queue runs dry often, so that turns end
+                        // while others push
+                        if(i % 8 == 0)
+                            std::this_thread::yield();
+                    }
+                });
+    }
+
+    // Lost wakeup leaves handlers behind
+    const auto deadline =
+        std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while(num_done < num_producers * num_handlers
+        && std::chrono::steady_clock::now() < deadline
+    )
+        std::this_thread::yield();
+    REQUIRE(num_done == num_producers * num_handlers);
+
+    serv.stop();
+}
+
+TEST_CASE("strand: occupies single worker", "[strand]") {
+    io_service serv;
+    strand first(serv);
+    strand second(serv);
+
+    std::vector<concurrency::jthread> workers;
+    for(int i = 0; i < 2; ++i)
+        workers.emplace_back(run_worker, &serv);
+
+    // Blocked handler of one strand does not hold up the other
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::promise<void> second_ran;
+
+    first.post([released] () { released.wait(); });
+    first.post([] () {});
+    second.post([&second_ran] () { second_ran.set_value(); });
+
+    REQUIRE(second_ran.get_future().wait_for(std::chrono::seconds(5))
+        == std::future_status::ready);
+
+    // Plain tasks are not held up either
+    std::promise<void> task_ran;
+    serv.post([&task_ran] () { task_ran.set_value(); });
+    REQUIRE(task_ran.get_future().wait_for(std::chrono::seconds(5))
+        == std::future_status::ready);
+
+    release.set_value();
+    serv.stop();
+}
+
+TEST_CASE("strand: dispatch", "[strand]") {
+    io_service serv;
+    strand str(serv);
+    strand other(serv);
+    concurrency::jthread worker(run_worker, &serv);
+
+    REQUIRE(!str.running_in_this_thread());
+
+    std::promise<std::vector<int>> result;
+    std::promise<int> other_result;
+    str.post(
+        [&] () {
+            std::vector<int> order;
+            order.push_back(str.running_in_this_thread() ? 0 : -1);
+
+            // Inline within own strand
+            str.dispatch([&order] () { order.push_back(1); });
+            order.push_back(2);
+
+            // Posted into another one. Runs after this handler
+            other.dispatch(
+                [&other, &other_result] () {
+                    other_result.set_value(other.running_in_this_thread() ? 3 : -1);
+                });
+            order.push_back(4);
+            result.set_value(order);
+        });
+
+    REQUIRE(result.get_future().get() == std::vector<int>{0, 1, 2, 4});
+    REQUIRE(other_result.get_future().get() == 3);
+    serv.stop();
+}
+
+TEST_CASE("strand: escaped exception", "[strand][exception]") {
+    io_service serv;
+    strand str(serv);
+    concurrency::jthread worker(run_worker, &serv);
+
+    std::promise<void> next_ran;
+    str.post([] () { throw std::runtime_error("handler failed"); });
+    str.post([&next_ran] () { next_ran.set_value(); });
+
+    // Discarded by default policy, strand goes on
+    REQUIRE(next_ran.get_future().wait_for(std::chrono::seconds(5))
+        == std::future_status::ready);
+    serv.stop();
+}
+
+TEST_CASE("strand: stop drops pending handlers", "[strand][restart]") {
+    io_service serv;
+    strand str(serv);
+
+    std::atomic<int> num_ran(0);
+    for(int i = 0; i < 10; ++i)
+        str.post([&num_ran] () { ++num_ran; });
+
+    serv.restart();
+    REQUIRE(num_ran == 0);
+
+    // Strand is not left marked running
+    concurrency::jthread worker(run_worker, &serv);
+    std::promise<void> ran;
+    str.post([&ran] () { ran.set_value(); });
+    REQUIRE(ran.get_future().wait_for(std::chrono::seconds(5))
+        == std::future_status::ready);
+    REQUIRE(num_ran == 0);
+
+    serv.stop();
+    REQUIRE_THROWS_AS(str.post([] () {}), service_stopped_error);
+}
+
+} // namespace io_service
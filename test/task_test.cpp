@@ -0,0 +1,214 @@
+#include <catch2/catch_all.hpp>
+
+#include <atomic>
+#include <memory>
+#include <new> // std::bad_alloc
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "io_service.hpp"
+#include "task.hpp"
+
+#include "jthread.hpp"
+
+#include "allocation_failure.hpp"
+
+
+namespace io_service {
+
+namespace {
+
+task<int> answer()
+{ co_return 42; }
+
+task<void> fail()
+{
+    throw std::runtime_error("fail");
+    co_return;
+}
+
+task<int> sum_to(int num) {
+    if(num == 0)
+        co_return 0;
+
+    co_return num + co_await sum_to(num - 1);
+}
+
+// Starts task on calling thread. Prereq: task does not leave it
+template<typename T>
+T sync_await(task<T> coro) {
+    T res{};
+    [] (task<T> coro, T& res) -> detail::detached_task {
+        res = co_await std::move(coro);
+    }(std::move(coro), res);
+    return res;
+}
+
+void run_worker(io_service* serv) {
+    try {
+        serv->run();
+    } catch(const service_stopped_error&) {}
+}
+
+} // namespace
+
+TEST_CASE("task: result and exception", "[task]") {
+    REQUIRE(sync_await(answer()) == 42);
+
+    auto outer =
+        [] () -> task<int> {
+            try {
+                co_await fail();
+            } catch(const std::runtime_error&) {
+                co_return 1;
+            }
+            co_return 0;
+        };
+    REQUIRE(sync_await(outer()) == 1);
+
+    // Deep chain of awaits does not grow stack
+    REQUIRE(sync_await(sum_to(10000)) == 50005000);
+
+    // Destroyed without being awaited
+    task<int> unused = answer();
+    REQUIRE(unused.valid());
+}
+
+TEST_CASE("frame_allocator: frames are reused", "[task]") {
+    typedef detail::frame_allocator allocator;
+
+    void* first = allocator::allocate(100);
+    allocator::deallocate(first, 100);
+    void* second = allocator::allocate(120);
+    REQUIRE(second == first);
+    allocator::deallocate(second, 120);
+
+    void* large = allocator::allocate(allocator::max_pooled_size + 1);
+    allocator::deallocate(large, allocator::max_pooled_size + 1);
+}
+
+TEST_CASE("io_service: coroutines", "[io_service][task]") {
+    const int num_threads = 4;
+
+    io_service serv;
+    std::vector<concurrency::jthread> threads;
+    for(int i = 0; i < num_threads; ++i)
+        threads.emplace_back(run_worker, &serv);
+
+    SECTION("schedule hops onto worker") {
+        const std::thread::id caller = std::this_thread::get_id();
+        std::atomic<bool> is_done(false);
+        std::atomic<bool> is_on_worker(false);
+
+        auto hop =
+            [] (io_service& serv) -> io_service::task<std::thread::id> {
+                co_await serv.schedule();
+                co_return std::this_thread::get_id();
+            };
+        auto body =
+            [&] () -> io_service::task<> {
+                const std::thread::id worker = co_await hop(serv);
+                is_on_worker = worker != caller;
+                is_done = true;
+            };
+
+        co_spawn(serv, body());
+        while(!is_done)
+            std::this_thread::yield();
+        REQUIRE(is_on_worker);
+    }
+
+    SECTION("pipeline of many coroutines") {
+        const int num_coros = 1000;
+        const int num_steps = 10;
+        std::atomic<int> sum(0);
+
+        auto step =
+            [] (io_service& serv, int value) -> io_service::task<int> {
+                co_await serv.schedule();
+                co_return value + 1;
+            };
+        auto pipeline =
+            [&] () -> io_service::task<> {
+                int value = 0;
+                for(int i = 0; i < num_steps; ++i)
+                    value = co_await step(serv, value);
+                sum += value;
+            };
+
+        for(int i = 0; i < num_coros; ++i)
+            co_spawn(serv, pipeline());
+        while(sum < num_coros * num_steps)
+            std::this_thread::yield();
+        REQUIRE(sum == num_coros * num_steps);
+    }
+
+    serv.stop();
+}
+
+TEST_CASE("io_service: co_spawn exception and stop", "[io_service][task]") {
+    std::atomic<int> num_handled(0);
+    service_options options;
+    options.on_task_exception = exception_policy::handler;
+    options.exception_handler =
+        [&num_handled] (std::exception_ptr) { ++num_handled; };
+
+    io_service serv(options);
+
+    SECTION("escaped exception goes to policy") {
+        co_spawn(serv, fail());
+        serv.run_one(); /*resumes coroutine*/
+        serv.run_one(); /*rethrows its exception*/
+        REQUIRE(num_handled == 1);
+    }
+
+    SECTION("dropped coroutine is unwound") {
+        std::shared_ptr<int> state = std::make_shared<int>(0);
+        std::weak_ptr<int> observer = state;
+
+        auto body =
+            [] (io_service& serv, std::shared_ptr<int> state) -> io_service::task<> {
+                co_await serv.schedule();
+                ++*state;
+            };
+        co_spawn(serv, body(serv, std::move(state)));
+        REQUIRE_FALSE(observer.expired());
+
+        // Frames are destroyed, body is not run
+        serv.stop();
+        REQUIRE(observer.expired());
+        REQUIRE(num_handled == 0);
+
+        REQUIRE_THROWS_AS(co_spawn(serv, answer()), service_stopped_error);
+    }
+}
+
+TEST_CASE("io_service: schedule fails to push", "[io_service][task]") {
+    io_service serv;
+
+    int num_resumed = 0;
+    bool is_failed = false;
+    auto body =
+        [&] () -> io_service::task<> {
+            // Local queue grows by blocks. One of pushes allocates
+            for(int i = 0; i < 1000 && !is_failed; ++i) {
+                try {
+                    allocation_failure failure;
+                    co_await serv.schedule();
+                } catch(const std::bad_alloc&) {
+                    is_failed = true;
+                }
+                ++num_resumed;
+            }
+        };
+
+    co_spawn(serv, body());
+    serv.poll();
+
+    // Resumed once by exception, not by dropped resumer as well
+    REQUIRE(is_failed);
+    REQUIRE(num_resumed > 1);
+}
+
+} // namespace io_service
@@ -0,0 +1,106 @@
+#include <catch2/catch_all.hpp>
+
+#include <cstdint>
+#include <sstream>
+#include <vector>
+
+#include "task_trace.hpp"
+
+#include "jthread.hpp"
+
+
+namespace io_service {
+
+namespace {
+
+trace_event make_event(trace_event_type type, std::int64_t time_ns,
+    std::uint64_t task_id = 0, const char* label = nullptr
+) { return trace_event{type, time_ns, task_id, label}; }
+
+} // namespace
+
+TEST_CASE("trace_ring: keeps last events", "[task_trace]") {
+    detail::trace_ring ring(8);
+
+    std::vector<trace_event> events;
+    ring.snapshot(events);
+    REQUIRE(events.empty());
+
+    for(int i = 0; i < 20; ++i)
+        ring.record_owned(make_event(trace_event_type::post, i, i + 1));
+
+    ring.snapshot(events);
+    REQUIRE(events.size() == 8);
+    for(std::size_t i = 0; i < events.size(); ++i) {
+        REQUIRE(events[i].time_ns == static_cast<std::int64_t>(12 + i));
+        REQUIRE(events[i].task_id == 13 + i);
+    }
+}
+
+TEST_CASE("trace_ring: concurrent writers and reader", "[task_trace]") {
+    const int num_threads = 4;
+    const int num_events = 20000;
+    const std::size_t capacity = 256;
+
+    detail::trace_ring ring(capacity);
+    {
+        std::vector<concurrency::jthread> threads;
+        for(int i = 0; i < num_threads; ++i)
+            threads.emplace_back(
+                [&ring, i] () {
+                    // Time and id agree, so that torn events are noticed
+                    for(int j = 1; j <= num_events; ++j)
+                        ring.record(make_event(trace_event_type::start, j, i * num_events + j));
+                });
+
+        for(int i = 0; i < 100; ++i) {
+            std::vector<trace_event> events;
+            ring.snapshot(events);
+            REQUIRE(events.size() <= capacity);
+            for(const trace_event& event : events)
+                REQUIRE(static_cast<std::int64_t>((event.task_id - 1) % num_events) + 1
+                    == event.time_ns);
+        }
+    }
+
+    // Events of writers, which met within entry, are dropped
+    std::vector<trace_event> events;
+    ring.snapshot(events);
+    REQUIRE(events.size() <= capacity);
+    REQUIRE_FALSE(events.empty());
+}
+
+TEST_CASE("write_chrome_trace", "[task_trace]") {
+    service_trace trace;
+    trace.threads.push_back(thread_trace{0, false, {
+        make_event(trace_event_type::post, 1000, 1000, "say \"hi\""),
+        make_event(trace_event_type::post, 1500, 1500)}});
+    trace.threads.push_back(thread_trace{3, true, {
+        // Start of this one was overwritten
+        make_event(trace_event_type::end, 1200, 42),
+        make_event(trace_event_type::start, 2000, 1000),
+        make_event(trace_event_type::end, 4500, 1000),
+        make_event(trace_event_type::start, 5000, 1500)}});
+
+    std::ostringstream os;
+    write_chrome_trace(os, trace);
+    const std::string json = os.str();
+
+    using Catch::Matchers::ContainsSubstring;
+    REQUIRE_THAT(json,
+        Catch::Matchers::StartsWith("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[")
+        && ContainsSubstring("\"args\":{\"name\":\"worker 3\"}")
+        && ContainsSubstring(
+            "{\"ph\":\"i\",\"s\":\"t\",\"name\":\"post\","
+            "\"args\":{\"task\":\"say \\\"hi\\\"\"},\"ts\":0.000,\"pid\":1,\"tid\":0}")
+        && ContainsSubstring(
+            "{\"ph\":\"B\",\"name\":\"say \\\"hi\\\"\",\"ts\":1.000,\"pid\":1,\"tid\":4}")
+        && ContainsSubstring("\"ph\":\"f\",\"name\":\"task\",\"cat\":\"io_service\",\"id\":\"0x3e8\"")
+        && ContainsSubstring("{\"ph\":\"E\",\"ts\":3.500,\"pid\":1,\"tid\":4}")
+        && ContainsSubstring("{\"ph\":\"B\",\"name\":\"task\",\"ts\":4.000,\"pid\":1,\"tid\":4}"));
+
+    // Single end is written, for task which started
+    REQUIRE(json.find("\"ph\":\"E\"") == json.rfind("\"ph\":\"E\""));
+}
+
+} // namespace io_service
@@ -1,5 +1,8 @@
 #include <catch2/catch_all.hpp>
+#include <atomic>
 #include <future>
+#include <iterator>
+#include <thread>
 #include <vector>
 
 #include "invocable.hpp"
@@ -23,6 +26,56 @@ TEST_CASE("queue creation") {
     REQUIRE(iqueue.try_pop(get_data) == false);
 }
 
+TEST_CASE("queue bulk push") {
+    std::vector<int> values = {1, 2, 3, 4, 5};
+    threadsafe_queue<int> iqueue;
+
+    REQUIRE(iqueue.push_bulk(values.begin(), values.begin()) == 0);
+    REQUIRE(iqueue.empty());
+
+    iqueue.push(0);
+    REQUIRE(iqueue.push_bulk(values.begin(), values.end()) == values.size());
+    iqueue.push(6);
+
+    int get_data;
+    for(int expected = 0; expected <= 6; ++expected) {
+        REQUIRE(iqueue.try_pop(get_data));
+        REQUIRE(get_data == expected);
+    }
+    REQUIRE(iqueue.try_pop(get_data) == false);
+}
+
+TEST_CASE("queue batched pop") {
+    std::vector<int> values = {1, 2, 3, 4, 5};
+    threadsafe_queue<int> iqueue;
+    iqueue.push_bulk(values.begin(), values.end());
+
+    std::vector<int> popped;
+    REQUIRE(iqueue.try_pop_n(std::back_inserter(popped), 2) == 2);
+    REQUIRE(iqueue.wait_and_pop_n(std::back_inserter(popped), 10) == 3);
+    REQUIRE(popped == values);
+
+    REQUIRE(iqueue.try_pop_n(std::back_inserter(popped), 2) == 0);
+
+    // Interrupted by predicate
+    REQUIRE(iqueue.wait_and_pop_n(
+        std::back_inserter(popped), 2, [] () { return true; }) == 0);
+}
+
+TEST_CASE("queue clear reports dropped elements") {
+    std::vector<int> values = {1, 2, 3, 4, 5};
+    threadsafe_queue<int> iqueue;
+    iqueue.push_bulk(values.begin(), values.end());
+
+    std::vector<int> dropped;
+    iqueue.clear([&dropped] (const int& val) { dropped.push_back(val); });
+    REQUIRE(dropped == values);
+    REQUIRE(iqueue.empty());
+
+    int get_data;
+    REQUIRE(iqueue.try_pop(get_data) == false);
+}
+
 TEST_CASE("queue accessed by 2 threads") {
     int const valid_sequence[] = {1, 2, 3, 4, 5, 5, 6, -1};
     size_t const valid_seq_size = 
@@ -126,4 +179,50 @@ TEST_CASE("queue accessed by multiple threads") {
     REQUIRE(all_true);
 };
 
+TEST_CASE("queue wakes blocked consumers") {
+    const int num_elems = 2000;
+    const int num_consumers = 4;
+
+    threadsafe_queue<int> queue;
+    std::atomic<int> num_popped(0);
+
+    auto all_popped =
+        [&num_popped, num_elems] () { return num_popped >= num_elems; };
+
+    // Blocking consumers, and one polling, which takes data
+    // from under the nose of woken ones
+    auto consumer_thread =
+        [&] () {
+            int out_val;
+            while(queue.wait_and_pop(out_val, all_popped))
+                if(++num_popped == num_elems)
+                    queue.signal();
+        };
+
+    auto polling_thread =
+        [&] () {
+            int out_val;
+            while(!all_popped())
+                if(queue.try_pop(out_val) && ++num_popped == num_elems)
+                    queue.signal();
+        };
+
+    {
+        using namespace concurrency;
+        std::vector<jthread> consumers;
+        for(int i = 0; i < num_consumers; ++i)
+            consumers.emplace_back(consumer_thread);
+        consumers.emplace_back(polling_thread);
+
+        // Pauses let consumers block between pushes
+        for(int i = 0; i < num_elems; ++i) {
+            queue.push(i);
+            if(i % 16 == 0)
+                std::this_thread::yield();
+        }
+    }
+
+    REQUIRE(num_popped == num_elems);
+}
+
 } // namespace io_service
@@ -0,0 +1,128 @@
+#include <catch2/catch_all.hpp>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "timer_wheel.hpp"
+
+
+namespace io_service {
+
+namespace {
+
+struct test_timer: detail::timer_wheel_node {
+    std::uint64_t fired_at = 0;
+    bool is_fired = false;
+};
+
+// Advances wheel tick by tick. Records tick of every expiry
+std::size_t advance_to(timer_wheel& wheel, std::uint64_t now_tick) {
+    std::size_t num_expired = 0;
+    for(std::uint64_t tick = wheel.current_tick(); tick <= now_tick; ++tick)
+        num_expired += wheel.advance(tick,
+            [tick] (timer_wheel::node_type* node) {
+                test_timer* timer = static_cast<test_timer*>(node);
+                timer->fired_at = tick;
+                timer->is_fired = true;
+            });
+
+    return num_expired;
+}
+
+} // namespace
+
+TEST_CASE("timer_wheel: expiry", "[timer_wheel]") {
+    timer_wheel wheel;
+    REQUIRE(wheel.empty());
+    REQUIRE(wheel.next_event_tick() == timer_wheel::no_event);
+
+    SECTION("within first level") {
+        test_timer timer;
+        wheel.insert(&timer, 10);
+        REQUIRE(wheel.next_event_tick() == 10);
+
+        REQUIRE(advance_to(wheel, 9) == 0);
+        REQUIRE(advance_to(wheel, 10) == 1);
+        REQUIRE(timer.fired_at == 10);
+    }
+
+    SECTION("cascaded from upper levels") {
+        const std::uint64_t expiries[] = {64, 100, 4095, 4096, 300000};
+        std::vector<test_timer> timers(std::size(expiries));
+        for(std::size_t i = 0; i < timers.size(); ++i)
+            wheel.insert(&timers[i], expiries[i]);
+
+        REQUIRE(advance_to(wheel, 300000) == timers.size());
+        for(std::size_t i = 0; i < timers.size(); ++i)
+            REQUIRE(timers[i].fired_at == expiries[i]);
+    }
+
+    SECTION("beyond last level") {
+        const std::uint64_t expiry = (std::uint64_t(1) << 24) + 5;
+        test_timer timer;
+        wheel.insert(&timer, expiry);
+
+        // Jump over empty ticks
+        REQUIRE(wheel.advance(expiry - 1, [] (timer_wheel::node_type*) {}) == 0);
+        REQUIRE(advance_to(wheel, expiry) == 1);
+        REQUIRE(timer.fired_at == expiry);
+    }
+
+    SECTION("already due") {
+        advance_to(wheel, 50);
+
+        test_timer timer;
+        wheel.insert(&timer, 20);
+        REQUIRE(wheel.next_event_tick() == 50);
+        REQUIRE(advance_to(wheel, 50) == 1);
+    }
+
+    REQUIRE(wheel.empty());
+}
+
+TEST_CASE("timer_wheel: remove", "[timer_wheel]") {
+    timer_wheel wheel;
+    test_timer first, second;
+    wheel.insert(&first, 5);
+    wheel.insert(&second, 1000);
+
+    REQUIRE(wheel.remove(&second));
+    REQUIRE_FALSE(wheel.remove(&second));
+    REQUIRE(wheel.size() == 1);
+    // Only first is left on wheel
+    REQUIRE(wheel.next_event_tick() == 5);
+
+    REQUIRE(advance_to(wheel, 2000) == 1);
+    REQUIRE(first.is_fired);
+    REQUIRE_FALSE(second.is_fired);
+}
+
+TEST_CASE("timer_wheel: large jumps do not fire early", "[timer_wheel]") {
+    const std::size_t num_timers = 2000;
+
+    timer_wheel wheel;
+    std::mt19937_64 gen(42);
+    std::uniform_int_distribution<std::uint64_t> dist(1, 1 << 20);
+
+    std::vector<test_timer> timers(num_timers);
+    for(test_timer& timer : timers)
+        wheel.insert(&timer, dist(gen));
+
+    std::uint64_t now_tick = 0;
+    std::size_t num_expired = 0;
+    while(!wheel.empty()) {
+        now_tick += dist(gen) / 64;
+        num_expired += wheel.advance(now_tick,
+            [now_tick] (timer_wheel::node_type* node) {
+                REQUIRE(node->expiry <= now_tick);
+                static_cast<test_timer*>(node)->is_fired = true;
+            });
+
+        // Nothing due is left behind
+        REQUIRE(wheel.next_event_tick() > now_tick);
+    }
+
+    REQUIRE(num_expired == num_timers);
+}
+
+} // namespace io_service
@@ -0,0 +1,232 @@
+#include <catch2/catch_all.hpp>
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "io_service.hpp"
+#include "uring_proactor.hpp"
+
+#include "jthread.hpp"
+
+
+namespace io_service {
+
+namespace {
+
+void run_worker(io_service* serv_ptr) {
+    try {
+        serv_ptr->run();
+    } catch(const service_stopped_error&) {}
+}
+
+struct io_result {
+    std::error_code ec;
+    std::size_t bytes;
+};
+
+struct promise_handler {
+    std::shared_ptr<std::promise<io_result>> prom;
+
+    void operator()(std::error_code ec, std::size_t bytes)
+    { prom->set_value(io_result{ec, bytes}); }
+};
+
+std::future<io_result> make_handler(promise_handler& handler) {
+    handler.prom = std::make_shared<std::promise<io_result>>();
+    return handler.prom->get_future();
+}
+
+service_options uring_options() {
+    service_options options;
+    options.io_backend = io_backend_type::io_uring;
+    return options;
+}
+
+// Unlinked right away, closed by destructor
+struct temp_file {
+    int fd;
+
+    temp_file() {
+        char path[] = "/tmp/io_service_uring_XXXXXX";
+        fd = ::mkstemp(path);
+        ::unlink(path);
+    }
+
+    ~temp_file()
+    { ::close(fd); }
+};
+
+} // namespace
+
+TEST_CASE("uring_proactor: backend selection", "[io_service][uring]") {
+    io_service serv(uring_options());
+    if(uring_proactor::is_supported())
+        REQUIRE(serv.backend_type() == io_backend_type::io_uring);
+    else
+        REQUIRE(serv.backend_type() == io_backend_type::epoll);
+
+    // Default stays readiness-based
+    io_service default_serv;
+    REQUIRE(default_serv.backend_type() == io_backend_type::epoll);
+}
+
+TEST_CASE("uring_proactor: pipe", "[io_service][uring]") {
+    if(!uring_proactor::is_supported()) {
+        WARN("io_uring is not available");
+        return;
+    }
+
+    int fds[2];
+    REQUIRE(::pipe(fds) == 0);
+
+    io_service serv(uring_options());
+    descriptor_handle read_end = serv.register_descriptor(fds[0]);
+    descriptor_handle write_end = serv.register_descriptor(fds[1]);
+
+    std::vector<concurrency::jthread> threads;
+    for(int i = 0; i < 2; ++i)
+        threads.emplace_back(run_worker, &serv);
+
+    SECTION("reads complete in order of initiation") {
+        char first[3] = {};
+        char second[3] = {};
+        promise_handler first_handler;
+        promise_handler second_handler;
+        std::future<io_result> first_fut = make_handler(first_handler);
+        std::future<io_result> second_fut = make_handler(second_handler);
+        serv.async_read_some(read_end, first, sizeof(first), first_handler);
+        serv.async_read_some(read_end, second, sizeof(second), second_handler);
+
+        REQUIRE(first_fut.wait_for(std::chrono::milliseconds(20))
+            == std::future_status::timeout);
+
+        promise_handler write_handler;
+        std::future<io_result> write_fut = make_handler(write_handler);
+        serv.async_write_some(write_end, "abc", 3, write_handler);
+        REQUIRE(write_fut.get().bytes == 3);
+        REQUIRE(first_fut.get().bytes == 3);
+        REQUIRE(std::string(first, 3) == "abc");
+
+        write_fut = make_handler(write_handler);
+        serv.async_write_some(write_end, "def", 3, write_handler);
+        REQUIRE(write_fut.get().bytes == 3);
+        REQUIRE(second_fut.get().bytes == 3);
+        REQUIRE(std::string(second, 3) == "def");
+    }
+
+    SECTION("deregister cancels read in flight") {
+        char buf[16];
+        promise_handler handler;
+        std::future<io_result> fut = make_handler(handler);
+        serv.async_read_some(read_end, buf, sizeof(buf), handler);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        serv.deregister_descriptor(read_end);
+
+        REQUIRE(fut.get().ec == std::errc::operation_canceled);
+
+        promise_handler after_handler;
+        std::future<io_result> after_fut = make_handler(after_handler);
+        serv.async_read_some(read_end, buf, sizeof(buf), after_handler);
+        REQUIRE(after_fut.get().ec == std::errc::bad_file_descriptor);
+    }
+
+    serv.stop();
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+TEST_CASE("uring_proactor: file I/O", "[io_service][uring]") {
+    if(!uring_proactor::is_supported()) {
+        WARN("io_uring is not available");
+        return;
+    }
+
+    const std::size_t block_size = 4096;
+    const std::size_t num_blocks = 64;
+
+    temp_file file;
+    REQUIRE(file.fd != -1);
+
+    io_service serv(uring_options());
+    descriptor_handle handle = serv.register_descriptor(file.fd);
+
+    std::vector<concurrency::jthread> threads;
+    for(int i = 0; i < 2; ++i)
+        threads.emplace_back(run_worker, &serv);
+
+    std::vector<char> data(block_size * num_blocks);
+    for(std::size_t i = 0; i < data.size(); ++i)
+        data[i] = static_cast<char>(i * 31 + i / block_size);
+
+    SECTION("plain buffers") {
+        // Issued at once, submitted in batches
+        std::vector<promise_handler> handlers(num_blocks);
+        std::vector<std::future<io_result>> futs;
+        for(std::size_t i = 0; i < num_blocks; ++i) {
+            futs.push_back(make_handler(handlers[i]));
+            serv.async_write_at(handle, i * block_size,
+                &data[i * block_size], block_size, handlers[i]);
+        }
+        for(std::future<io_result>& fut : futs) {
+            io_result res = fut.get();
+            REQUIRE(!res.ec);
+            REQUIRE(res.bytes == block_size);
+        }
+
+        std::vector<char> read_back(data.size());
+        futs.clear();
+        for(std::size_t i = num_blocks; i-- > 0; ) {
+            futs.push_back(make_handler(handlers[i]));
+            serv.async_read_at(handle, i * block_size,
+                &read_back[i * block_size], block_size, handlers[i]);
+        }
+        for(std::future<io_result>& fut : futs)
+            REQUIRE(fut.get().bytes == block_size);
+
+        REQUIRE(read_back == data);
+
+        // Past end of file
+        char buf[16];
+        promise_handler eof_handler;
+        std::future<io_result> eof_fut = make_handler(eof_handler);
+        serv.async_read_at(handle, data.size(), buf, sizeof(buf), eof_handler);
+        io_result res = eof_fut.get();
+        REQUIRE(!res.ec);
+        REQUIRE(res.bytes == 0);
+    }
+
+    SECTION("registered buffers") {
+        std::vector<char> read_back(data.size());
+        std::vector<iovec> buffers = {
+            iovec{data.data(), data.size()},
+            iovec{read_back.data(), read_back.size()}};
+        if(!serv.register_buffers(buffers)) {
+            WARN("Buffers can not be registered");
+            return;
+        }
+
+        promise_handler handler;
+        std::future<io_result> fut = make_handler(handler);
+        serv.async_write_at(handle, 0, data.data(), data.size(), handler);
+        REQUIRE(fut.get().bytes == data.size());
+
+        fut = make_handler(handler);
+        serv.async_read_at(handle, block_size,
+            &read_back[block_size], block_size, handler);
+        REQUIRE(fut.get().bytes == block_size);
+        REQUIRE(std::memcmp(&read_back[block_size], &data[block_size], block_size) == 0);
+
+        REQUIRE(serv.register_buffers(std::vector<iovec>()));
+    }
+
+    serv.deregister_descriptor(handle);
+    serv.stop();
+}
+
+} // namespace io_service
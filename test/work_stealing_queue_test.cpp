@@ -0,0 +1,81 @@
+#include <catch2/catch_all.hpp>
+#include <atomic>
+#include <vector>
+
+#include "work_stealing_queue.hpp"
+
+#include "jthread.hpp"
+
+
+namespace io_service {
+
+TEST_CASE("work_stealing_queue: owner pop and steal", "[work_stealing_queue]") {
+    work_stealing_queue<int> queue;
+    REQUIRE(queue.empty());
+
+    int out_val = 0;
+    REQUIRE(queue.try_pop(out_val) == false);
+    REQUIRE(queue.try_steal(out_val) == false);
+
+    queue.push(1);
+    queue.push(2);
+    queue.push(3);
+    REQUIRE(queue.size() == 3);
+
+    // Both ends keep FIFO order
+    REQUIRE(queue.try_pop(out_val));
+    REQUIRE(out_val == 1);
+    REQUIRE(queue.try_steal(out_val));
+    REQUIRE(out_val == 2);
+
+    queue.clear();
+    REQUIRE(queue.empty());
+    REQUIRE(queue.try_pop(out_val) == false);
+}
+
+TEST_CASE("work_stealing_queue: thieves and owner", "[work_stealing_queue]") {
+    const int num_items = 4096;
+    const int num_thieves = 8;
+
+    work_stealing_queue<int> queue;
+    std::atomic<int> items_taken(0);
+    std::atomic<long> sum_taken(0);
+
+    {
+        using namespace concurrency;
+        std::vector<jthread> thieves;
+
+        jthread owner(
+            [&] () {
+                for(int i = 1; i <= num_items; ++i) {
+                    queue.push(i);
+
+                    int out_val;
+                    if(i % 2 == 0 && queue.try_pop(out_val)) {
+                        sum_taken += out_val;
+                        ++items_taken;
+                    }
+                }
+            });
+
+        for(int i = 0; i < num_thieves; ++i)
+            thieves.push_back(jthread(
+                [&] () {
+                    int out_val;
+                    while(items_taken < num_items) {
+                        if(!queue.try_steal(out_val))
+                            continue;
+
+                        sum_taken += out_val;
+                        ++items_taken;
+                    }
+                }));
+    }
+
+    // Every item is taken exactly once
+    REQUIRE(items_taken == num_items);
+    REQUIRE(sum_taken == (long(num_items) * (num_items + 1)) / 2);
+    REQUIRE(queue.empty());
+}
+
+} // namespace io_service